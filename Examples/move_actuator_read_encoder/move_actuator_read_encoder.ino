@@ -20,6 +20,7 @@
 #include "LinActStepper.h"
 #include "RotaryEncoder.h"
 #include "SerialComm.h"
+#include "SerialLog.h"
 
 
 // Serial Settings
@@ -27,20 +28,21 @@ static const uint32_t SERIAL_BAUD_RATE = 2000000;
 
 
 // Encoder Settings
-static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Connect to External Interrupt pins
+static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Any two pins, see RotaryEncoder.h
 static const uint16_t CPR = 4000; // Encoder's counts per revolution
 
 
 // Linear Actuator Settings
-static const uint8_t STEPPER_PINS[4] = {7,4,6,5};
-static const uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
-static const uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
-static const uint8_t LEAD_LENGTH = 12; // in mm.
+static constexpr uint8_t STEPPER_PINS[4] = {7,4,6,5}; // constexpr: the pins are template parameters of "Fixed" below
+static constexpr uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
+static constexpr uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
+static constexpr uint8_t LEAD_LENGTH = 12; // in mm.
 
 
 // Get objects for Encoder and Linear actuator
 static RotaryEncoder::Obj my_rotary = RotaryEncoder::init(ENCODER_PINS, CPR);
-static LinActStepper::Obj my_actuator = LinActStepper::init(STEPPER_PINS, NUM_STEPS, LEAD_LENGTH, MICRO_STEPS);
+static LinActStepper::Obj my_actuator = LinActStepper::Fixed<STEPPER_PINS[0], STEPPER_PINS[1], STEPPER_PINS[2], STEPPER_PINS[3],
+                                                  NUM_STEPS, LEAD_LENGTH, MICRO_STEPS>::init();
 
 
 
@@ -67,7 +69,14 @@ void loop(){
 
 	float displacement = Serial.parseFloat();
 	Serial.read(); // Clear i/p buffer
-	LinActStepper::move(my_actuator, displacement);
+	LinActStepper::moveAsync(my_actuator, displacement); // Returns immediately, the motor moves in the background
+
+	// Print the encoder values while the actuator is moving
+	while (LinActStepper::isMoving(my_actuator)){
+		RotaryEncoder::printAll(my_rotary);
+		SerialLog::drain(); // Sends what the serial port can take now, see SerialLog.h
+		delay(1);
+	}
 
 	RotaryEncoder::printAll(my_rotary);
 	delay(1);
@@ -28,15 +28,15 @@ static const uint32_t SERIAL_BAUD_RATE = 2000000;
 
 
 // Encoder Settings
-static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Connect to External Interrupt pins
+static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Any two pins, see RotaryEncoder.h
 static const uint16_t CPR = 4000; // Encoder's counts per revolution
 
 
 // Linear Actuator Settings
-static const uint8_t STEPPER_PINS[4] = {7,4,6,5};
-static const uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
-static const uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
-static const uint8_t LEAD_LENGTH = 12; // in mm.
+static constexpr uint8_t STEPPER_PINS[4] = {7,4,6,5}; // constexpr: the pins are template parameters of "Fixed" below
+static constexpr uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
+static constexpr uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
+static constexpr uint8_t LEAD_LENGTH = 12; // in mm.
 
 
 // System Settings
@@ -52,10 +52,11 @@ namespace ns_act = LinActStepper;
 
 // Get objects for Encoder and Linear actuator
 static ns_rot::Obj my_rotary   = ns_rot::init(ENCODER_PINS, CPR);
-static ns_act::Obj my_actuator = ns_act::init(STEPPER_PINS, NUM_STEPS, LEAD_LENGTH, MICRO_STEPS);
+static ns_act::Obj my_actuator = ns_act::Fixed<STEPPER_PINS[0], STEPPER_PINS[1], STEPPER_PINS[2], STEPPER_PINS[3],
+                                                  NUM_STEPS, LEAD_LENGTH, MICRO_STEPS>::init();
 static ns_sys::Obj my_system   = ns_sys::init(my_rotary, my_actuator, TOLERANCE_FACTOR);
 // Note: You can create any number of actuators and create any number of systems based on encoders and actuators.
-//       But you can only use 1 encoder/arduino because of the lack of external interrupt pins.
+//       Up to RotaryEncoder::MAX_ENCODERS encoders can be used on the same arduino.
 
 
 
@@ -82,6 +83,12 @@ void loop(){
 	float displacement = Serial.parseFloat();
 	Serial.read();	// Clear i/p buffer
 	ns_sys::moveTo(my_system, displacement);
+
+	// One start means that the actuator got there in one continuous motion
+	Serial.print("Settle time(us), Starts: ");
+	Serial.print(ns_sys::getSettleTime(my_system));
+	Serial.print(", ");
+	Serial.println(ns_sys::getStarts(my_system));
   
 	ns_rot::printAll(my_rotary);
 	delay(1);
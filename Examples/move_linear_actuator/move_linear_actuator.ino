@@ -26,13 +26,14 @@ static const uint32_t SERIAL_BAUD_RATE = 2000000;
 
 
 // Linear Actuator Settings
-static const uint8_t STEPPER_PINS[4] = {7,4,6,5};
-static const uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
-static const uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
-static const uint8_t LEAD_LENGTH = 12; // in mm.
+static constexpr uint8_t STEPPER_PINS[4] = {7,4,6,5}; // constexpr: the pins are template parameters of "Fixed" below
+static constexpr uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
+static constexpr uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
+static constexpr uint8_t LEAD_LENGTH = 12; // in mm.
 
 // Setup the linear actuator
-static LinActStepper::Obj my_actuator = LinActStepper::init(STEPPER_PINS, NUM_STEPS, LEAD_LENGTH, MICRO_STEPS);
+static LinActStepper::Obj my_actuator = LinActStepper::Fixed<STEPPER_PINS[0], STEPPER_PINS[1], STEPPER_PINS[2], STEPPER_PINS[3],
+                                                  NUM_STEPS, LEAD_LENGTH, MICRO_STEPS>::init();
 
 void setup(){
 
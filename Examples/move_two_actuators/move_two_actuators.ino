@@ -0,0 +1,73 @@
+/*
+	This code moves two linear actuators together, so that both of them
+	start and reach the distances specified by the user at the same time.
+
+	Setup:
+	Two linear actuators, each with its own motor driver (see
+	"move_linear_actuator"). The PWM pins of the second driver are on
+	pins 11 and 3 (Timer2), pins 9 and 10 cannot be used for PWM because
+	the moves use Timer1 (see StepTimer.h).
+
+
+	GNU GPL License
+ */
+
+#include "LinActStepper.h"
+#include "LinActMultiAxis.h"
+#include "SerialComm.h"
+
+
+// Serial Settings
+static const uint32_t SERIAL_BAUD_RATE = 2000000;
+
+
+// Linear Actuator Settings
+static constexpr uint8_t STEPPER_PINS_X[4] = {7,4,6,5}; // constexpr: the pins are template parameters of "Fixed" below
+static constexpr uint8_t STEPPER_PINS_Y[4] = {8,12,11,3};
+static constexpr uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
+static constexpr uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
+static constexpr uint8_t LEAD_LENGTH = 12; // in mm.
+static const double MAX_SPEED = 5.0; // in mm/s, for each actuator
+
+
+// Shorthand notation for namespace.
+namespace ns_act = LinActStepper;
+namespace ns_mul = LinActMultiAxis;
+
+
+// Setup the linear actuators and the group that moves them together
+static ns_act::Obj actuator_x = ns_act::Fixed<STEPPER_PINS_X[0], STEPPER_PINS_X[1], STEPPER_PINS_X[2], STEPPER_PINS_X[3],
+                                              NUM_STEPS, LEAD_LENGTH, MICRO_STEPS>::init();
+static ns_act::Obj actuator_y = ns_act::Fixed<STEPPER_PINS_Y[0], STEPPER_PINS_Y[1], STEPPER_PINS_Y[2], STEPPER_PINS_Y[3],
+                                              NUM_STEPS, LEAD_LENGTH, MICRO_STEPS>::init();
+static ns_act::Obj* const actuators[2] = {&actuator_x, &actuator_y};
+static ns_mul::Obj my_group = ns_mul::init(actuators, 2);
+
+void setup(){
+
+	ns_mul::printCommands(my_group, true);
+
+	// Each axis is limited to its own speed
+	ns_act::setMaxSpeed(actuator_x, MAX_SPEED);
+	ns_act::setMaxSpeed(actuator_y, MAX_SPEED);
+
+	// Start communication
+	Serial.begin(SERIAL_BAUD_RATE);
+	delay(1);
+}
+
+void loop(){
+
+	Serial.println("Enter distances to move from current position (in mm), X and Y: ");
+	SerialComm::waitForSignal();
+
+	double displacement[2];
+	displacement[0] = Serial.parseFloat();
+	displacement[1] = Serial.parseFloat();
+	Serial.read(); // Clear the i/p buffer
+	ns_mul::move(my_group, displacement);
+
+	Serial.print("Steps per second, both axes: ");
+	Serial.println(ns_mul::getAggregateRate(my_group));
+	delay(1);
+}
@@ -27,7 +27,7 @@ static const uint32_t SERIAL_BAUD_RATE = 2000000;
 
 
 // Encoder Settings
-static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Connect to External Interrupt pins
+static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Any two pins, see RotaryEncoder.h
 static const uint16_t CPR = 4000; // Encoder's counts per revolution
 
 static RotaryEncoder::Obj my_rotary = RotaryEncoder::init(ENCODER_PINS, CPR); // Initialize encoders
@@ -0,0 +1,193 @@
+/*
+	FrameDecoder.h - Library for the PC that decodes the binary frames sent
+	by "SerialComm" (see SerialFrame.h for the layout).
+
+	GNU GPL License
+ */
+
+#include "FrameDecoder.h"
+#include <string.h>
+
+
+namespace ns_dec = Communication::FrameDecoder;
+
+
+ns_dec::Obj ns_dec::init(){
+
+	ns_dec::Obj my_decoder;
+	memset(&my_decoder, 0, sizeof(my_decoder));
+
+	return my_decoder;
+}
+
+
+// Drops the first byte of the buffer and looks for the next sync bytes in the rest of it
+static void resync(ns_dec::Obj& my_decoder){
+	uint8_t start = 1;
+	while (start < my_decoder.index && my_decoder.buffer[start] != SerialFrame::SYNC_1){
+		start++;
+	}
+
+	my_decoder.stats.skipped_bytes += start;
+	my_decoder.index -= start;
+	memmove(my_decoder.buffer, my_decoder.buffer + start, my_decoder.index);
+}
+
+
+// Checks the bytes received so far. Returns 1 for a complete good frame, 0 to wait for more bytes, -1 if they aren't a frame.
+static int check(ns_dec::Obj& my_decoder){
+	const uint8_t* buffer = my_decoder.buffer;
+	uint8_t index = my_decoder.index;
+
+	if (index >= 1 && buffer[0] != SerialFrame::SYNC_1) return -1;
+	if (index >= 2 && buffer[1] != SerialFrame::SYNC_2) return -1;
+	if (index < SerialFrame::HEADER_SIZE) return 0;
+
+	uint8_t length = buffer[5];
+	if (length > SerialFrame::MAX_PAYLOAD) return -1;
+	if (index < SerialFrame::HEADER_SIZE + length + SerialFrame::CRC_SIZE) return 0;
+
+	uint16_t crc = SerialFrame::crc16(buffer + 2, SerialFrame::HEADER_SIZE - 2 + length);
+	uint16_t received = buffer[SerialFrame::HEADER_SIZE + length] | (buffer[SerialFrame::HEADER_SIZE + length + 1] << 8);
+	if (crc != received){
+		my_decoder.stats.crc_errors++;
+		return -1;
+	}
+	return 1;
+}
+
+
+bool ns_dec::feed(ns_dec::Obj& my_decoder, const uint8_t& data){
+
+	my_decoder.buffer[my_decoder.index++] = data;
+
+	int result = check(my_decoder);
+	while (result < 0){
+		// A false start: the sync bytes can be inside a frame that was cut, look again after them
+		resync(my_decoder);
+		result = (my_decoder.index > 0) ? check(my_decoder) : 0;
+	}
+	if (result == 0){
+		return false;
+	}
+
+	ns_dec::Frame& frame = my_decoder.frame;
+	frame.type   = my_decoder.buffer[2];
+	frame.seq    = my_decoder.buffer[3] | (my_decoder.buffer[4] << 8);
+	frame.length = my_decoder.buffer[5];
+	memcpy(frame.payload, my_decoder.buffer + SerialFrame::HEADER_SIZE, frame.length);
+
+	// The sequence number wraps around, so does the difference
+	frame.gap = my_decoder.synced ? static_cast<uint16_t>(frame.seq - my_decoder.next_seq) : 0;
+	my_decoder.synced   = true;
+	my_decoder.next_seq = frame.seq + 1;
+
+	my_decoder.stats.frames++;
+	my_decoder.stats.lost_frames += frame.gap;
+
+	// After a resync, the bytes behind the frame can already be the start of the next one
+	uint8_t size = SerialFrame::HEADER_SIZE + frame.length + SerialFrame::CRC_SIZE;
+	my_decoder.index -= size;
+	memmove(my_decoder.buffer, my_decoder.buffer + size, my_decoder.index);
+
+	return true;
+}
+
+
+uint8_t ns_dec::numSamples(const ns_dec::Frame& frame){
+	return (frame.type == SerialFrame::TYPE_SAMPLE) ? frame.length / SerialFrame::SAMPLE_SIZE : 0;
+}
+
+
+SerialFrame::Sample ns_dec::getSample(const ns_dec::Frame& frame, const uint8_t& index){
+	return SerialFrame::unpackSample(frame.payload + index*SerialFrame::SAMPLE_SIZE);
+}
+
+
+ns_dec::Reader ns_dec::startSamples(const ns_dec::Frame& frame){
+	(void)frame;
+	ns_dec::Reader reader;
+	memset(&reader, 0, sizeof(reader));
+	return reader;
+}
+
+
+bool ns_dec::nextSample(const ns_dec::Frame& frame, ns_dec::Reader& reader, SerialFrame::Sample& sample){
+
+	if (frame.type == SerialFrame::TYPE_SAMPLE){
+		if (reader.offset + SerialFrame::SAMPLE_SIZE > frame.length){
+			return false;
+		}
+		sample = SerialFrame::unpackSample(frame.payload + reader.offset);
+		reader.offset += SerialFrame::SAMPLE_SIZE;
+		return true;
+	}
+	if (frame.type != SerialFrame::TYPE_DELTA || reader.error){
+		return false;
+	}
+
+	if (reader.run > 0){
+		reader.run--;
+		reader.last.time += reader.step;
+		sample = reader.last;
+		return true;
+	}
+	if (reader.offset >= frame.length){
+		return false;
+	}
+
+	const uint8_t* payload = frame.payload;
+	uint8_t left = frame.length - reader.offset;
+	uint32_t tag;
+	uint8_t size = SerialFrame::getVarint(payload + reader.offset, left, tag);
+
+	// Every frame starts with a KEY, everything else is a change from the sample before
+	bool key = (size > 0 && tag == SerialFrame::TAG_KEY);
+	bool run = (size > 0 && (tag & 3) == SerialFrame::TAG_RUN);
+	bool small = (!key && (tag & 3) == SerialFrame::TAG_SMALL);
+	const int8_t SMALL = SerialFrame::MAX_SMALL_CHANGE;
+	if (size == 0 || (reader.offset == 0) != key || (small && (tag >> 2) > (2*SMALL + 1) * (2*SMALL + 1)) || (run && (tag >> 2) == 0)){
+		reader.error = true;
+		return false;
+	}
+
+	if (key){
+		if (size + SerialFrame::SAMPLE_SIZE > left){
+			reader.error = true;
+			return false;
+		}
+		reader.last = SerialFrame::unpackSample(payload + reader.offset + size);
+		reader.step = 0;
+		reader.offset += size + SerialFrame::SAMPLE_SIZE;
+	}
+	else if (run){
+		reader.offset += size;
+		reader.run = (tag >> 2) - 1;
+		reader.last.time += reader.step;
+	}
+	else if (small){
+		uint8_t code = (tag >> 2) - 1;
+		reader.offset += size;
+		reader.last.time += reader.step;
+		reader.last.position += code / (2*SMALL + 1) - SMALL;
+		reader.last.analog += code % (2*SMALL + 1) - SMALL;
+	}
+	else {
+		uint32_t position_change, analog_change;
+		uint8_t position_size = SerialFrame::getVarint(payload + reader.offset + size, left - size, position_change);
+		uint8_t analog_size = (position_size > 0) ?
+			SerialFrame::getVarint(payload + reader.offset + size + position_size, left - size - position_size, analog_change) : 0;
+		if (analog_size == 0){
+			reader.error = true;
+			return false;
+		}
+		reader.step += static_cast<uint32_t>(SerialFrame::unzigzag(tag >> 1));
+		reader.last.time += reader.step;
+		reader.last.position = static_cast<int32_t>(static_cast<uint32_t>(reader.last.position) + static_cast<uint32_t>(SerialFrame::unzigzag(position_change)));
+		reader.last.analog = static_cast<uint16_t>(reader.last.analog + SerialFrame::unzigzag(analog_change));
+		reader.offset += size + position_size + analog_size;
+	}
+
+	sample = reader.last;
+	return true;
+}
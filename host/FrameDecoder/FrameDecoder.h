@@ -0,0 +1,96 @@
+/*
+	FrameDecoder.h - Library for the PC that decodes the binary frames sent
+	by "SerialComm" (see SerialFrame.h for the layout). It is plain C++, it
+	doesn't need Arduino.
+
+	How to use:
+	Feed it the bytes as they come from the serial port, one at a time.
+	"feed" returns true every time a complete frame with a good CRC has been
+	received, the frame is then in "my_decoder.frame". Bytes that don't
+	belong to a frame are skipped till the next sync bytes, so it doesn't
+	matter where in the stream the PC starts listening.
+
+	Lost frames:
+	"frame.gap" is the num of frames that are missing right before this one,
+	from the sequence numbers. A frame with a bad CRC is dropped, so it
+	shows up as a gap in the next good frame. "stats" keeps the totals.
+
+	Samples:
+	"startSamples" and "nextSample" read the samples of a frame one after
+	the other, for both TYPE_SAMPLE and TYPE_DELTA (which has no fixed
+	num of samples per frame):
+
+	FrameDecoder::Reader reader = FrameDecoder::startSamples(frame);
+	SerialFrame::Sample sample;
+	while (FrameDecoder::nextSample(frame, reader, sample)) { ... }
+
+	"reader.error" is true afterwards if the payload didn't follow the
+	layout (the samples up to there are fine).
+
+
+	GNU GPL License
+ */
+
+
+#include <stdint.h>
+#include "SerialFrame.h"
+
+
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+namespace Communication{
+	namespace FrameDecoder{
+
+		struct Frame{
+			uint8_t type;
+			uint16_t seq;
+			uint8_t length;
+			uint8_t payload[SerialFrame::MAX_PAYLOAD];
+			uint16_t gap; // Num of frames lost right before this one
+		};
+
+		struct Stats{
+			unsigned long frames;        // Good frames
+			unsigned long lost_frames;   // From the gaps in the sequence numbers
+			unsigned long crc_errors;
+			unsigned long skipped_bytes; // Bytes that were not part of a frame
+		};
+
+		typedef struct MyObj{
+			uint8_t buffer[SerialFrame::HEADER_SIZE + SerialFrame::MAX_PAYLOAD + SerialFrame::CRC_SIZE];
+			uint8_t index;       // Num of bytes of the current frame received so far
+			bool synced;         // False till the first good frame, there is no sequence number to compare with
+			uint16_t next_seq;   // Sequence number expected next
+			Frame frame;         // Last good frame
+			Stats stats;
+		} Obj;
+
+
+		Obj init();
+		bool feed(Obj& my_decoder, const uint8_t& data); // True when "my_decoder.frame" holds a new frame
+
+		struct Reader{
+			uint8_t offset;   // Of the next record in the payload
+			uint16_t run;     // Samples left in the current RUN record
+			uint32_t step;    // Time step of the last sample
+			SerialFrame::Sample last;
+			bool error;       // The payload didn't follow the layout
+		};
+
+
+		// Num of samples in a frame of SerialFrame::TYPE_SAMPLE, 0 for other types. "index" goes from 0 to that num - 1.
+		uint8_t numSamples(const Frame& frame);
+		SerialFrame::Sample getSample(const Frame& frame, const uint8_t& index);
+
+		// Samples of a frame of TYPE_SAMPLE or TYPE_DELTA in order, see "Samples"
+		Reader startSamples(const Frame& frame);
+		bool nextSample(const Frame& frame, Reader& reader, SerialFrame::Sample& sample); // False after the last one
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace FrameDecoder = Communication::FrameDecoder;
+
+#endif
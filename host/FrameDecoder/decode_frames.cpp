@@ -0,0 +1,59 @@
+/*
+	decode_frames.cpp - Converts the binary frames recorded from the serial
+	port back to text, one sample per line: time (us), encoder position and
+	analog value separated by a space, same as the text output of
+	"em_rrl_sensor". Frames of samples and of delta compressed samples are
+	both decoded. Lost frames are reported on stderr.
+
+	Usage: decode_frames [recording.bin]   (reads stdin without a file)
+
+	For example, on linux:
+	stty -F /dev/ttyACM0 2000000 raw && cat /dev/ttyACM0 > recording.bin
+
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include "FrameDecoder.h"
+
+
+int main(int argc, char** argv){
+
+	FILE* input = (argc > 1) ? fopen(argv[1], "rb") : stdin;
+	if (input == 0){
+		fprintf(stderr, "Cannot open %s\n", argv[1]);
+		return 1;
+	}
+
+	FrameDecoder::Obj my_decoder = FrameDecoder::init();
+
+	int data;
+	while ((data = fgetc(input)) != EOF){
+		if (!FrameDecoder::feed(my_decoder, static_cast<uint8_t>(data))){
+			continue;
+		}
+
+		const FrameDecoder::Frame& frame = my_decoder.frame;
+		if (frame.gap > 0){
+			fprintf(stderr, "Lost %u frame(s) before frame %u\n", frame.gap, frame.seq);
+		}
+		FrameDecoder::Reader reader = FrameDecoder::startSamples(frame);
+		SerialFrame::Sample sample;
+		while (FrameDecoder::nextSample(frame, reader, sample)){
+			printf("%lu %ld %u\n", static_cast<unsigned long>(sample.time), static_cast<long>(sample.position), sample.analog);
+		}
+		if (reader.error){
+			fprintf(stderr, "Bad payload in frame %u\n", frame.seq);
+		}
+	}
+
+	const FrameDecoder::Stats& stats = my_decoder.stats;
+	fprintf(stderr, "Frames: %lu, lost: %lu, CRC errors: %lu, skipped bytes: %lu\n",
+			stats.frames, stats.lost_frames, stats.crc_errors, stats.skipped_bytes);
+
+	if (input != stdin){
+		fclose(input);
+	}
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*
+	bench_encoder.cpp - Measures how fast the encoder can turn before the
+	pin change interrupts of RotaryEncoder miss edges, on the host build.
+	A simulated encoder produces quadrature edges at a rising rate; for
+	each rate the counted position, the illegal transitions (see
+	"getErrors") and the cycles spent in the interrupt are printed.
+
+	Only the Arduino core calls and the interrupt entry and exit are
+	charged to the virtual clock (see HalSim.h), the plain code of the
+	decoder is free. So the limit found here is an upper bound; what it
+	shows is whether the interrupt calls the (slow) core functions.
+
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "RotaryEncoder.h"
+
+
+// Encoder turning forward at a constant rate, "num_edges" edges in total
+class Quadrature : public Hal::Device{
+  public:
+	Quadrature(const uint8_t (&pins)[2], const double& edges_per_second, const long& num_edges)
+		: pins(pins), period(F_CPU / edges_per_second), left(num_edges), state(0) {
+		next = Hal::cycles() + period;
+	}
+
+	uint64_t nextEvent() { return (left > 0) ? next : Hal::NEVER; }
+
+	void onEvent(const uint64_t& cycle){
+		static const uint8_t gray[4] = { 0, 1, 3, 2 };
+		state = (state + 1) & 3;
+		Hal::setInput(pins[0], gray[state] & 2);
+		Hal::setInput(pins[1], gray[state] & 1);
+		left--;
+		next = cycle + period;
+	}
+
+  private:
+	const uint8_t (&pins)[2];
+	uint64_t period;
+	uint64_t next;
+	long left;
+	uint8_t state;
+};
+
+
+static const uint8_t PINS[2] = {2, 3};
+static const long NUM_EDGES = 20000;
+
+
+int main(){
+
+	RotaryEncoder::Obj my_rotary = RotaryEncoder::init(PINS, 4000);
+
+	printf("%10s %10s %8s %10s %10s\n", "edges/s", "counted", "errors", "cyc/edge", "max cyc");
+
+	for (double rate = 10000; rate <= 1000000; rate *= 1.25){
+		long before = RotaryEncoder::getPosition(my_rotary);
+		unsigned long errors = RotaryEncoder::getErrors(my_rotary);
+		Hal::clearIsrStats();
+
+		Quadrature encoder(PINS, rate, NUM_EDGES);
+		Hal::attach(&encoder);
+		Hal::run(static_cast<uint64_t>(F_CPU / rate * (NUM_EDGES + 2)));
+		Hal::detach(&encoder);
+
+		const Hal::IsrStats& stats = Hal::isrStats(Hal::VECT_PCINT2);
+		printf("%10.0f %10ld %8lu %10.1f %10lu\n", rate, RotaryEncoder::getPosition(my_rotary) - before,
+		       RotaryEncoder::getErrors(my_rotary) - errors,
+		       stats.count ? static_cast<double>(stats.cycles) / stats.count : 0.0,
+		       static_cast<unsigned long>(stats.max_cycles));
+	}
+
+	return 0;
+}
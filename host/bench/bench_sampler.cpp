@@ -0,0 +1,230 @@
+/*
+	bench_sampler.cpp - Measures the sampling of em_rrl_sensor on the host
+	build: the analog pin and the encoder sampled at a given rate and sent
+	over Serial at 2 Mbaud, as text lines or in binary frames, for one
+	second of the virtual clock. Two ways of sampling are compared:
+
+	- polled: loop() waits for the time of the next sample and takes it with
+	  analogRead (the way em_rrl_sensor did it, with Timer1 setting a flag)
+	- sampler: AnalogSampler converts in the background, loop() only reads
+	  the ring buffer and sends the samples
+
+	and for each it prints the rate of the samples that made it out, the
+	worst jitter of the time between two samples (us, from the period asked
+	for), the samples dropped by the ring buffer and the clock cycles of the
+	ADC interrupt per conversion.
+
+	Then the filters of AnalogFilter are run in the sampler, on a constant
+	input between two steps of the ADC with 1 LSB (rms) of noise, and for
+	each it prints the rate of the outputs, the bytes per second they take
+	on the serial port, the rms error of the outputs (in LSB of the ADC) and
+	the effective bits that this error is worth (10 bits for the error of
+	an ideal 10 bit ADC, 1 / sqrt(12) LSB).
+
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "RotaryEncoder.h"
+#include "AnalogSampler.h"
+#include "AnalogFilter.h"
+#include "SerialComm.h"
+
+
+static const uint32_t SERIAL_BAUD_RATE = 2000000;
+static const uint8_t ENCODER_PINS[2] = {2, 3};
+static const uint16_t CPR = 4000;
+static const double DURATION_S = 1.0;
+
+static const double LEVEL = 511.3; // Input of the filter runs, in LSB of the ADC
+static const double NOISE = 1.0;   // rms, in LSB
+
+
+struct Result{
+	uint32_t samples;
+	double max_jitter_us;
+	uint16_t overruns;
+	double isr_cycles;
+	double error_sum; // Of the squares of the errors from LEVEL
+	unsigned long serial_bytes;
+};
+
+
+static RotaryEncoder::Obj my_rotary = RotaryEncoder::init(ENCODER_PINS, CPR);
+
+// State of the sketch that runs, runSketch takes plain functions
+static uint32_t rate = 0;
+static bool binary = false;
+static bool use_sampler = false;
+static AnalogFilter::Obj* filter = 0;
+static uint32_t next_time = 0;
+static uint32_t last_time = 0;
+static SerialFrame::Sample batch[SerialComm::SAMPLES_PER_FRAME];
+static uint8_t batch_size = 0;
+static Result result;
+
+
+static void record(const uint32_t& time, const uint16_t& analog){
+	double value = (filter != 0) ? analog / static_cast<double>(1 << AnalogFilter::getExtraBits(*filter)) : analog;
+	result.error_sum += (value - LEVEL) * (value - LEVEL);
+
+	// The first conversion of the ADC takes 25 ADC clocks instead of 13, the interval after it is left out
+	if (result.samples > 1 && rate != AnalogSampler::FREE_RUNNING){
+		double jitter = fabs(static_cast<double>(time - last_time) - 1e6 / rate);
+		if (jitter > result.max_jitter_us) result.max_jitter_us = jitter;
+	}
+	last_time = time;
+	result.samples++;
+}
+
+
+static void send(const SerialFrame::Sample& sample){
+	if (!binary){
+		Serial.print(sample.time);
+		Serial.print(" ");
+		Serial.print(sample.position);
+		Serial.print(" ");
+		Serial.println(sample.analog);
+		return;
+	}
+	if (!use_sampler){
+		SerialComm::sendSample(sample);
+		return;
+	}
+	batch[batch_size++] = sample;
+	if (batch_size == SerialComm::SAMPLES_PER_FRAME || AnalogSampler::available() == 0){
+		SerialComm::sendSamples(batch, batch_size);
+		batch_size = 0;
+	}
+}
+
+
+static void setupSketch(){
+	Serial.begin(SERIAL_BAUD_RATE);
+	if (use_sampler){
+		AnalogSampler::start(A0, rate, &my_rotary, filter);
+	}
+	next_time = micros();
+}
+
+
+static void loopSketch(){
+	SerialFrame::Sample sample;
+
+	if (use_sampler){
+		AnalogSampler::Sample taken;
+		while (AnalogSampler::read(taken)){
+			sample.time     = taken.time;
+			sample.position = taken.position;
+			sample.analog   = taken.analog;
+			record(sample.time, sample.analog);
+			send(sample);
+		}
+		return;
+	}
+
+	if (static_cast<long>(micros() - next_time) >= 0){
+		next_time += 1000000UL / rate;
+		sample.time     = micros();
+		sample.position = RotaryEncoder::getPosition(my_rotary);
+		sample.analog   = analogRead(0);
+		record(sample.time, sample.analog);
+		send(sample);
+	}
+}
+
+
+static Result run(const uint32_t& sample_rate, const bool& sampler, const bool& binary_output,
+                  AnalogFilter::Obj* my_filter = 0){
+	Hal::reset();
+	if (my_filter == 0){
+		Hal::setAnalog(0, [](uint64_t cycle){ // 50 Hz sine
+			return static_cast<uint16_t>(512 + 400 * sin(2 * M_PI * 50 * cycle / static_cast<double>(F_CPU)));
+		});
+	}
+	else {
+		srand(1);
+		Hal::setAnalog(0, [](uint64_t){ // LEVEL + gaussian noise, rounded by the ADC
+			double noise = 0;
+			for (uint8_t i = 0; i < 12; i++) noise += rand() / static_cast<double>(RAND_MAX);
+			return static_cast<uint16_t>(floor(LEVEL + NOISE * (noise - 6) + 0.5));
+		});
+	}
+
+	rate = sample_rate;
+	use_sampler = sampler;
+	binary = binary_output;
+	filter = my_filter;
+	batch_size = 0;
+	result = Result{ 0, 0, 0, 0, 0, 0 };
+
+	Hal::runSketch(setupSketch, loopSketch, DURATION_S);
+	if (sampler){
+		AnalogSampler::stop();
+		result.overruns = AnalogSampler::getOverruns();
+	}
+
+	const Hal::IsrStats& stats = Hal::isrStats(Hal::VECT_ADC);
+	result.isr_cycles = stats.count ? static_cast<double>(stats.cycles) / stats.count : 0.0;
+	result.serial_bytes = Hal::serialOutput().size();
+	return result;
+}
+
+
+static void printRow(const char* method, const uint32_t& sample_rate, const char* output, const Result& result){
+	char asked[12];
+	if (sample_rate == AnalogSampler::FREE_RUNNING) snprintf(asked, sizeof(asked), "free");
+	else snprintf(asked, sizeof(asked), "%lu", static_cast<unsigned long>(sample_rate));
+	printf("%-8s %7s %7s %10.0f %10.1f %9u %9.1f\n", method, asked, output, result.samples / DURATION_S,
+	       result.max_jitter_us, result.overruns, result.isr_cycles);
+}
+
+
+int main(){
+
+	printf("Analog pin and encoder sampled for %.0f s, sent at %lu baud\n", DURATION_S,
+	       static_cast<unsigned long>(SERIAL_BAUD_RATE));
+	printf("%-8s %7s %7s %10s %10s %9s %9s\n", "method", "rate", "output", "sent/s", "jitter us", "overruns", "cyc/isr");
+
+	static const uint32_t rates[] = { 200, 1000, 2000, 5000, 10000, AnalogSampler::FREE_RUNNING };
+	for (uint8_t i = 0; i < 6; i++){
+		for (uint8_t b = 0; b < 2; b++){
+			if (rates[i] != AnalogSampler::FREE_RUNNING){
+				printRow("polled", rates[i], b ? "binary" : "text", run(rates[i], false, b));
+			}
+			printRow("sampler", rates[i], b ? "binary" : "text", run(rates[i], true, b));
+		}
+	}
+
+	static const uint32_t ADC_RATE = 10000;
+	printf("\nFilters in the sampler, ADC at %lu Hz, binary output, input %.1f LSB with %.1f LSB rms of noise\n",
+	       static_cast<unsigned long>(ADC_RATE), LEVEL, NOISE);
+	printf("%-20s %10s %10s %10s %9s %9s\n", "filter", "out/s", "bytes/s", "rms LSB", "eff bits", "cyc/isr");
+
+	struct Row { const char* label; AnalogFilter::Obj filter; };
+	Row rows[] = {
+		{ "none",                  AnalogFilter::none() },
+		{ "oversample 1",          AnalogFilter::oversample(1) },
+		{ "oversample 2",          AnalogFilter::oversample(2) },
+		{ "oversample 3",          AnalogFilter::oversample(3) },
+		{ "oversample 4",          AnalogFilter::oversample(4) },
+		{ "moving avg 16 / 16",    AnalogFilter::movingAverage(4, 16) },
+		{ "moving avg 16 / 50",    AnalogFilter::movingAverage(4, 50) },
+		{ "low-pass 4 / 16",       AnalogFilter::lowPass(4, 16) },
+		{ "low-pass 6 / 50",       AnalogFilter::lowPass(6, 50) },
+		{ "low-pass 8 / 200",      AnalogFilter::lowPass(8, 200) },
+	};
+	for (uint8_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++){
+		Result filtered = run(ADC_RATE, true, true, &rows[i].filter);
+		double rms = filtered.samples ? sqrt(filtered.error_sum / filtered.samples) : 0.0;
+		printf("%-20s %10.0f %10.0f %10.3f %9.1f %9.1f\n", rows[i].label, filtered.samples / DURATION_S,
+		       filtered.serial_bytes / DURATION_S, rms, 10 - log2(rms * sqrt(12.0)), filtered.isr_cycles);
+	}
+
+	return 0;
+}
@@ -0,0 +1,188 @@
+/*
+	bench_sequencer.cpp - Measures how WaveformSequencer runs strain ramps
+	that are sent as many points, on the host build, with the actuator
+	simulated by host/plant/LeadScrewStage. The points are pushed while the
+	waveform runs, as soon as there is space in the queue (like they come in
+	over serial in em_rrl_actuator). Every waveform runs twice:
+
+	- look-ahead: the points without a hold, the servo goes through the
+	  points in the same direction (see "Look-ahead" in WaveformSequencer.h)
+	- stop: a hold of 1 ms at every point, so the servo stops at each one,
+	  the way every segment ran before
+
+	and it prints:
+
+	- time s: from the first point till the last one is done
+	- ideal s: the least time for the waveform with the speed and the
+	  acceleration, stopping only where it turns back
+	- mean mm/s: length of the waveform / time
+	- stops: num of times the motor came to a stop on the way
+	- lost: full steps the motor lost (see "getLostSteps")
+	- end um: error of the carriage at the end, in micro meters
+
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "WaveformSequencer.h"
+#include "LeadScrewStage.h"
+
+
+static const uint8_t STEPPER_PINS[4] = {7, 4, 6, 5};
+static const uint8_t ENCODER_PINS[2] = {2, 3};
+static const uint16_t CPR = 4000;
+static const uint16_t NUM_STEPS = 200;
+static const uint8_t LEAD_LENGTH = 12;
+static const uint8_t MICRO_STEPS = 8;
+static const double ACCELERATION = 50.0;
+static const float TOLERANCE_FACTOR = 2.5f;
+
+static const double SENSOR_LENGTH = 20.0; // mm
+static const double HOLD_S = 0.2;
+static const double TIMEOUT_S = 60.0;
+
+typedef std::vector<double> Points; // Strain in %, as sent to em_rrl_actuator
+
+
+struct Result{
+	double time_s;
+	double ideal_s;
+	double length_mm;
+	uint16_t stops;
+	long lost_steps;
+	double end_error_um;
+};
+
+
+// The encoder can only be initialized a few times (see RotaryEncoder::MAX_ENCODERS), every run uses the same one
+static RotaryEncoder::Obj my_rotary = RotaryEncoder::init(ENCODER_PINS, CPR);
+
+
+// Up to "peak" % and back, "num_points" points each way, "cycles" times
+static Points triangle(const double& peak, const uint16_t& num_points, const uint8_t& cycles){
+	Points points;
+	for (uint8_t c = 0; c < cycles; c++){
+		for (uint16_t i = 1; i <= num_points; i++) points.push_back(peak * i / num_points);
+		for (uint16_t i = 1; i <= num_points; i++) points.push_back(peak * (num_points - i) / num_points);
+	}
+	return points;
+}
+
+
+// 0 to "peak" % and back along 1 - cos, "num_points" points per cycle
+static Points sine(const double& peak, const uint16_t& num_points, const uint8_t& cycles){
+	Points points;
+	for (uint8_t c = 0; c < cycles; c++){
+		for (uint16_t i = 1; i <= num_points; i++) points.push_back(peak / 2 * (1 - cos(2 * M_PI * i / num_points)));
+	}
+	return points;
+}
+
+
+static Result run(const Points& points, const double& speed_mm_s, const bool& look_ahead){
+
+	Plant::StageSettings settings = Plant::defaultSettings();
+	Plant::LeadScrewStage stage(settings);
+	Hal::attach(&stage);
+
+	LinActStepper::Obj my_actuator = LinActStepper::init(STEPPER_PINS, NUM_STEPS, LEAD_LENGTH, MICRO_STEPS);
+	LinActStepper::setMaxSpeed(my_actuator, speed_mm_s);
+	LinActStepper::setAcceleration(my_actuator, ACCELERATION);
+	LinActWithRotEnc::Obj my_system = LinActWithRotEnc::init(my_rotary, my_actuator, TOLERANCE_FACTOR);
+	WaveformSequencer::Obj my_sequencer = WaveformSequencer::init(my_system);
+
+	// The coils are off till the first step
+	LinActStepper::move(my_actuator, static_cast<int32_t>(1));
+	LinActStepper::move(my_actuator, static_cast<int32_t>(-1));
+	Hal::run(static_cast<uint64_t>(HOLD_S * F_CPU));
+
+	// The encoder keeps its count from the run before, the points are relative to where it is now
+	const int32_t origin_um = RotaryEncoder::getPosition(my_rotary) * 1000 / my_system.convert.disp2encpos;
+	const double carriage_0 = stage.getCarriage() - stage.getShaft();
+	const long lost_0 = stage.getLostSteps();
+
+	// Every run in one direction is a trapezoid (or a triangle if it is too short to reach the speed)
+	Result result = { 0, 0, 0, 0, 0, 0 };
+	double last_mm = 0, run_mm = 0, direction = 0;
+	for (size_t i = 0; i <= points.size(); i++){
+		double step_mm = (i < points.size()) ? -points[i] / 100.0 * SENSOR_LENGTH - last_mm : 0;
+		if (step_mm == 0 || (step_mm > 0) != (direction > 0)){
+			result.ideal_s += (run_mm >= speed_mm_s * speed_mm_s / ACCELERATION) ?
+			                  run_mm / speed_mm_s + speed_mm_s / ACCELERATION : 2 * sqrt(run_mm / ACCELERATION);
+			run_mm = 0;
+		}
+		run_mm += fabs(step_mm);
+		direction = step_mm;
+		last_mm += step_mm;
+		result.length_mm += fabs(step_mm);
+	}
+
+	const uint64_t start = Hal::cycles();
+	size_t sent = 0;
+	bool was_moving = false;
+	Hal::runUntil([&]{
+		while (sent < points.size() && WaveformSequencer::space(my_sequencer) > 0){
+			WaveformSequencer::Segment segment;
+			segment.target_um  = origin_um - static_cast<int32_t>(floor(points[sent] * SENSOR_LENGTH * 10.0 + 0.5));
+			segment.speed_um_s = static_cast<uint16_t>(speed_mm_s * 1000);
+			segment.hold_ms    = look_ahead ? 0 : 1;
+			WaveformSequencer::push(my_sequencer, segment);
+			sent++;
+		}
+		WaveformSequencer::update(my_sequencer);
+
+		bool moving = (my_system.state.rate != 0);
+		if (was_moving && !moving) result.stops++;
+		was_moving = moving;
+
+		return sent == points.size() && WaveformSequencer::isIdle(my_sequencer);
+	}, static_cast<uint64_t>(TIMEOUT_S * F_CPU), 160);
+
+	result.time_s       = (Hal::cycles() - start) / static_cast<double>(F_CPU);
+	result.lost_steps   = stage.getLostSteps() - lost_0;
+	result.end_error_um = fabs(stage.getCarriage() - carriage_0 - last_mm) * 1000;
+
+	WaveformSequencer::stop(my_sequencer);
+	Hal::detach(&stage);
+	return result;
+}
+
+
+static void printRow(const char* label, const double& speed_mm_s, const char* mode, const Result& result){
+	printf("%-22s %6.0f %-10s %8.2f %8.2f %9.2f %6u %5ld %7.1f\n", label, speed_mm_s, mode, result.time_s,
+	       result.ideal_s, result.length_mm / result.time_s, result.stops, result.lost_steps,
+	       result.end_error_um);
+}
+
+
+int main(){
+
+	printf("Strain ramps on a %.0f mm sensor as points, %u micro steps, %.0f mm/s^2, queue of %u segments\n",
+	       SENSOR_LENGTH, MICRO_STEPS, ACCELERATION, WaveformSequencer::QUEUE_SIZE);
+	printf("%-22s %6s %-10s %8s %8s %9s %6s %5s %7s\n", "waveform", "mm/s", "mode", "time s", "ideal s", "mean mm/s",
+	       "stops", "lost", "end um");
+
+	struct Row { const char* label; Points points; };
+	Row rows[] = {
+		{ "triangle 10%, 20 pts",  triangle(10, 20, 2) },
+		{ "triangle 10%, 100 pts", triangle(10, 100, 1) },
+		{ "sine 10%, 40 pts",      sine(10, 40, 2) },
+		{ "sine 20%, 100 pts",     sine(20, 100, 1) },
+	};
+	static const double speeds[] = { 5, 20 };
+
+	for (uint8_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++){
+		for (uint8_t s = 0; s < 2; s++){
+			printRow(rows[i].label, speeds[s], "look-ahead", run(rows[i].points, speeds[s], true));
+			printRow(rows[i].label, speeds[s], "stop", run(rows[i].points, speeds[s], false));
+		}
+	}
+
+	return 0;
+}
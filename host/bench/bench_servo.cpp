@@ -0,0 +1,192 @@
+/*
+	bench_servo.cpp - Measures how the closed loop moves of LinActWithRotEnc
+	converge, on the host build, with the actuator simulated by
+	host/plant/LeadScrewStage. Every scenario runs the moves that EM_RRL
+	makes (steps of strain on a sensor and back to zero) and prints, over
+	all the moves:
+
+	- settle: mean and worst time from "moveToAsync" till the encoder stayed
+	  in the tolerance (see "getSettleTime"), in ms
+	- starts: worst number of times the motor started from standstill, i.e.,
+	  1 + the correction passes (see "getStarts")
+	- enc err: worst final error of the encoder in counts
+	- carr err: worst final error of the carriage in micro meters, which the
+	  encoder on the shaft doesn't see (backlash)
+	- lost: full steps the motor lost on the way (see "getLostSteps")
+	- fail: moves that didn't settle within MOVE_TIMEOUT_S
+
+	The scenarios vary the tolerance factor, the microstepping, the speed,
+	the load on the carriage and the backlash, one at a time, around the
+	EM_RRL settings.
+
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "LinActWithRotEnc.h"
+#include "LeadScrewStage.h"
+
+
+static const uint8_t STEPPER_PINS[4] = {7, 4, 6, 5};
+static const uint8_t ENCODER_PINS[2] = {2, 3};
+static const uint16_t CPR = 4000;
+static const uint16_t NUM_STEPS = 200;
+static const uint8_t LEAD_LENGTH = 12;
+static const double ACCELERATION = 50.0;
+
+static const double SENSOR_LENGTH = 20.0; // mm
+static const double STRAINS[] = { 5, 0, 10, 0, 1, 0, 20, 10, 0 }; // % of the sensor length, as sent to em_rrl_actuator
+static const uint8_t NUM_MOVES = sizeof(STRAINS) / sizeof(STRAINS[0]);
+static const double HOLD_S = 0.2;
+static const double MOVE_TIMEOUT_S = 5.0;
+
+
+struct Scenario{
+	uint8_t micro_steps;
+	float tolerance_factor;
+	double speed_mm_s;
+	double load_force;
+	double backlash_mm;
+};
+
+struct Result{
+	double settle_mean_ms;
+	double settle_max_ms;
+	uint16_t max_starts;
+	long max_encoder_error;
+	double max_carriage_error_um;
+	long lost_steps;
+	uint8_t failed;
+};
+
+
+// The encoder can only be initialized a few times (see RotaryEncoder::MAX_ENCODERS), every scenario uses the same one
+static RotaryEncoder::Obj my_rotary = RotaryEncoder::init(ENCODER_PINS, CPR);
+
+
+static Result run(const Scenario& scenario){
+
+	Plant::StageSettings settings = Plant::defaultSettings();
+	settings.driver      = (scenario.micro_steps == 1) ? Plant::DRIVER_FULL_BRIDGE : Plant::DRIVER_SIGNED_MAGNITUDE;
+	settings.load_force  = 0;
+	settings.backlash_mm = scenario.backlash_mm;
+
+	Plant::LeadScrewStage stage(settings);
+	Hal::attach(&stage);
+
+	LinActStepper::Obj my_actuator = LinActStepper::init(STEPPER_PINS, NUM_STEPS, LEAD_LENGTH, scenario.micro_steps);
+	LinActStepper::setMaxSpeed(my_actuator, scenario.speed_mm_s);
+	LinActStepper::setAcceleration(my_actuator, ACCELERATION);
+	LinActWithRotEnc::Obj my_system = LinActWithRotEnc::init(my_rotary, my_actuator, scenario.tolerance_factor);
+
+	// The coils are off till the first step, the motor holds the carriage before the load is put on
+	LinActStepper::move(my_actuator, static_cast<int32_t>(1));
+	LinActStepper::move(my_actuator, static_cast<int32_t>(-1));
+	stage.setLoadForce(scenario.load_force);
+	Hal::run(static_cast<uint64_t>(HOLD_S * F_CPU));
+
+	// The encoder keeps its count from the scenario before, the moves are relative to where it is now
+	const double origin_mm  = RotaryEncoder::getPosition(my_rotary) / my_system.convert.disp2encpos;
+	const double carriage_0 = stage.getCarriage() - stage.getShaft();
+
+	Result result = { 0, 0, 0, 0, 0, 0, 0 };
+	for (uint8_t i = 0; i < NUM_MOVES; i++){
+		double target_mm = -STRAINS[i] / 100.0 * SENSOR_LENGTH;
+
+		LinActWithRotEnc::moveToAsync(my_system, origin_mm + target_mm);
+		bool settled = Hal::runUntil([&]{ return LinActWithRotEnc::atTarget(my_system); },
+		                             static_cast<uint64_t>(MOVE_TIMEOUT_S * F_CPU), 1600);
+		if (!settled){
+			LinActWithRotEnc::stop(my_system);
+			result.failed++;
+		}
+
+		double settle_ms = LinActWithRotEnc::getSettleTime(my_system) / 1000.0;
+		result.settle_mean_ms += settle_ms / NUM_MOVES;
+		if (settle_ms > result.settle_max_ms) result.settle_max_ms = settle_ms;
+
+		uint16_t starts = LinActWithRotEnc::getStarts(my_system);
+		if (starts > result.max_starts) result.max_starts = starts;
+
+		long encoder_error = labs(my_system.state.target_encpos - RotaryEncoder::getPosition(my_rotary));
+		if (encoder_error > result.max_encoder_error) result.max_encoder_error = encoder_error;
+
+		double carriage_error = fabs(stage.getCarriage() - carriage_0 - target_mm) * 1000;
+		if (carriage_error > result.max_carriage_error_um) result.max_carriage_error_um = carriage_error;
+
+		Hal::run(static_cast<uint64_t>(HOLD_S * F_CPU));
+	}
+	result.lost_steps = stage.getLostSteps();
+
+	LinActWithRotEnc::stop(my_system);
+	Hal::detach(&stage);
+	return result;
+}
+
+
+static void printHeader(const char* title, const char* column){
+	printf("\n%s\n", title);
+	printf("%-10s %10s %10s %7s %8s %10s %6s %5s\n", column, "settle ms", "max ms", "starts", "enc err", "carr err", "lost", "fail");
+}
+
+
+static void printRow(const char* label, const Result& result){
+	printf("%-10s %10.1f %10.1f %7u %8ld %10.1f %6ld %5u\n", label, result.settle_mean_ms, result.settle_max_ms,
+	       result.max_starts, result.max_encoder_error, result.max_carriage_error_um, result.lost_steps, result.failed);
+}
+
+
+int main(){
+
+	const Scenario base = { 8, 2.5f, 5.0, 0.0, 0.02 }; // as in em_rrl_actuator
+	char label[16];
+
+	printf("Moves of %u steps of strain on a %.0f mm sensor, %.0f mm/s^2\n", NUM_MOVES, SENSOR_LENGTH, ACCELERATION);
+
+	printHeader("Tolerance factor and microstepping, 5 mm/s", "micro/tol");
+	static const uint8_t micro_steps[] = { 1, 2, 4, 8, 16, 32 };
+	static const float tolerance_factors[] = { 1.0f, 2.5f, 5.0f };
+	for (uint8_t m = 0; m < 6; m++){
+		for (uint8_t t = 0; t < 3; t++){
+			Scenario scenario = base;
+			scenario.micro_steps = micro_steps[m];
+			scenario.tolerance_factor = tolerance_factors[t];
+			snprintf(label, sizeof(label), "%u / %.1f", micro_steps[m], tolerance_factors[t]);
+			printRow(label, run(scenario));
+		}
+	}
+
+	printHeader("Speed, 8 micro steps, tolerance factor 2.5", "mm/s");
+	static const double speeds[] = { 1, 2, 5, 10, 20, 40 };
+	for (uint8_t i = 0; i < 6; i++){
+		Scenario scenario = base;
+		scenario.speed_mm_s = speeds[i];
+		snprintf(label, sizeof(label), "%.0f", speeds[i]);
+		printRow(label, run(scenario));
+	}
+
+	printHeader("Load pulling the carriage back (N), 5 mm/s", "load N");
+	static const double loads[] = { 0, 50, 100, 150, 200, 250 };
+	for (uint8_t i = 0; i < 6; i++){
+		Scenario scenario = base;
+		scenario.load_force = -loads[i];
+		snprintf(label, sizeof(label), "%.0f", loads[i]);
+		printRow(label, run(scenario));
+	}
+
+	printHeader("Backlash of the screw (mm), 5 mm/s, no load", "backlash");
+	static const double backlashes[] = { 0, 0.02, 0.05, 0.1 };
+	for (uint8_t i = 0; i < 4; i++){
+		Scenario scenario = base;
+		scenario.backlash_mm = backlashes[i];
+		snprintf(label, sizeof(label), "%.2f", backlashes[i]);
+		printRow(label, run(scenario));
+	}
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+	bench_stall.cpp - Measures the stall detection of LinActWithRotEnc on
+	the host build, with the actuator simulated by host/plant/LeadScrewStage.
+	Every scenario is one open loop move ("LinActWithRotEnc::move") of
+	MOVE_MM against a load on the carriage, or too fast for the motor, and
+	it prints:
+
+	- lost: full steps the motor lost (see "getLostSteps" of the plant)
+	- slip ms: time from the start of the move till the motor had lost
+	  SLIP_STEPS full steps (the plant counts one as soon as the load pulls
+	  the rotor back by half a step, that isn't a stall yet)
+	- caught ms: time from then till the first stall was counted
+	  ("getStalls"), "-" if none was
+	- stalls: num of stalls counted
+	- follow: following error at the end of the move, in steps
+	  ("getFollowingError"), next to "lost" in the same steps (x micro steps)
+	- moved mm: how far the carriage got
+
+	Each scenario runs with the three actions: STALL_FLAG, STALL_SLOW_DOWN
+	and STALL_ABORT, with a threshold of THRESHOLD_MM.
+
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "LinActWithRotEnc.h"
+#include "LeadScrewStage.h"
+
+
+static const uint8_t STEPPER_PINS[4] = {7, 4, 6, 5};
+static const uint8_t ENCODER_PINS[2] = {2, 3};
+static const uint16_t CPR = 4000;
+static const uint16_t NUM_STEPS = 200;
+static const uint8_t LEAD_LENGTH = 12;
+static const uint8_t MICRO_STEPS = 8;
+
+static const double MOVE_MM = 10.0;
+static const double THRESHOLD_MM = 0.12; // 2 full steps
+static const long SLIP_STEPS = 2;
+static const double HOLD_S = 0.2;
+static const double MOVE_TIMEOUT_S = 20.0;
+
+
+static const double NO_STALL = -1e9;
+
+
+struct Scenario{
+	const char* label;
+	double speed_mm_s;
+	double acceleration; // mm/s^2
+	double load_force; // N, pulling the carriage back
+};
+
+struct Result{
+	long lost_steps;
+	double slip_ms;   // < 0: no step lost
+	double caught_ms; // NO_STALL: no stall counted, < 0 if counted before the plant lost SLIP_STEPS
+	uint16_t stalls;
+	long following_error;
+	double moved_mm;
+};
+
+
+// The encoder can only be initialized a few times (see RotaryEncoder::MAX_ENCODERS), every scenario uses the same one
+static RotaryEncoder::Obj my_rotary = RotaryEncoder::init(ENCODER_PINS, CPR);
+
+
+static Result run(const Scenario& scenario, const uint8_t& action){
+
+	Plant::StageSettings settings = Plant::defaultSettings();
+	settings.driver     = Plant::DRIVER_SIGNED_MAGNITUDE;
+	settings.load_force = 0;
+
+	Plant::LeadScrewStage stage(settings);
+	Hal::attach(&stage);
+
+	LinActStepper::Obj my_actuator = LinActStepper::init(STEPPER_PINS, NUM_STEPS, LEAD_LENGTH, MICRO_STEPS);
+	LinActStepper::setMaxSpeed(my_actuator, scenario.speed_mm_s);
+	LinActStepper::setAcceleration(my_actuator, scenario.acceleration);
+	LinActWithRotEnc::Obj my_system = LinActWithRotEnc::init(my_rotary, my_actuator, 2.5f);
+	LinActWithRotEnc::setStallDetection(my_system, THRESHOLD_MM, action);
+
+	// The coils are off till the first step, the motor holds the carriage before the load is put on
+	LinActStepper::move(my_actuator, static_cast<int32_t>(1));
+	LinActStepper::move(my_actuator, static_cast<int32_t>(-1));
+	stage.setLoadForce(-scenario.load_force);
+	Hal::run(static_cast<uint64_t>(HOLD_S * F_CPU));
+
+	const long lost_0 = stage.getLostSteps();
+	const double carriage_0 = stage.getCarriage();
+	const uint64_t start = Hal::cycles();
+	uint64_t slip = 0, caught = 0;
+
+	LinActWithRotEnc::moveAsync(my_system, MOVE_MM);
+	bool done = Hal::runUntil([&]{
+		if (slip == 0 && labs(stage.getLostSteps() - lost_0) >= SLIP_STEPS) slip = Hal::cycles();
+		if (caught == 0 && LinActWithRotEnc::getStalls(my_system) != 0) caught = Hal::cycles();
+		return !LinActWithRotEnc::isMoving(my_system);
+	}, static_cast<uint64_t>(MOVE_TIMEOUT_S * F_CPU), 160);
+	if (!done){
+		LinActWithRotEnc::stop(my_system);
+	}
+
+	Result result;
+	result.lost_steps      = labs(stage.getLostSteps() - lost_0);
+	result.slip_ms         = slip ? (slip - start) * 1000.0 / F_CPU : -1;
+	result.caught_ms       = (caught && slip) ? (static_cast<double>(caught) - slip) * 1000.0 / F_CPU : NO_STALL;
+	result.stalls          = LinActWithRotEnc::getStalls(my_system);
+	result.following_error = LinActWithRotEnc::getFollowingError(my_system);
+	result.moved_mm        = stage.getCarriage() - carriage_0;
+
+	Hal::detach(&stage);
+	return result;
+}
+
+
+static void printRow(const char* label, const char* action, const Result& result){
+	char slip[12], caught[12];
+	if (result.slip_ms < 0) snprintf(slip, sizeof(slip), "-");
+	else snprintf(slip, sizeof(slip), "%.1f", result.slip_ms);
+	if (result.caught_ms == NO_STALL) snprintf(caught, sizeof(caught), "-");
+	else snprintf(caught, sizeof(caught), "%.1f", result.caught_ms);
+
+	printf("%-18s %-10s %6ld %8s %9s %7u %7ld %7ld %9.2f\n", label, action, result.lost_steps, slip, caught,
+	       result.stalls, result.following_error, result.lost_steps * MICRO_STEPS, result.moved_mm);
+}
+
+
+int main(){
+
+	printf("Open loop moves of %.0f mm, %u micro steps, stall threshold %.2f mm\n", MOVE_MM, MICRO_STEPS, THRESHOLD_MM);
+	printf("%-18s %-10s %6s %8s %9s %7s %7s %7s %9s\n", "scenario", "action", "lost", "slip ms", "caught ms", "stalls",
+	       "follow", "lost x8", "moved mm");
+
+	static const Scenario scenarios[] = {
+		{ "5 mm/s, no load",  5, 50, 0 },
+		{ "5 mm/s, 200 N",    5, 50, 200 },
+		{ "5 mm/s, 230 N",    5, 50, 230 },
+		{ "5 mm/s, 300 N",    5, 50, 300 },
+		{ "20 mm/s, 200 N",   20, 200, 200 },
+		{ "40 mm/s, 170 N",   40, 200, 170 },
+		{ "60 mm/s, 150 N",   60, 500, 150 },
+	};
+	static const uint8_t actions[] = { LinActWithRotEnc::STALL_FLAG, LinActWithRotEnc::STALL_SLOW_DOWN,
+	                                   LinActWithRotEnc::STALL_ABORT };
+	static const char* action_names[] = { "flag", "slow down", "abort" };
+
+	for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++){
+		for (uint8_t a = 0; a < 3; a++){
+			printRow(scenarios[i].label, action_names[a], run(scenarios[i], actions[a]));
+		}
+	}
+
+	return 0;
+}
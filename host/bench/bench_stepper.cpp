@@ -0,0 +1,337 @@
+/*
+	bench_stepper.cpp - Measures the stepper in the background (Timer1
+	interrupt) on the host build: CPU cycles spent in the interrupt per
+	step for each wiring and for FixedStepper (the port and compare
+	register accesses are charged, see "HalSim.h"), how far the steps are
+	from their ideal time, and how long a move with acceleration takes
+	compared to the theory. For the microstepping it also checks the PWM
+	of the enable pins: its frequency, and that the compare registers
+	written on every microstep give the duties of a sine.
+	A STEP/DIR driver is stepped at rates up to the 50 kHz of StepTimer,
+	with the pulses on the STEP pin counted and timed. The same pulses give
+	the rate that a speed in rpm (setSpeed) or mm/s (setStepRateMilli)
+	actually runs at over a long move, next to the rate that the whole us
+	and whole steps per second of the earlier code gave.
+
+	It is built twice: "bench_stepper" writes the coils through the port
+	registers, "bench_stepper_digitalwrite" is built with
+	STEPPER_DIGITALWRITE, i.e., with digitalWrite() like before, so the two
+	can be compared.
+
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "Stepper.h"
+#include "FixedStepper.h"
+
+
+static const long NUM_STEPS = 800;
+static const uint32_t STEP_RATE = 1000; // steps/s
+
+
+// Moves the stepper (created right after Hal::reset()) and prints the cycles per step and the timing of a coil pin
+static void measure(const char* name, Stepper& stepper, const uint8_t& pin){
+
+	stepper.setStepRate(STEP_RATE);
+	Hal::tracePins(true);
+	Hal::clearIsrStats();
+
+	stepper.stepAsync(NUM_STEPS);
+	while (stepper.isMoving()){
+		yield();
+	}
+
+	const Hal::IsrStats& stats = Hal::isrStats(Hal::VECT_TIMER1_COMPA);
+
+	// The changes of one coil pin happen on steps, so they must be a whole num of step periods apart
+	const std::vector<Hal::PinEvent>& trace = Hal::pinTrace();
+	double period = F_CPU / static_cast<double>(STEP_RATE);
+	double max_error = 0;
+	uint64_t first = 0;
+	for (size_t i = 0; i < trace.size(); i++){
+		if (trace[i].pin != pin){
+			continue;
+		}
+		if (first == 0){
+			first = trace[i].cycle;
+			continue;
+		}
+		double periods = (trace[i].cycle - first) / period;
+		double error = fabs(periods - floor(periods + 0.5)) * period;
+		if (error > max_error) max_error = error;
+	}
+
+	printf("%-28s %8.1f %8lu %12.2f\n", name, static_cast<double>(stats.cycles) / stats.count,
+	       static_cast<unsigned long>(stats.max_cycles), max_error / (F_CPU / 1000000.0));
+}
+
+
+// Duty of a PWM pin, also when it is not connected to its timer (analogWrite() of 0 and 255 set the pin)
+static uint8_t duty(const uint8_t& pin){
+	uint8_t value = Hal::pwmDuty(pin);
+	return (value > 0 || !Hal::pinLevel(pin)) ? value : 255;
+}
+
+
+// Takes one electrical cycle of microsteps and compares the duties of the PWM pins with PWMRANGE * |sin|, |cos|
+static void pwm(const char* name, Stepper& stepper, const uint8_t& micro_steps, const uint8_t (&pwm_pins)[2]){
+
+	Hal::traceRegisters(true);
+	Hal::clearRegisterTrace();
+
+	const uint16_t num_phases = 4 * micro_steps;
+	double max_error = 0;
+	for (uint16_t i = 1; i <= num_phases; i++){
+		stepper.stepOnce(true);
+		Hal::run(16); // lets the register trace see the writes of this microstep
+		double angle = i * M_PI / 2 / micro_steps;
+		double error_1 = fabs(duty(pwm_pins[0]) - PWMRANGE * fabs(sin(angle)));
+		double error_2 = fabs(duty(pwm_pins[1]) - PWMRANGE * fabs(cos(angle)));
+		max_error = fmax(max_error, fmax(error_1, error_2));
+	}
+
+	unsigned long compare_writes = 0;
+	const std::vector<Hal::RegisterEvent>& trace = Hal::registerTrace();
+	for (size_t i = 0; i < trace.size(); i++){
+		if (strncmp(trace[i].name, "OCR", 3) == 0) compare_writes++;
+	}
+	Hal::traceRegisters(false);
+
+	printf("%-22s %8lu %10lu %12.1f\n", name, static_cast<unsigned long>(Hal::pwmFrequency(pwm_pins[0])),
+	       compare_writes, max_error);
+}
+
+
+// Steps a STEP/DIR driver at "rate", counts the pulses on the STEP pin and measures their timing and width
+static void stepDir(const uint32_t& rate){
+
+	static const uint8_t STEP_PIN = 8;
+	static const long NUM_PULSES = 2000;
+
+	Hal::reset();
+	StepDirDriver driver = { STEP_PIN, 9, StepDirDriver::NO_PIN, 16, StepDirDriver::DEFAULT_PULSE_WIDTH_US,
+	                         StepDirDriver::DEFAULT_DIR_SETUP_US };
+	Stepper stepper(200, driver);
+	stepper.setStepRate(rate);
+	Hal::tracePins(true);
+	Hal::clearIsrStats();
+
+	stepper.stepAsync(NUM_PULSES);
+	while (stepper.isMoving()){
+		yield();
+	}
+
+	const Hal::IsrStats& stats = Hal::isrStats(Hal::VECT_TIMER1_COMPA);
+	const std::vector<Hal::PinEvent>& trace = Hal::pinTrace();
+	const double period = F_CPU / static_cast<double>(rate);
+	long pulses = 0;
+	double max_error = 0, min_width = 1e9;
+	uint64_t first = 0, rise = 0;
+	for (size_t i = 0; i < trace.size(); i++){
+		if (trace[i].pin != STEP_PIN) continue;
+		if (trace[i].level){
+			rise = trace[i].cycle;
+			if (pulses++ == 0){
+				first = rise;
+				continue;
+			}
+			double periods = (rise - first) / period;
+			max_error = fmax(max_error, fabs(periods - floor(periods + 0.5)) * period);
+		}
+		else if (rise != 0){
+			min_width = fmin(min_width, static_cast<double>(trace[i].cycle - rise));
+		}
+	}
+
+	double cycles = static_cast<double>(stats.cycles) / stats.count;
+	printf("%8lu %8ld %8.1f %12.2f %10.2f %6.0f%%\n", static_cast<unsigned long>(rate), pulses, cycles,
+	       max_error / (F_CPU / 1000000.0), min_width / (F_CPU / 1000000.0), 100.0 * cycles * rate / F_CPU);
+}
+
+
+// Rising edges on "pin" since the trace was cleared: their number, the cycles of the first and of the last one
+static long risingEdges(const uint8_t& pin, uint64_t& first, uint64_t& last){
+	const std::vector<Hal::PinEvent>& trace = Hal::pinTrace();
+	long edges = 0;
+	for (size_t i = 0; i < trace.size(); i++){
+		if (trace[i].pin != pin || !trace[i].level) continue;
+		if (edges++ == 0) first = trace[i].cycle;
+		last = trace[i].cycle;
+	}
+	return edges;
+}
+
+
+// Measures the rate of a move of 200 steps x 8 micro steps set to "millisteps" (1/1000 steps/s), or to "rpm"
+// if not 0, and prints it with the rate asked for and the one that the earlier code gave ("before"), in steps/s
+static void rate(const char* name, const uint32_t& millisteps, const uint16_t& rpm, const double& asked,
+                 const double& before){
+
+	static const uint8_t STEP_PIN = 8;
+
+	Hal::reset();
+	StepDirDriver driver = { STEP_PIN, 9, StepDirDriver::NO_PIN, 8, StepDirDriver::DEFAULT_PULSE_WIDTH_US,
+	                         StepDirDriver::DEFAULT_DIR_SETUP_US };
+	Stepper stepper(200, driver);
+	if (rpm != 0) stepper.setSpeed(rpm);
+	else stepper.setStepRateMilli(millisteps);
+
+	// About 2 s of steps, at least 10
+	long num_steps = static_cast<long>(asked * 2);
+	if (num_steps < 10) num_steps = 10;
+	if (num_steps > 20000) num_steps = 20000;
+	Hal::tracePins(true);
+	stepper.stepAsync(num_steps);
+	while (stepper.isMoving()){
+		yield();
+	}
+
+	uint64_t first = 0, last = 0;
+	long edges = risingEdges(STEP_PIN, first, last);
+	double actual = (edges - 1) * static_cast<double>(F_CPU) / (last - first);
+	printf("%-22s %12.4f %12.4f %8.3f%% %12.4f %8.4f%%\n", name, asked, before, 100 * (before - asked) / asked,
+	       actual, 100 * (actual - asked) / asked);
+}
+
+
+// Rate of "rpm" with the earlier setSpeed: whole us per step, then per micro step, then Timer1 ticks
+static double rpmBefore(const uint16_t& rpm){
+	unsigned long step_delay = 60UL * 1000UL * 1000UL / 200 / rpm;
+	unsigned long micro_step_delay = step_delay / 8;
+	return StepTimer::TICKS_PER_SEC / static_cast<double>(StepTimer::usToTicks(micro_step_delay));
+}
+
+
+// Rate of "speed" mm/s with the earlier LinActStepper::setMaxSpeed: whole steps per second, then whole ticks
+static double mmBefore(const double& speed){
+	uint32_t steps_per_second = static_cast<uint32_t>(speed * 1600 / 12 + 0.5);
+	if (steps_per_second == 0) return 0;
+	return StepTimer::TICKS_PER_SEC / static_cast<double>(StepTimer::TICKS_PER_SEC / steps_per_second);
+}
+
+
+// Moves "distance" steps with an acceleration and compares the time with the theory
+static void profile(const char* name, const uint32_t& jerk){
+
+	static const long DISTANCE = 1333;   // 10 mm of the EM_RRL actuator
+	static const uint32_t RATE = 1333;   // 10 mm/s
+	static const uint32_t ACCEL = 6667;  // 50 mm/s^2
+
+	Hal::reset();
+	Stepper stepper(200, 7, 4);
+	stepper.setStepRate(RATE);
+	stepper.setAcceleration(ACCEL);
+	stepper.setJerk(jerk);
+
+	uint64_t start = Hal::cycles();
+	stepper.stepAsync(DISTANCE);
+	while (stepper.isMoving()){
+		yield();
+	}
+	double seconds = (Hal::cycles() - start) / static_cast<double>(F_CPU);
+
+	// Trapezoid: ramp up and down at "a", cruise in between
+	double theory = DISTANCE / static_cast<double>(RATE) + RATE / static_cast<double>(ACCEL);
+	if (jerk != 0){
+		theory += ACCEL / static_cast<double>(jerk);
+	}
+	printf("%-22s %8.3f s (theory from standstill %.3f s)\n", name, seconds, theory);
+}
+
+
+int main(){
+
+#ifdef STEPPER_DIGITALWRITE
+	printf("Coils written with digitalWrite()\n\n");
+#else
+	printf("Coils written through the port registers\n\n");
+#endif
+
+	printf("%-28s %8s %8s %12s\n", "Wiring", "cyc/step", "max cyc", "max err (us)");
+
+	Hal::reset();
+	Stepper two_wire(200, 7, 4);
+	measure("2 wire", two_wire, 7);
+
+	Hal::reset();
+	Stepper four_wire(200, 7, 4, 6, 5);
+	measure("4 wire", four_wire, 7);
+
+	Hal::reset();
+	Stepper three_ports(200, 2, 8, 14, 13);
+	measure("4 wire on 3 ports", three_ports, 2);
+
+	Hal::reset();
+	Stepper five_wire(200, 2, 3, 4, 5, 6);
+	measure("5 wire", five_wire, 2);
+
+	Hal::reset();
+	Stepper micro(200, true, 8, 7, 4, 6, 5);
+	measure("2 wire + PWM, 8 micro", micro, 7);
+
+	Hal::reset();
+	Stepper micro_32(200, true, 32, 7, 4, 6, 5);
+	measure("2 wire + PWM, 32 micro", micro_32, 7);
+
+	Hal::reset();
+	Stepper micro_4_wire(200, true, 8, 7, 4, 8, 12, 11, 3);
+	measure("4 wire + PWM, 8 micro", micro_4_wire, 7);
+
+	Hal::reset();
+	Stepper fixed_four_wire;
+	FixedStepper<7, 4, 6, 5, 1>::init(fixed_four_wire, 200);
+	measure("FixedStepper 4 wire", fixed_four_wire, 7);
+
+	Hal::reset();
+	Stepper fixed_micro;
+	FixedStepper<7, 4, 6, 5, 8>::init(fixed_micro, 200);
+	measure("FixedStepper + PWM, 8 micro", fixed_micro, 7);
+
+	printf("\n%-22s %8s %10s %12s\n", "PWM of the coils", "Hz", "OCR writes", "max duty err");
+	static const uint8_t timer0_pins[2] = {6, 5};
+	static const uint8_t timer2_pins[2] = {3, 11};
+
+	Hal::reset();
+	Stepper timer0(200, true, 32, 7, 4, 6, 5);
+	pwm("pins 6, 5 (Timer0)", timer0, 32, timer0_pins);
+
+	Hal::reset();
+	Stepper timer2(200, true, 32, 12, 13, 3, 11);
+	timer2.setPwmFrequency(Stepper::PWM_FREQUENCY_ULTRASONIC);
+	pwm("pins 3, 11 (Timer2)", timer2, 32, timer2_pins);
+
+	printf("\nSTEP/DIR driver, 16 micro, %u us pulses\n", StepDirDriver::DEFAULT_PULSE_WIDTH_US);
+	printf("%8s %8s %8s %12s %10s %7s\n", "steps/s", "pulses", "cyc/step", "max err (us)", "width (us)", "CPU");
+	static const uint32_t rates[] = { 1000, 10000, 20000, 40000, 50000 };
+	for (uint8_t i = 0; i < 5; i++){
+		stepDir(rates[i]);
+	}
+
+	printf("\nRate of a long move, 200 steps x 8 micro, 12 mm lead (steps/s)\n");
+	printf("%-22s %12s %12s %9s %12s %9s\n", "Speed", "asked", "before", "error", "now", "error");
+	static const uint16_t rpms[] = { 7, 60, 375, 1000 };
+	for (uint8_t i = 0; i < 4; i++){
+		char name[24];
+		snprintf(name, sizeof(name), "%u rpm", rpms[i]);
+		rate(name, 0, rpms[i], rpms[i] * 1600 / 60.0, rpmBefore(rpms[i]));
+	}
+	static const double speeds[] = { 0.0125, 0.1, 1.0, 2.5, 10.0, 37.5 };
+	for (uint8_t i = 0; i < 6; i++){
+		char name[24];
+		snprintf(name, sizeof(name), "%g mm/s", speeds[i]);
+		double asked = speeds[i] * 1600 / 12;
+		rate(name, static_cast<uint32_t>(asked * 1000 + 0.5), 0, asked, mmBefore(speeds[i]));
+	}
+
+	printf("\nMove of %d steps with acceleration:\n", 1333);
+	profile("trapezoidal", 0);
+	profile("S-curve", 66670);
+
+	return 0;
+}
@@ -0,0 +1,184 @@
+/*
+	bench_telemetry.cpp - Measures how many bytes per sample the three
+	outputs of em_rrl_sensor take on the serial port: text lines, frames of
+	samples (SerialComm::sendSamples) and delta compressed frames
+	(SerialComm::streamSample, flushed every FLUSH_MS like the sketch). The
+	delta frames are decoded again with host/FrameDecoder and compared with
+	the samples that went in.
+
+	For each trace it prints the bytes per sample of each output, how much
+	smaller the delta frames are than the frames of samples, and the most
+	samples per second that fit in 2 Mbaud with each of them.
+
+	The traces are made up after what em_rrl_sensor sees: the actuator
+	holding still or moving at 5 mm/s, raw 10 bit values or 12 bit ones
+	(oversampled, see AnalogFilter.h), with the time steps of AnalogSampler
+	or with the jitter of polling. A trace recorded from em_rrl_sensor (text
+	output, or the output of decode_frames) can be given as well:
+
+	Usage: bench_telemetry [trace.txt]
+
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "SerialComm.h"
+#include "FrameDecoder.h"
+
+
+static const uint32_t SERIAL_BAUD_RATE = 2000000;
+static const double BYTES_PER_S = SERIAL_BAUD_RATE / 10.0;
+static const uint32_t FLUSH_MS = 20;
+static const double COUNTS_PER_MM = 4000 / 12.0; // CPR / lead of the EM_RRL actuator
+
+typedef std::vector<SerialFrame::Sample> Trace;
+
+
+// Time steps of "rate" Hz (+- "jitter" us), the encoder at "speed" mm/s (moving and holding every second if
+// "steps"), the analog value following the position with "noise" LSB rms on top, "extra_bits" above 10 bits
+static Trace makeTrace(const double& rate, const double& jitter, const double& speed, const bool& steps,
+                       const double& noise, const uint8_t& extra_bits){
+	Trace trace;
+	srand(1);
+	const uint32_t num_samples = static_cast<uint32_t>(rate * 4);
+	double position = 0;
+	for (uint32_t i = 0; i < num_samples; i++){
+		double t = i / rate;
+		bool moving = !steps || (static_cast<uint32_t>(t * 2) % 2 == 0);
+		if (moving && i > 0) position += speed * COUNTS_PER_MM / rate;
+
+		double gaussian = 0;
+		for (uint8_t k = 0; k < 12; k++) gaussian += rand() / static_cast<double>(RAND_MAX);
+		double analog = (400 + position / 50 + noise * (gaussian - 6)) * (1 << extra_bits);
+
+		SerialFrame::Sample sample;
+		sample.time = 1000 + static_cast<uint32_t>(t * 1e6 + jitter * (2.0 * rand() / RAND_MAX - 1));
+		sample.position = -static_cast<int32_t>(floor(position));
+		sample.analog = static_cast<uint16_t>(floor(analog + 0.5));
+		trace.push_back(sample);
+	}
+	return trace;
+}
+
+
+static Trace readTrace(const char* path){
+	Trace trace;
+	FILE* file = fopen(path, "r");
+	if (file == 0){
+		fprintf(stderr, "Cannot open %s\n", path);
+		return trace;
+	}
+	unsigned long time;
+	long position;
+	unsigned analog;
+	char line[64];
+	while (fgets(line, sizeof(line), file)){
+		if (sscanf(line, "%lu %ld %u", &time, &position, &analog) == 3){
+			SerialFrame::Sample sample = { static_cast<uint32_t>(time), static_cast<int32_t>(position), static_cast<uint16_t>(analog) };
+			trace.push_back(sample);
+		}
+	}
+	fclose(file);
+	return trace;
+}
+
+
+static double textBytes(const Trace& trace){
+	double bytes = 0;
+	char line[40];
+	for (size_t i = 0; i < trace.size(); i++){
+		bytes += snprintf(line, sizeof(line), "%lu %ld %u\r\n", static_cast<unsigned long>(trace[i].time),
+		                  static_cast<long>(trace[i].position), trace[i].analog);
+	}
+	return bytes;
+}
+
+
+static double frameBytes(const Trace& trace){
+	const uint8_t per_frame = SerialComm::SAMPLES_PER_FRAME;
+	double num_frames = static_cast<double>((trace.size() + per_frame - 1) / per_frame);
+	return num_frames * (SerialFrame::HEADER_SIZE + SerialFrame::CRC_SIZE) + trace.size() * SerialFrame::SAMPLE_SIZE;
+}
+
+
+// Sends the trace with streamSample on the emulated Uno, returns the bytes that went out. "decoded_ok" tells whether
+// FrameDecoder gives back the very same samples.
+static double deltaBytes(const Trace& trace, bool& decoded_ok){
+	Hal::reset();
+	Serial.begin(SERIAL_BAUD_RATE);
+
+	uint32_t last_flush = trace.empty() ? 0 : trace[0].time;
+	for (size_t i = 0; i < trace.size(); i++){
+		SerialComm::streamSample(trace[i]);
+		if (trace[i].time - last_flush >= FLUSH_MS * 1000UL){
+			SerialComm::flushSamples();
+			last_flush = trace[i].time;
+		}
+	}
+	SerialComm::flushSamples();
+	Hal::run(F_CPU / 10); // Till the transmit buffer is empty
+
+	const std::string& output = Hal::serialOutput();
+	FrameDecoder::Obj my_decoder = FrameDecoder::init();
+	size_t index = 0;
+	decoded_ok = true;
+	for (size_t i = 0; i < output.size(); i++){
+		if (!FrameDecoder::feed(my_decoder, static_cast<uint8_t>(output[i]))) continue;
+
+		FrameDecoder::Reader reader = FrameDecoder::startSamples(my_decoder.frame);
+		SerialFrame::Sample sample;
+		while (FrameDecoder::nextSample(my_decoder.frame, reader, sample)){
+			if (index >= trace.size() || sample.time != trace[index].time || sample.position != trace[index].position ||
+			    sample.analog != trace[index].analog){
+				decoded_ok = false;
+			}
+			index++;
+		}
+		if (reader.error) decoded_ok = false;
+	}
+	if (index != trace.size()) decoded_ok = false;
+
+	return output.size();
+}
+
+
+static void printRow(const char* label, const Trace& trace){
+	if (trace.empty()) return;
+
+	bool decoded_ok;
+	double n = static_cast<double>(trace.size());
+	double text = textBytes(trace) / n;
+	double frame = frameBytes(trace) / n;
+	double delta = deltaBytes(trace, decoded_ok) / n;
+	printf("%-26s %8.0f %7.2f %7.2f %7.2f %7.1fx %8.0f %8.0f %8s\n", label, n, text, frame, delta, frame / delta,
+	       BYTES_PER_S / frame, BYTES_PER_S / delta, decoded_ok ? "ok" : "MISMATCH");
+}
+
+
+int main(int argc, char** argv){
+
+	printf("Bytes per sample on the serial port, max samples/s at %lu baud\n", static_cast<unsigned long>(SERIAL_BAUD_RATE));
+	printf("%-26s %8s %7s %7s %7s %8s %8s %8s %8s\n", "trace", "samples", "text", "frames", "delta", "smaller",
+	       "frames/s", "delta/s", "decoded");
+
+	printRow("hold, 10 bit, 200 Hz",       makeTrace(200, 0, 0, false, 0.3, 0));
+	printRow("hold, 10 bit, 1 kHz",        makeTrace(1000, 0, 0, false, 0.3, 0));
+	printRow("hold, 12 bit, 1 kHz",        makeTrace(1000, 0, 0, false, 0.5, 2));
+	printRow("move 5 mm/s, 10 bit, 1 kHz", makeTrace(1000, 0, 5, false, 0.3, 0));
+	printRow("move 5 mm/s, 12 bit, 1 kHz", makeTrace(1000, 0, 5, false, 0.5, 2));
+	printRow("steps, 12 bit, 5 kHz",       makeTrace(5000, 0, 5, true, 0.5, 2));
+	printRow("move, polled +-4 us, 1 kHz", makeTrace(1000, 4, 5, false, 0.3, 0));
+	printRow("move 40 mm/s, 12 bit, 1 kHz", makeTrace(1000, 0, 40, false, 0.5, 2));
+
+	if (argc > 1){
+		printRow(argv[1], readTrace(argv[1]));
+	}
+
+	return 0;
+}
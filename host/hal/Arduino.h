@@ -0,0 +1,152 @@
+/*
+	Arduino.h (host) - Stand-in for the Arduino core so that the libraries
+	in this repository can be compiled and exercised on a Linux machine.
+
+	Only the subset of the Arduino/AVR API that the libraries and sketches
+	in this repository use is provided. The ATmega328P (Arduino Uno) is
+	emulated: the I/O, timer, ADC, external and pin change interrupt
+	registers are plain variables that the simulator (see "HalSim.h")
+	reads and updates every time the virtual clock moves.
+
+	About the virtual clock:
+	Nothing in here runs in real time. Every Arduino core function charges
+	an approximate number of CPU cycles (the cost of the same call on a
+	16 MHz Uno) to a 64-bit virtual cycle counter, and every time the
+	counter moves the simulated peripherals catch up and pending interrupts
+	are dispatched. Pure computation in the libraries is free, so busy-wait
+	loops MUST call a core function (yield(), micros(), ...) to let time
+	pass, which they do on the real board anyway.
+
+
+	GNU GPL License
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h> // the core has it through WCharacter.h (isspace, isdigit ...)
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#include "avr/io.h"
+#include "avr/interrupt.h"
+#include "avr/pgmspace.h"
+
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define NOT_AN_INTERRUPT -1
+#define NOT_A_PIN  0
+#define NOT_A_PORT 0
+#define NOT_ON_TIMER 0
+
+#define PI 3.1415926535897932384626433832795
+
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+
+#define lowByte(w)  ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bitRead(value, bit)  (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit)   ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bit(b) (1UL << (b))
+
+#ifndef _BV
+#define _BV(b) (1 << (b))
+#endif
+
+// The AVR core defines abs() as a macro and the libraries rely on that (abs() of
+// a long or a double). min() and max() are left out on purpose, they break the
+// C++ standard headers that the simulator itself includes.
+#ifdef abs
+#undef abs
+#endif
+#define abs(x) ((x)>0?(x):-(x))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define sq(x) ((x)*(x))
+
+#define interrupts()   sei()
+#define noInterrupts() cli()
+
+
+// Digital and analog I/O
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+
+// Time
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+// External interrupts (pins 2 and 3 on the Uno)
+void attachInterrupt(uint8_t interrupt_num, void (*user_func)(void), int mode);
+void detachInterrupt(uint8_t interrupt_num);
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+
+
+// Pin to port mapping of the ATmega328P (same macros as pins_arduino.h)
+#define NUM_DIGITAL_PINS 20
+#define PB 2
+#define PC 3
+#define PD 4
+
+#define digitalPinToPort(p) ((p) < 8 ? PD : ((p) < 14 ? PB : ((p) < 20 ? PC : NOT_A_PORT)))
+#define digitalPinToBitMask(p) ((uint8_t)(1 << ((p) < 8 ? (p) : ((p) < 14 ? (p) - 8 : (p) - 14))))
+#define portOutputRegister(P) ((P) == PB ? &PORTB : ((P) == PC ? &PORTC : ((P) == PD ? &PORTD : (IoRegister*)0)))
+#define portInputRegister(P)  ((P) == PB ? &PINB  : ((P) == PC ? &PINC  : ((P) == PD ? &PIND  : (volatile uint8_t*)0)))
+#define portModeRegister(P)   ((P) == PB ? &DDRB  : ((P) == PC ? &DDRC  : ((P) == PD ? &DDRD  : (volatile uint8_t*)0)))
+
+#define digitalPinToPCICR(p)    (((p) >= 0 && (p) <= 21) ? (&PCICR) : ((uint8_t *)0))
+#define digitalPinToPCICRbit(p) (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p)    (((p) <= 7) ? (&PCMSK2) : (((p) <= 13) ? (&PCMSK0) : (((p) <= 21) ? (&PCMSK1) : ((uint8_t *)0))))
+#define digitalPinToPCMSKbit(p) (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+// Timer output compare channels used by analogWrite()
+#define TIMER0A 1
+#define TIMER0B 2
+#define TIMER1A 3
+#define TIMER1B 4
+#define TIMER2A 6
+#define TIMER2B 7
+#define digitalPinToTimer(p) ((p) == 3 ? TIMER2B : (p) == 5 ? TIMER0B : (p) == 6 ? TIMER0A : \
+                              (p) == 9 ? TIMER1A : (p) == 10 ? TIMER1B : (p) == 11 ? TIMER2A : NOT_ON_TIMER)
+
+
+#include "HardwareSerial.h"
+
+
+// Sketch entry points (provided by the .ino when a sketch is built on the host)
+void setup(void);
+void loop(void);
+
+#endif
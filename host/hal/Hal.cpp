@@ -0,0 +1,976 @@
+/*
+	Hal.cpp (host) - Emulated ATmega328P (Arduino Uno) behind "Arduino.h".
+	See "HalSim.h" for the model.
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "HalSim.h"
+
+
+// Registers (reset values are the ones left behind by the Arduino core's init())
+volatile uint8_t SREG = _BV(SREG_I);
+
+volatile uint8_t PINB, DDRB, PINC, DDRC, PIND, DDRD;
+IoRegister PORTB, PORTC, PORTD;
+
+volatile uint8_t EICRA, EIMSK;
+FlagRegister EIFR;
+volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+FlagRegister PCIFR;
+
+// Timer0 overflows counted by the core (wiring.c), used by millis()/micros()
+volatile unsigned long timer0_overflow_count = 0;
+volatile uint8_t TCCR0A = _BV(WGM01) | _BV(WGM00), TCCR0B = _BV(CS01) | _BV(CS00), TCNT0, TIMSK0 = _BV(TOIE0);
+IoRegister OCR0A, OCR0B;
+FlagRegister TIFR0;
+volatile uint8_t TCCR1A = _BV(WGM10), TCCR1B = _BV(CS11) | _BV(CS10), TCCR1C, TIMSK1;
+FlagRegister TIFR1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2A = _BV(WGM20), TCCR2B = _BV(CS22), TCNT2, TIMSK2;
+IoRegister OCR2A, OCR2B;
+FlagRegister TIFR2;
+
+volatile uint8_t ADMUX, ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0), ADCSRB, DIDR0;
+volatile uint16_t ADC;
+
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0;
+volatile uint16_t UBRR0;
+
+HardwareSerial Serial;
+
+
+namespace {
+
+	const uint8_t NUM_PINS = NUM_DIGITAL_PINS;
+	const uint32_t TX_CAPACITY = SERIAL_TX_BUFFER_SIZE - 1;
+	const uint32_t RX_CAPACITY = SERIAL_RX_BUFFER_SIZE - 1;
+
+	// Timer/Counter 1 or 2. The counter itself lives in TCNT1/TCNT2.
+	struct Timer{
+		bool wide;
+		uint32_t phase;		// cycles since the last timer clock
+		uint16_t shadow;	// last value written to TCNTx by the simulator
+		uint32_t last_prescaler;
+	};
+
+	struct AdcSim{
+		bool converting;
+		bool first;
+		uint64_t done_at;
+		uint8_t channel;
+	};
+
+	struct State{
+		uint64_t clock = 0;
+		int isr_depth = 0;
+		bool in_device = false;	// a device callback is running, its input changes are dispatched after it
+		bool in_sync = false;
+		Hal::Cost cost;
+
+		bool ext_level[NUM_PINS] = {};
+		int8_t out_level[NUM_PINS];	// -1: pin is an input
+		bool trace_pins = false;
+		std::vector<Hal::PinEvent> pin_trace;
+
+		bool trace_registers = false;
+		std::vector<Hal::RegisterEvent> register_trace;
+		uint16_t reg_shadow[14] = {};
+
+		void (*int_func[2])(void) = { 0, 0 };
+
+		Timer t1 = { true, 0, 0, 0 };
+		Timer t2 = { false, 0, 0, 0 };
+		AdcSim adc = { false, true, 0, 0 };
+		uint16_t analog_value[8] = {};
+		std::function<uint16_t(uint64_t)> analog_source[8];
+
+		uint32_t baud = 0;
+		std::deque<uint8_t> tx;
+		uint64_t tx_done_at = 0;
+		std::string tx_out;
+		bool echo = false;
+		std::deque<std::pair<uint64_t, uint8_t> > rx_pending;
+		std::deque<uint8_t> rx;
+
+		std::vector<Hal::Device*> devices;
+		Hal::IsrStats isr_stats[Hal::NUM_VECTORS] = {};
+
+		State(){
+			for (uint8_t i = 0; i < NUM_PINS; i++) out_level[i] = -1;
+		}
+	};
+
+	State& S(){
+		static State s;
+		return s;
+	}
+
+	void advanceTo(const uint64_t& target);
+
+
+	// ---------------------------------------------------------------- pins
+
+	volatile uint8_t* portOf(const uint8_t& pin){
+		IoRegister* port = portOutputRegister(digitalPinToPort(pin));
+		return port ? &port->value : 0;
+	}
+	volatile uint8_t* ddrOf(const uint8_t& pin) { return portModeRegister(digitalPinToPort(pin)); }
+	volatile uint8_t* pinOf(const uint8_t& pin) { return portInputRegister(digitalPinToPort(pin)); }
+
+	bool pwmConnected(const uint8_t& pin){
+		switch (digitalPinToTimer(pin)) {
+			case TIMER0A: return TCCR0A & _BV(COM0A1);
+			case TIMER0B: return TCCR0A & _BV(COM0B1);
+			case TIMER1A: return TCCR1A & _BV(COM1A1);
+			case TIMER1B: return TCCR1A & _BV(COM1B1);
+			case TIMER2A: return TCCR2A & _BV(COM2A1);
+			case TIMER2B: return TCCR2A & _BV(COM2B1);
+		}
+		return false;
+	}
+
+	// Input registers follow the output latches of output pins and the outside world for inputs
+	void syncInputRegisters(){
+		State& s = S();
+		uint8_t ext[3] = { 0, 0, 0 };
+		for (uint8_t pin = 0; pin < NUM_PINS; pin++){
+			if (s.ext_level[pin]) ext[pin < 8 ? 2 : (pin < 14 ? 0 : 1)] |= digitalPinToBitMask(pin);
+		}
+		PINB = (PORTB.value & DDRB) | (ext[0] & ~DDRB);
+		PINC = (PORTC.value & DDRC) | (ext[1] & ~DDRC);
+		PIND = (PORTD.value & DDRD) | (ext[2] & ~DDRD);
+	}
+
+	void syncOutputs(){
+		State& s = S();
+		for (uint8_t pin = 0; pin < NUM_PINS; pin++){
+			int8_t level = -1;
+			if (*ddrOf(pin) & digitalPinToBitMask(pin)){
+				level = (*portOf(pin) & digitalPinToBitMask(pin)) ? HIGH : LOW;
+			}
+			if (level != s.out_level[pin]){
+				s.out_level[pin] = level;
+				if (level >= 0){
+					if (s.trace_pins) s.pin_trace.push_back(Hal::PinEvent{ s.clock, pin, static_cast<uint8_t>(level) });
+					for (size_t i = 0; i < s.devices.size(); i++) s.devices[i]->onPinChange(pin, level, s.clock);
+				}
+			}
+		}
+		syncInputRegisters();
+	}
+
+	void syncRegisterTrace(){
+		State& s = S();
+		if (!s.trace_registers) return;
+		static const char* names[14] = { "OCR0A", "OCR0B", "OCR1A", "OCR1B", "OCR2A", "OCR2B", "ICR1",
+										 "TCCR0A", "TCCR0B", "TCCR1A", "TCCR1B", "TCCR2A", "TCCR2B", "ADCSRA" };
+		const uint16_t values[14] = { OCR0A.value, OCR0B.value, OCR1A, OCR1B, OCR2A.value, OCR2B.value, ICR1,
+									  TCCR0A, TCCR0B, TCCR1A, TCCR1B, TCCR2A, TCCR2B, ADCSRA };
+		for (uint8_t i = 0; i < 14; i++){
+			if (values[i] != s.reg_shadow[i]){
+				s.reg_shadow[i] = values[i];
+				s.register_trace.push_back(Hal::RegisterEvent{ s.clock, names[i], values[i] });
+			}
+		}
+	}
+
+
+	// -------------------------------------------------------------- timers
+
+	uint32_t prescaler(const Timer& t){
+		static const uint32_t t1[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+		static const uint32_t t2[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+		return t.wide ? t1[TCCR1B & 7] : t2[TCCR2B & 7];
+	}
+
+	uint8_t waveform(const Timer& t){
+		if (t.wide) return (TCCR1A & 3) | (((TCCR1B >> WGM12) & 3) << 2);
+		return (TCCR2A & 3) | (((TCCR2B >> WGM22) & 1) << 2);
+	}
+
+	uint32_t maxCount(const Timer& t){ return t.wide ? 0xFFFF : 0xFF; }
+
+	uint32_t topCount(const Timer& t){
+		const uint8_t mode = waveform(t);
+		if (t.wide){
+			switch (mode){
+				case 1: case 5: return 0xFF;
+				case 2: case 6: return 0x1FF;
+				case 3: case 7: return 0x3FF;
+				case 4: case 9: case 11: case 15: return OCR1A;
+				case 8: case 10: case 12: case 14: return ICR1;
+			}
+			return 0xFFFF;
+		}
+		return (mode == 2 || mode == 5 || mode == 7) ? OCR2A.value : 0xFF;
+	}
+
+	bool clearOnCompare(const Timer& t){
+		const uint8_t mode = waveform(t);
+		return t.wide ? (mode == 4 || mode == 12) : (mode == 2);
+	}
+
+	uint32_t count(const Timer& t){ return t.wide ? TCNT1 : TCNT2; }
+
+	// Timer clocks till the counter next becomes "value" (0 if never)
+	uint64_t ticksTo(const uint32_t& now, const uint32_t& value, const uint32_t& top, const uint32_t& max){
+		if (now < top){
+			if (value > now && value <= top) return value - now;
+			if (value <= now) return top - now + 1 + value;
+			return 0;
+		}
+		if (now == top) return (value <= top) ? 1 + value : 0;
+		if (value > now && value <= max) return value - now;
+		if (value <= top) return max - now + 1 + value;
+		return 0;
+	}
+
+	uint32_t countAfter(const uint32_t& now, const uint64_t& ticks, const uint32_t& top, const uint32_t& max){
+		if (now <= top) return (now + ticks) % (static_cast<uint64_t>(top) + 1);
+		const uint64_t to_wrap = max - now + 1;
+		if (ticks < to_wrap) return now + ticks;
+		return (ticks - to_wrap) % (static_cast<uint64_t>(top) + 1);
+	}
+
+	// Picks up writes to TCNTx and prescaler changes made by the code
+	void adoptTimerWrites(Timer& t){
+		const uint32_t p = prescaler(t);
+		if (count(t) != t.shadow || p != t.last_prescaler) t.phase = 0;
+		t.shadow = count(t);
+		t.last_prescaler = p;
+	}
+
+	// Cycle of the next compare A/B or overflow of the timer
+	uint64_t nextTimerEvent(Timer& t){
+		adoptTimerWrites(t);
+		const uint32_t p = prescaler(t);
+		if (p == 0) return Hal::NEVER;
+
+		const uint32_t now = count(t), top = topCount(t), max = maxCount(t);
+		const uint32_t ocra = t.wide ? OCR1A : OCR2A.value;
+		const uint32_t ocrb = t.wide ? OCR1B : OCR2B.value;
+
+		uint64_t ticks = Hal::NEVER;
+		const uint64_t a = ticksTo(now, ocra, top, max);
+		const uint64_t b = ticksTo(now, ocrb, top, max);
+		const uint64_t o = clearOnCompare(t) ? (now > top ? ticksTo(now, 0, top, max) : 0) : ticksTo(now, 0, top, max);
+		if (a) ticks = std::min(ticks, a);
+		if (b) ticks = std::min(ticks, b);
+		if (o) ticks = std::min(ticks, o);
+		if (ticks == Hal::NEVER) return Hal::NEVER;
+
+		return S().clock + (p - t.phase) + (ticks - 1) * p;
+	}
+
+	void startConversion(const uint64_t& clock);
+
+	void setTimerFlag(Timer& t, const uint8_t& flag){
+		FlagRegister& tifr = t.wide ? TIFR1 : TIFR2;
+		const bool rising = !(tifr.value & _BV(flag));
+		tifr.value |= _BV(flag);
+
+		// ADC auto trigger sources: 5 = Timer1 compare B, 6 = Timer1 overflow
+		if (t.wide && rising && (ADCSRA & _BV(ADEN)) && (ADCSRA & _BV(ADATE))){
+			const uint8_t source = ADCSRB & 7;
+			if ((source == 5 && flag == OCF1B) || (source == 6 && flag == TOV1)) startConversion(S().clock);
+		}
+	}
+
+	void moveTimer(Timer& t, const uint64_t& elapsed){
+		adoptTimerWrites(t);
+		const uint32_t p = prescaler(t);
+		if (p == 0 || elapsed == 0) return;
+
+		const uint64_t total = t.phase + elapsed;
+		const uint64_t ticks = total / p;
+		t.phase = total % p;
+		if (ticks == 0) return;
+
+		const uint32_t now = count(t), top = topCount(t), max = maxCount(t);
+		const uint64_t a = ticksTo(now, t.wide ? OCR1A : OCR2A.value, top, max);
+		const uint64_t b = ticksTo(now, t.wide ? OCR1B : OCR2B.value, top, max);
+		const uint64_t o = clearOnCompare(t) ? (now > top ? ticksTo(now, 0, top, max) : 0) : ticksTo(now, 0, top, max);
+
+		const uint32_t after = countAfter(now, ticks, top, max);
+		if (t.wide) TCNT1 = after;
+		else TCNT2 = after;
+		t.shadow = after;
+
+		if (a && a <= ticks) setTimerFlag(t, t.wide ? OCF1A : OCF2A);
+		if (b && b <= ticks) setTimerFlag(t, t.wide ? OCF1B : OCF2B);
+		if (o && o <= ticks) setTimerFlag(t, t.wide ? TOV1 : TOV2);
+	}
+
+
+	// ----------------------------------------------------------------- ADC
+
+	uint16_t sampleAnalog(const uint8_t& channel, const uint64_t& clock){
+		State& s = S();
+		uint16_t value = s.analog_source[channel & 7] ? s.analog_source[channel & 7](clock) : s.analog_value[channel & 7];
+		return value > 1023 ? 1023 : value;
+	}
+
+	uint32_t adcClock(){
+		static const uint32_t div[8] = { 2, 2, 4, 8, 16, 32, 64, 128 };
+		return div[ADCSRA & 7];
+	}
+
+	void startConversion(const uint64_t& clock){
+		State& s = S();
+		if (s.adc.converting || !(ADCSRA & _BV(ADEN))) return;
+		s.adc.converting = true;
+		s.adc.channel = ADMUX & 0x0F;
+		s.adc.done_at = clock + (s.adc.first ? 25 : 13) * adcClock();
+		s.adc.first = false;
+		ADCSRA |= _BV(ADSC);
+	}
+
+	void finishConversion(){
+		State& s = S();
+		const uint16_t value = sampleAnalog(s.adc.channel, s.clock);
+		ADC = (ADMUX & _BV(ADLAR)) ? static_cast<uint16_t>(value << 6) : value;
+		ADCSRA |= _BV(ADIF);
+		s.adc.converting = false;
+
+		if ((ADCSRA & _BV(ADATE)) && (ADCSRB & 7) == 0) startConversion(s.clock); // free running
+		else ADCSRA &= ~_BV(ADSC);
+	}
+
+
+	// --------------------------------------------------------------- USART
+
+	uint64_t byteCycles(){
+		const uint32_t baud = S().baud ? S().baud : 115200;
+		return (10ULL * F_CPU + baud - 1) / baud;
+	}
+
+	void moveSerial(){
+		State& s = S();
+		while (!s.tx.empty() && s.tx_done_at <= s.clock){
+			const char c = static_cast<char>(s.tx.front());
+			s.tx.pop_front();
+			s.tx_out.push_back(c);
+			if (s.echo) fputc(c, stdout);
+			if (!s.tx.empty()) s.tx_done_at += byteCycles();
+		}
+		while (!s.rx_pending.empty() && s.rx_pending.front().first <= s.clock){
+			if (s.rx.size() < RX_CAPACITY) s.rx.push_back(s.rx_pending.front().second);
+			s.rx_pending.pop_front();
+		}
+	}
+
+
+	// ---------------------------------------------------------- interrupts
+
+	bool pending(const Hal::Vector& v){
+		switch (v){
+			case Hal::VECT_INT0:         return (EIFR & _BV(INTF0)) && (EIMSK & _BV(INT0));
+			case Hal::VECT_INT1:         return (EIFR & _BV(INTF1)) && (EIMSK & _BV(INT1));
+			case Hal::VECT_PCINT0:       return (PCIFR & _BV(PCIF0)) && (PCICR & _BV(PCIE0));
+			case Hal::VECT_PCINT1:       return (PCIFR & _BV(PCIF1)) && (PCICR & _BV(PCIE1));
+			case Hal::VECT_PCINT2:       return (PCIFR & _BV(PCIF2)) && (PCICR & _BV(PCIE2));
+			case Hal::VECT_TIMER2_COMPA: return (TIFR2 & _BV(OCF2A)) && (TIMSK2 & _BV(OCIE2A));
+			case Hal::VECT_TIMER2_COMPB: return (TIFR2 & _BV(OCF2B)) && (TIMSK2 & _BV(OCIE2B));
+			case Hal::VECT_TIMER2_OVF:   return (TIFR2 & _BV(TOV2)) && (TIMSK2 & _BV(TOIE2));
+			case Hal::VECT_TIMER1_CAPT:  return (TIFR1 & _BV(ICF1)) && (TIMSK1 & _BV(ICIE1));
+			case Hal::VECT_TIMER1_COMPA: return (TIFR1 & _BV(OCF1A)) && (TIMSK1 & _BV(OCIE1A));
+			case Hal::VECT_TIMER1_COMPB: return (TIFR1 & _BV(OCF1B)) && (TIMSK1 & _BV(OCIE1B));
+			case Hal::VECT_TIMER1_OVF:   return (TIFR1 & _BV(TOV1)) && (TIMSK1 & _BV(TOIE1));
+			case Hal::VECT_ADC:          return (ADCSRA & _BV(ADIF)) && (ADCSRA & _BV(ADIE));
+			default: return false;
+		}
+	}
+
+	// Clears the flag (the hardware does so when the vector is executed) and returns the handler
+	void (*acknowledge(const Hal::Vector& v, bool& attached))(void){
+		attached = false;
+		switch (v){
+			case Hal::VECT_INT0:
+				EIFR.value &= ~_BV(INTF0);
+				if (S().int_func[0]) { attached = true; return S().int_func[0]; }
+				return INT0_vect;
+			case Hal::VECT_INT1:
+				EIFR.value &= ~_BV(INTF1);
+				if (S().int_func[1]) { attached = true; return S().int_func[1]; }
+				return INT1_vect;
+			case Hal::VECT_PCINT0:       PCIFR.value &= ~_BV(PCIF0); return PCINT0_vect;
+			case Hal::VECT_PCINT1:       PCIFR.value &= ~_BV(PCIF1); return PCINT1_vect;
+			case Hal::VECT_PCINT2:       PCIFR.value &= ~_BV(PCIF2); return PCINT2_vect;
+			case Hal::VECT_TIMER2_COMPA: TIFR2.value &= ~_BV(OCF2A); return TIMER2_COMPA_vect;
+			case Hal::VECT_TIMER2_COMPB: TIFR2.value &= ~_BV(OCF2B); return TIMER2_COMPB_vect;
+			case Hal::VECT_TIMER2_OVF:   TIFR2.value &= ~_BV(TOV2);  return TIMER2_OVF_vect;
+			case Hal::VECT_TIMER1_CAPT:  TIFR1.value &= ~_BV(ICF1);  return TIMER1_CAPT_vect;
+			case Hal::VECT_TIMER1_COMPA: TIFR1.value &= ~_BV(OCF1A); return TIMER1_COMPA_vect;
+			case Hal::VECT_TIMER1_COMPB: TIFR1.value &= ~_BV(OCF1B); return TIMER1_COMPB_vect;
+			case Hal::VECT_TIMER1_OVF:   TIFR1.value &= ~_BV(TOV1);  return TIMER1_OVF_vect;
+			case Hal::VECT_ADC:          ADCSRA &= ~_BV(ADIF); return ADC_vect;
+			default: return 0;
+		}
+	}
+
+	void dispatchPending(){
+		State& s = S();
+		bool serviced = true;
+		while (serviced && s.isr_depth == 0 && (SREG & _BV(SREG_I))){
+			serviced = false;
+			for (int v = 0; v < Hal::NUM_VECTORS; v++){
+				const Hal::Vector vector = static_cast<Hal::Vector>(v);
+				if (!pending(vector)) continue;
+
+				bool attached;
+				void (*handler)(void) = acknowledge(vector, attached);
+				const uint64_t start = s.clock;
+				const uint8_t sreg = SREG;
+
+				SREG &= ~_BV(SREG_I);
+				s.isr_depth++;
+				advanceTo(s.clock + (attached ? s.cost.attached_isr : s.cost.isr));
+				if (handler) handler();
+				s.isr_depth--;
+				SREG = sreg;
+
+				Hal::IsrStats& stats = s.isr_stats[v];
+				const uint64_t spent = s.clock - start;
+				stats.count++;
+				stats.cycles += spent;
+				if (spent > stats.max_cycles) stats.max_cycles = spent;
+
+				serviced = true;
+				break; // re-evaluate priorities after every vector
+			}
+		}
+	}
+
+
+	// ----------------------------------------------------------- the clock
+
+	uint64_t nextEvent(){
+		State& s = S();
+		uint64_t next = Hal::NEVER;
+		next = std::min(next, nextTimerEvent(s.t1));
+		next = std::min(next, nextTimerEvent(s.t2));
+		if (s.adc.converting) next = std::min(next, s.adc.done_at);
+		if (!s.tx.empty()) next = std::min(next, s.tx_done_at);
+		if (!s.rx_pending.empty()) next = std::min(next, s.rx_pending.front().first);
+		for (size_t i = 0; i < s.devices.size(); i++) next = std::min(next, s.devices[i]->nextEvent());
+		return next;
+	}
+
+	void sync(){
+		State& s = S();
+		if (s.in_sync) return;
+		s.in_sync = true;
+		syncOutputs();
+		syncRegisterTrace();
+		// Conversions started by the code writing ADSC
+		if ((ADCSRA & _BV(ADSC)) && !s.adc.converting) startConversion(s.clock);
+		s.in_sync = false;
+	}
+
+	void advanceTo(const uint64_t& target){
+		State& s = S();
+		sync();
+		do {
+			const uint64_t next = std::max(s.clock, std::min(target, nextEvent()));
+			moveTimer(s.t1, next - s.clock);
+			moveTimer(s.t2, next - s.clock);
+			s.clock = next;
+			TCNT0 = static_cast<uint8_t>(s.clock / 64);
+			timer0_overflow_count = static_cast<unsigned long>(s.clock / (64 * 256));
+
+			if (s.adc.converting && s.adc.done_at <= s.clock) finishConversion();
+			moveSerial();
+			s.in_device = true;
+			for (size_t i = 0; i < s.devices.size(); i++){
+				if (s.devices[i]->nextEvent() <= s.clock) s.devices[i]->onEvent(s.clock);
+			}
+			s.in_device = false;
+			sync();
+			if (s.isr_depth == 0) dispatchPending();
+		} while (s.clock < target);
+	}
+}
+
+
+// ------------------------------------------------------------ simulator API
+
+namespace Hal{
+
+	void reset(){
+		State& s = S();
+		s.~State();
+		new (&s) State();
+
+		SREG = _BV(SREG_I);
+		PINB = DDRB = PINC = DDRC = PIND = DDRD = 0;
+		PORTB.value = PORTC.value = PORTD.value = 0;
+		EICRA = EIMSK = PCICR = PCMSK0 = PCMSK1 = PCMSK2 = 0;
+		EIFR.value = PCIFR.value = TIFR0.value = TIFR1.value = TIFR2.value = 0;
+		TCCR0A = _BV(WGM01) | _BV(WGM00); TCCR0B = _BV(CS01) | _BV(CS00); TCNT0 = OCR0A.value = OCR0B.value = 0; TIMSK0 = _BV(TOIE0);
+		timer0_overflow_count = 0;
+		TCCR1A = _BV(WGM10); TCCR1B = _BV(CS11) | _BV(CS10); TCCR1C = TIMSK1 = 0; TCNT1 = OCR1A = OCR1B = ICR1 = 0;
+		TCCR2A = _BV(WGM20); TCCR2B = _BV(CS22); TCNT2 = OCR2A.value = OCR2B.value = TIMSK2 = 0;
+		ADMUX = 0; ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); ADCSRB = DIDR0 = 0; ADC = 0;
+		UCSR0A = UCSR0B = UCSR0C = UDR0 = 0; UBRR0 = 0;
+	}
+
+	uint64_t cycles() { return S().clock; }
+	double seconds() { return S().clock / static_cast<double>(F_CPU); }
+	uint64_t usToCycles(const double& us) { return static_cast<uint64_t>(us * (F_CPU / 1000000.0) + 0.5); }
+
+	void run(const uint64_t& num_cycles) { advanceTo(S().clock + num_cycles); }
+	void runUntil(const uint64_t& cycle) { if (cycle > S().clock) advanceTo(cycle); }
+
+	bool runUntil(const std::function<bool()>& condition, const uint64_t& timeout_cycles, const uint32_t& step_cycles){
+		const uint64_t end = S().clock + timeout_cycles;
+		while (!condition()){
+			if (S().clock >= end) return false;
+			advanceTo(std::min(end, S().clock + step_cycles));
+		}
+		return true;
+	}
+
+	Cost& cost() { return S().cost; }
+	void charge(const uint32_t& num_cycles) { advanceTo(S().clock + num_cycles); }
+
+	void setInput(const uint8_t& pin, const bool& level){
+		State& s = S();
+		if (pin >= NUM_PINS || s.ext_level[pin] == level) return;
+		s.ext_level[pin] = level;
+		syncInputRegisters();
+
+		const bool is_input = !(*ddrOf(pin) & digitalPinToBitMask(pin));
+		if (!is_input) return;
+
+		// External interrupts INT0 (pin 2), INT1 (pin 3)
+		const int num = digitalPinToInterrupt(pin);
+		if (num >= 0){
+			const uint8_t sense = (EICRA >> (2 * num)) & 3;
+			if (sense == 1 || (sense == 2 && !level) || (sense == 3 && level) || (sense == 0 && !level)){
+				if (EIFR & _BV(num)) s.isr_stats[num].lost++;
+				EIFR.value |= _BV(num);
+			}
+		}
+
+		// Pin change interrupts
+		const uint8_t group = digitalPinToPCICRbit(pin);
+		if (*digitalPinToPCMSK(pin) & _BV(digitalPinToPCMSKbit(pin))){
+			if (PCIFR & _BV(group)) s.isr_stats[VECT_PCINT0 + group].lost++;
+			PCIFR.value |= _BV(group);
+		}
+
+		if (s.trace_pins) s.pin_trace.push_back(PinEvent{ s.clock, pin, static_cast<uint8_t>(level) });
+		if (s.isr_depth == 0 && !s.in_device) dispatchPending();
+	}
+
+	bool pinLevel(const uint8_t& pin){
+		sync();
+		return (*pinOf(pin) & digitalPinToBitMask(pin)) != 0;
+	}
+
+	uint8_t pwmDuty(const uint8_t& pin){
+		if (!pwmConnected(pin)) return 0;
+		// COMxx0 set as well: inverted output, high from the compare match to TOP
+		switch (digitalPinToTimer(pin)) {
+			case TIMER0A: return (TCCR0A & _BV(COM0A0)) ? 0xFF - OCR0A.value : OCR0A.value;
+			case TIMER0B: return (TCCR0A & _BV(COM0B0)) ? 0xFF - OCR0B.value : OCR0B.value;
+			case TIMER1A: return static_cast<uint8_t>((TCCR1A & _BV(COM1A0)) ? 0xFF - OCR1A : OCR1A);
+			case TIMER1B: return static_cast<uint8_t>((TCCR1A & _BV(COM1B0)) ? 0xFF - OCR1B : OCR1B);
+			case TIMER2A: return (TCCR2A & _BV(COM2A0)) ? 0xFF - OCR2A.value : OCR2A.value;
+			case TIMER2B: return (TCCR2A & _BV(COM2B0)) ? 0xFF - OCR2B.value : OCR2B.value;
+		}
+		return 0;
+	}
+
+	uint32_t pwmFrequency(const uint8_t& pin){
+		static const uint32_t t0[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+		uint32_t p = 0, top = 0xFF;
+		bool phase_correct = false;
+		switch (digitalPinToTimer(pin)) {
+			case TIMER0A: case TIMER0B:
+				p = t0[TCCR0B & 7];
+				phase_correct = (TCCR0A & 3) == 1;
+				top = ((TCCR0B & _BV(WGM02)) ? OCR0A.value : 0xFF);
+				break;
+			case TIMER1A: case TIMER1B: {
+				p = prescaler(S().t1);
+				top = topCount(S().t1);
+				const uint8_t mode = waveform(S().t1);
+				phase_correct = (mode >= 1 && mode <= 3) || (mode >= 8 && mode <= 11);
+				break;
+			}
+			case TIMER2A: case TIMER2B:
+				p = prescaler(S().t2);
+				top = topCount(S().t2);
+				phase_correct = (waveform(S().t2) & 3) == 1;
+				break;
+			default:
+				return 0;
+		}
+		if (p == 0) return 0;
+		return phase_correct ? F_CPU / (p * 2 * top) : F_CPU / (p * (top + 1));
+	}
+
+	void tracePins(const bool& enable) { S().trace_pins = enable; }
+	const std::vector<PinEvent>& pinTrace() { sync(); return S().pin_trace; }
+	void clearPinTrace() { S().pin_trace.clear(); }
+
+	void traceRegisters(const bool& enable) { S().trace_registers = enable; if (enable) syncRegisterTrace(); }
+	const std::vector<RegisterEvent>& registerTrace() { sync(); return S().register_trace; }
+	void clearRegisterTrace() { S().register_trace.clear(); }
+
+	void setAnalog(const uint8_t& channel, const uint16_t& value){
+		S().analog_source[channel & 7] = std::function<uint16_t(uint64_t)>();
+		S().analog_value[channel & 7] = value;
+	}
+
+	void setAnalog(const uint8_t& channel, const std::function<uint16_t(uint64_t)>& source){
+		S().analog_source[channel & 7] = source;
+	}
+
+	void serialInput(const std::string& data){
+		State& s = S();
+		uint64_t at = s.rx_pending.empty() ? s.clock : s.rx_pending.back().first;
+		for (size_t i = 0; i < data.size(); i++){
+			at += byteCycles();
+			s.rx_pending.push_back(std::make_pair(at, static_cast<uint8_t>(data[i])));
+		}
+	}
+
+	const std::string& serialOutput() { moveSerial(); return S().tx_out; }
+	void clearSerialOutput() { S().tx_out.clear(); }
+	void echoSerial(const bool& enable) { S().echo = enable; }
+	uint32_t serialBaud() { return S().baud; }
+
+	void attach(Device* device) { S().devices.push_back(device); }
+	void detach(Device* device){
+		std::vector<Device*>& d = S().devices;
+		d.erase(std::remove(d.begin(), d.end(), device), d.end());
+	}
+
+	const IsrStats& isrStats(const Vector& vector) { return S().isr_stats[vector]; }
+	void clearIsrStats() { for (int v = 0; v < NUM_VECTORS; v++) S().isr_stats[v] = IsrStats(); }
+
+	void runSketch(void (*setup_fn)(), void (*loop_fn)(), const double& duration_s){
+		const uint64_t end = static_cast<uint64_t>(duration_s * F_CPU);
+		setup_fn();
+		while (S().clock < end){
+			loop_fn();
+			charge(S().cost.loop);
+		}
+	}
+}
+
+
+// ------------------------------------------- registers that charge cycles
+
+// The time passes before the access, the same as for the core calls
+IoRegister::operator uint8_t() const{
+	Hal::charge(S().cost.io_access);
+	return value;
+}
+
+IoRegister& IoRegister::operator=(const uint8_t& written){
+	Hal::charge(S().cost.io_access);
+	value = written;
+	return *this;
+}
+
+IoRegister& IoRegister::operator|=(const int& bits){
+	Hal::charge(S().cost.io_bit);
+	value |= bits;
+	return *this;
+}
+
+IoRegister& IoRegister::operator&=(const int& bits){
+	Hal::charge(S().cost.io_bit);
+	value &= bits;
+	return *this;
+}
+
+IoRegister& IoRegisterPtr::operator*() const{
+	Hal::charge(S().cost.io_pointer);
+	return *reg;
+}
+
+
+// ------------------------------------------------------- Arduino core calls
+
+extern "C" void hal_sei(void){
+	SREG |= _BV(SREG_I);
+	if (S().isr_depth == 0) dispatchPending();
+}
+
+extern "C" void hal_cli(void){
+	SREG &= ~_BV(SREG_I);
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+	if (pin >= NUM_PINS) return;
+	Hal::charge(S().cost.pin_mode);
+	const uint8_t mask = digitalPinToBitMask(pin);
+	if (mode == OUTPUT) {
+		*ddrOf(pin) |= mask;
+	} else {
+		*ddrOf(pin) &= ~mask;
+		if (mode == INPUT_PULLUP) *portOf(pin) |= mask;
+		else *portOf(pin) &= ~mask;
+	}
+	sync();
+}
+
+void digitalWrite(uint8_t pin, uint8_t val){
+	if (pin >= NUM_PINS) return;
+	Hal::charge(S().cost.digital_write);
+	// Same as the core: writing a pin disconnects its PWM output
+	switch (digitalPinToTimer(pin)) {
+		case TIMER0A: TCCR0A &= ~_BV(COM0A1); break;
+		case TIMER0B: TCCR0A &= ~_BV(COM0B1); break;
+		case TIMER1A: TCCR1A &= ~_BV(COM1A1); break;
+		case TIMER1B: TCCR1A &= ~_BV(COM1B1); break;
+		case TIMER2A: TCCR2A &= ~_BV(COM2A1); break;
+		case TIMER2B: TCCR2A &= ~_BV(COM2B1); break;
+	}
+	if (val == LOW) *portOf(pin) &= ~digitalPinToBitMask(pin);
+	else *portOf(pin) |= digitalPinToBitMask(pin);
+	sync();
+}
+
+int digitalRead(uint8_t pin){
+	if (pin >= NUM_PINS) return LOW;
+	Hal::charge(S().cost.digital_read);
+	return (*pinOf(pin) & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+void analogWrite(uint8_t pin, int val){
+	pinMode(pin, OUTPUT);
+	Hal::charge(S().cost.analog_write);
+	if (val <= 0) { digitalWrite(pin, LOW); return; }
+	if (val >= 255) { digitalWrite(pin, HIGH); return; }
+	switch (digitalPinToTimer(pin)) {
+		case TIMER0A: TCCR0A |= _BV(COM0A1); OCR0A.value = val; break;
+		case TIMER0B: TCCR0A |= _BV(COM0B1); OCR0B.value = val; break;
+		case TIMER1A: TCCR1A |= _BV(COM1A1); OCR1A = val; break;
+		case TIMER1B: TCCR1A |= _BV(COM1B1); OCR1B = val; break;
+		case TIMER2A: TCCR2A |= _BV(COM2A1); OCR2A.value = val; break;
+		case TIMER2B: TCCR2A |= _BV(COM2B1); OCR2B.value = val; break;
+		default: digitalWrite(pin, val < 128 ? LOW : HIGH); return;
+	}
+	sync();
+}
+
+int analogRead(uint8_t pin){
+	const uint8_t channel = pin >= 14 ? pin - 14 : pin;
+	ADMUX = _BV(REFS0) | (channel & 0x07);
+	Hal::charge(S().cost.analog_read_overhead + 13 * adcClock());
+	return sampleAnalog(channel, S().clock);
+}
+
+unsigned long micros(void){
+	Hal::charge(S().cost.micros);
+	return static_cast<unsigned long>(S().clock / (F_CPU / 1000000UL));
+}
+
+unsigned long millis(void){
+	Hal::charge(S().cost.millis);
+	return static_cast<unsigned long>(S().clock / (F_CPU / 1000UL));
+}
+
+void delay(unsigned long ms) { Hal::run(static_cast<uint64_t>(ms) * (F_CPU / 1000UL)); }
+void delayMicroseconds(unsigned int us) { Hal::run(static_cast<uint64_t>(us) * (F_CPU / 1000000UL)); }
+void yield(void) { Hal::charge(S().cost.yield); }
+
+void attachInterrupt(uint8_t interrupt_num, void (*user_func)(void), int mode){
+	if (interrupt_num > 1) return;
+	S().int_func[interrupt_num] = user_func;
+	EICRA = (EICRA & ~(3 << (2 * interrupt_num))) | (mode << (2 * interrupt_num));
+	EIMSK |= _BV(interrupt_num);
+}
+
+void detachInterrupt(uint8_t interrupt_num){
+	if (interrupt_num > 1) return;
+	EIMSK &= ~_BV(interrupt_num);
+	S().int_func[interrupt_num] = 0;
+}
+
+
+// ------------------------------------------------------------------ Serial
+
+// Print (formatting shared by Serial and anything else that prints)
+size_t Print::write(const uint8_t* buffer, size_t size){
+	size_t n = 0;
+	while (size--) n += write(*buffer++);
+	return n;
+}
+
+size_t Print::write(const char* str) { return (str == 0) ? 0 : write(reinterpret_cast<const uint8_t*>(str), strlen(str)); }
+
+size_t Print::printNumber(unsigned long n, int base){
+	char buf[8 * sizeof(long) + 1];
+	char* str = &buf[sizeof(buf) - 1];
+	*str = '\0';
+	if (base < 2) base = 10;
+	do {
+		const char c = n % base;
+		n /= base;
+		*--str = c < 10 ? c + '0' : c + 'A' - 10;
+		Hal::charge(Hal::cost().print_digit);
+	} while (n);
+	return write(str);
+}
+
+size_t Print::print(const char* str) { return write(str); }
+size_t Print::print(char c) { return write(static_cast<uint8_t>(c)); }
+size_t Print::print(unsigned char n, int base) { return print(static_cast<unsigned long>(n), base); }
+size_t Print::print(int n, int base) { return print(static_cast<long>(n), base); }
+size_t Print::print(unsigned int n, int base) { return print(static_cast<unsigned long>(n), base); }
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+
+size_t Print::print(long n, int base){
+	if (base == 10 && n < 0) return write('-') + printNumber(static_cast<unsigned long>(-n), 10);
+	return printNumber(static_cast<unsigned long>(n), base);
+}
+
+size_t Print::print(double number, int digits){
+	if (isnan(number)) return print("nan");
+	if (isinf(number)) return print("inf");
+	if (number > 4294967040.0 || number < -4294967040.0) return print("ovf");
+
+	size_t n = 0;
+	if (number < 0.0) { n += write('-'); number = -number; }
+
+	double rounding = 0.5;
+	for (int i = 0; i < digits; ++i) rounding /= 10.0;
+	number += rounding;
+
+	const unsigned long int_part = static_cast<unsigned long>(number);
+	double remainder = number - static_cast<double>(int_part);
+	n += print(int_part);
+	if (digits > 0) n += write('.');
+	while (digits-- > 0){
+		remainder *= 10.0;
+		const unsigned int to_print = static_cast<unsigned int>(remainder);
+		n += print(to_print);
+		remainder -= to_print;
+	}
+	return n;
+}
+
+size_t Print::println() { return write('\r') + write('\n'); }
+size_t Print::println(const char* str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base) { return print(n, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+
+void HardwareSerial::begin(unsigned long baud) { S().baud = baud; UCSR0B = _BV(RXEN0) | _BV(TXEN0); }
+void HardwareSerial::end() { flush(); S().baud = 0; }
+
+int HardwareSerial::available(){
+	moveSerial();
+	return static_cast<int>(S().rx.size());
+}
+
+int HardwareSerial::peek(){
+	moveSerial();
+	return S().rx.empty() ? -1 : S().rx.front();
+}
+
+int HardwareSerial::read(){
+	Hal::charge(S().cost.serial_read);
+	moveSerial();
+	if (S().rx.empty()) return -1;
+	const int c = S().rx.front();
+	S().rx.pop_front();
+	return c;
+}
+
+int HardwareSerial::availableForWrite(){
+	moveSerial();
+	return static_cast<int>(TX_CAPACITY - S().tx.size());
+}
+
+void HardwareSerial::flush(){
+	State& s = S();
+	moveSerial();
+	while (!s.tx.empty()) advanceTo(s.tx_done_at);
+}
+
+size_t HardwareSerial::write(uint8_t c){
+	State& s = S();
+	Hal::charge(s.cost.serial_write);
+	moveSerial();
+	while (s.tx.size() >= TX_CAPACITY) advanceTo(s.tx_done_at); // the core busy-waits for room
+	if (s.tx.empty()) s.tx_done_at = s.clock + byteCycles();
+	s.tx.push_back(c);
+	return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size){
+	for (size_t i = 0; i < size; i++) write(buffer[i]);
+	return size;
+}
+
+
+void HardwareSerial::setTimeout(unsigned long timeout) { timeout_ms = timeout; }
+
+int HardwareSerial::timedPeek(){
+	const uint64_t end = S().clock + static_cast<uint64_t>(timeout_ms) * (F_CPU / 1000UL);
+	while (true){
+		const int c = peek();
+		if (c >= 0) return c;
+		if (S().clock >= end) return -1;
+		advanceTo(std::min(end, S().clock + byteCycles()));
+	}
+}
+
+// Same parsing rules as Stream::parseInt() / Stream::parseFloat() (SKIP_ALL)
+long HardwareSerial::parseInt(){
+	int c;
+	while ((c = timedPeek()) >= 0 && c != '-' && (c < '0' || c > '9')) read();
+	if (c < 0) return 0;
+
+	bool negative = false;
+	long value = 0;
+	do {
+		if (c == '-') negative = true;
+		else value = value * 10 + c - '0';
+		read();
+		c = timedPeek();
+	} while (c >= '0' && c <= '9');
+	return negative ? -value : value;
+}
+
+float HardwareSerial::parseFloat(){
+	int c;
+	while ((c = timedPeek()) >= 0 && c != '-' && c != '.' && (c < '0' || c > '9')) read();
+	if (c < 0) return 0;
+
+	bool negative = false, fraction = false;
+	double value = 0.0, scale = 1.0;
+	do {
+		if (c == '-') negative = true;
+		else if (c == '.') fraction = true;
+		else {
+			value = value * 10 + c - '0';
+			if (fraction) scale *= 0.1;
+		}
+		read();
+		c = timedPeek();
+	} while ((c >= '0' && c <= '9') || (c == '.' && !fraction));
+	value *= scale;
+	return static_cast<float>(negative ? -value : value);
+}
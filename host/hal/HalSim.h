@@ -0,0 +1,159 @@
+/*
+	HalSim.h (host) - Control side of the host Arduino emulation.
+
+	The libraries only ever see "Arduino.h". Benchmarks and simulations use
+	this header to drive the emulated Uno: move the virtual clock, feed input
+	pins, analog channels and serial data, and read back what the libraries
+	did (pin transitions with time stamps, register writes, serial output,
+	interrupt statistics).
+
+	About the model:
+	Time only moves when something charges cycles to the virtual clock. The
+	Arduino core functions charge their approximate cost on a 16 MHz Uno (see
+	Hal::Cost, every value can be changed), an interrupt charges its entry and
+	exit overhead, and Hal::run() lets time pass with the CPU idle. So do the
+	reads and writes of the port registers and of the 8 bit compare
+	registers (PORTx, OCR0x, OCR2x, see "IoRegister" in avr/io.h): that is
+	what the step functions of the motors do, and how a wiring or FixedStepper
+	differs from another, together with the loads of the pointers kept to
+	them (IO_REGISTER_PTR). The other registers and plain computation in the
+	libraries are free, which is also roughly true on the board when compared
+	to the core calls. Not counted, e.g., the call through a function pointer
+	and the loads of the bitmasks, so the step functions of Stepper are a bit
+	cheaper here than on the board next to FixedStepper.
+
+	Whenever the clock moves, Timer1 and Timer2, the ADC and the USART catch
+	up, external devices (see Hal::Device) get their events, output pin
+	changes are detected and recorded, and pending interrupts are dispatched
+	in AVR vector priority order if the global interrupt flag is set.
+	Interrupts never nest (same as the AVR without sei() inside the ISR).
+
+
+	GNU GPL License
+ */
+
+#ifndef HALSIM_H
+#define HALSIM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace Hal{
+
+	static const uint64_t NEVER = ~static_cast<uint64_t>(0);
+
+	// Approximate cost (in CPU cycles at 16 MHz) of the Arduino core calls
+	struct Cost{
+		uint32_t digital_write = 56;
+		uint32_t digital_read  = 50;
+		uint32_t pin_mode      = 60;
+		uint32_t analog_write  = 90;
+		uint32_t analog_read_overhead = 60;	// + the conversion itself (13 ADC clocks)
+		uint32_t micros        = 56;
+		uint32_t millis        = 30;
+		uint32_t yield         = 8;
+		uint32_t loop          = 20;	// main() overhead around every loop() call
+		uint32_t isr           = 40;	// vector jump, prologue, epilogue and reti of an ISR()
+		uint32_t attached_isr  = 90;	// same for attachInterrupt() handlers (the core's wrapper saves more registers)
+		uint32_t serial_write  = 40;	// per byte queued in the transmit buffer
+		uint32_t serial_read   = 30;
+		uint32_t print_digit   = 60;	// number formatting in print(), per digit
+		uint32_t io_access     = 2;	// read or write of a port or 8 bit compare register (ld/st, lds/sts; in/out take 1)
+		uint32_t io_bit        = 2;	// "|=" or "&=" of one of them (sbi/cbi; through a pointer it is ld, or, st on the board)
+		uint32_t io_pointer    = 2;	// + an access through a pointer: loading it (ldd, halved as a read and a write share it)
+	};
+
+	// Output pin transition (or an input transition when tracing inputs)
+	struct PinEvent{
+		uint64_t cycle;
+		uint8_t pin;
+		uint8_t level;
+	};
+
+	// Value of a watched register after it changed
+	struct RegisterEvent{
+		uint64_t cycle;
+		const char* name;
+		uint16_t value;
+	};
+
+	// Number of times an interrupt vector ran and the cycles spent in it
+	struct IsrStats{
+		uint64_t count;
+		uint64_t cycles;
+		uint64_t max_cycles;
+		uint64_t lost; // edges/events that arrived while the same flag was still pending
+	};
+
+	enum Vector{
+		VECT_INT0, VECT_INT1, VECT_PCINT0, VECT_PCINT1, VECT_PCINT2,
+		VECT_TIMER2_COMPA, VECT_TIMER2_COMPB, VECT_TIMER2_OVF,
+		VECT_TIMER1_CAPT, VECT_TIMER1_COMPA, VECT_TIMER1_COMPB, VECT_TIMER1_OVF,
+		VECT_ADC, NUM_VECTORS
+	};
+
+	// Anything outside the MCU: a motor, an encoder, a signal source, ...
+	// "nextEvent" returns the cycle at which the device wants to be called
+	// next (Hal::NEVER if it doesn't), "onEvent" is then called with the
+	// clock at that cycle. "onPinChange" reports every output pin change.
+	class Device{
+	  public:
+		virtual ~Device(){}
+		virtual uint64_t nextEvent() { return NEVER; }
+		virtual void onEvent(const uint64_t& cycle) { (void)cycle; }
+		virtual void onPinChange(const uint8_t& pin, const uint8_t& level, const uint64_t& cycle) { (void)pin; (void)level; (void)cycle; }
+	};
+
+
+	void reset(); // Resets the clock, the registers, the traces and detaches all devices
+
+	uint64_t cycles();   // Virtual clock in CPU cycles
+	double seconds();    // Virtual clock in seconds
+	void run(const uint64_t& num_cycles);    // Lets time pass with the CPU idle (interrupts are serviced)
+	void runUntil(const uint64_t& cycle);
+	bool runUntil(const std::function<bool()>& condition, const uint64_t& timeout_cycles, const uint32_t& step_cycles = 16);
+	uint64_t usToCycles(const double& us);
+
+	Cost& cost();
+	void charge(const uint32_t& num_cycles); // Charges cycles to whatever is running (used by the core functions)
+
+	// Pins
+	void setInput(const uint8_t& pin, const bool& level);	// Drives an input pin from outside
+	bool pinLevel(const uint8_t& pin);
+	uint8_t pwmDuty(const uint8_t& pin);	// Duty (0 .. 255) set by the compare value of the timer channel driving the pin, if it is connected
+	uint32_t pwmFrequency(const uint8_t& pin);	// PWM frequency in Hz of the timer driving the pin
+	void tracePins(const bool& enable);
+	const std::vector<PinEvent>& pinTrace();
+	void clearPinTrace();
+
+	// Registers
+	void traceRegisters(const bool& enable);
+	const std::vector<RegisterEvent>& registerTrace();
+	void clearRegisterTrace();
+
+	// Analog inputs: either a fixed value or a function of the clock
+	void setAnalog(const uint8_t& channel, const uint16_t& value);
+	void setAnalog(const uint8_t& channel, const std::function<uint16_t(uint64_t)>& source);
+
+	// Serial port
+	void serialInput(const std::string& data); // Bytes arrive back to back at the configured baud rate
+	const std::string& serialOutput();	// Everything that has left the transmit buffer so far
+	void clearSerialOutput();
+	void echoSerial(const bool& enable);	// Also copy the serial output to stdout
+	uint32_t serialBaud();
+
+	// Devices
+	void attach(Device* device);
+	void detach(Device* device);
+
+	// Interrupt statistics
+	const IsrStats& isrStats(const Vector& vector);
+	void clearIsrStats();
+
+	// Runs a sketch: setup() once, then loop() till the clock reaches "duration_s"
+	void runSketch(void (*setup_fn)(), void (*loop_fn)(), const double& duration_s);
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+	HardwareSerial.h (host) - Serial port of the host build.
+
+	Bytes written are queued in a 64 byte transmit buffer (same size as the
+	AVR core) that drains at the configured baud rate on the virtual clock,
+	so a full buffer or flush() stalls the caller exactly like on the board.
+	Everything that leaves the buffer is captured by the simulator, see
+	Hal::serialOutput(). Received bytes are injected with Hal::serialInput().
+
+	GNU GPL License
+ */
+
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "Print.h"
+
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+
+class HardwareSerial : public Print {
+  public:
+	void begin(unsigned long baud);
+	void end();
+
+	int available();
+	int peek();
+	int read();
+	int availableForWrite();
+	void flush();
+
+	long parseInt();
+	float parseFloat();
+	void setTimeout(unsigned long timeout_ms);
+
+	size_t write(uint8_t c);
+	size_t write(const uint8_t* buffer, size_t size);
+	using Print::write;
+
+	operator bool() { return true; }
+
+  private:
+	int timedPeek();
+	unsigned long timeout_ms = 1000;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,51 @@
+/*
+	Print.h (host) - Base class of everything that prints, like the
+	Arduino core: a class that writes single bytes gets print() and
+	println() of text and numbers, formatted the same way as on the board.
+	The formatting charges Hal::Cost::print_digit per digit.
+
+	GNU GPL License
+ */
+
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+class Print {
+  public:
+	virtual ~Print(){}
+
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t* buffer, size_t size);
+	size_t write(const char* str);
+
+	size_t print(const char* str);
+	size_t print(char c);
+	size_t print(unsigned char n, int base = DEC);
+	size_t print(int n, int base = DEC);
+	size_t print(unsigned int n, int base = DEC);
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+
+	size_t println();
+	size_t println(const char* str);
+	size_t println(char c);
+	size_t println(unsigned char n, int base = DEC);
+	size_t println(int n, int base = DEC);
+	size_t println(unsigned int n, int base = DEC);
+	size_t println(long n, int base = DEC);
+	size_t println(unsigned long n, int base = DEC);
+	size_t println(double n, int digits = 2);
+
+  private:
+	size_t printNumber(unsigned long n, int base);
+};
+
+#endif
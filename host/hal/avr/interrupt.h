@@ -0,0 +1,41 @@
+/*
+	avr/interrupt.h (host) - Interrupt vectors and global interrupt control
+	for the host build.
+
+	ISR(vector) defines an ordinary C function with the vector's name. The
+	vectors are declared weak here, so the simulator only dispatches the
+	ones that a library or sketch actually defines.
+
+	GNU GPL License
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include "avr/io.h"
+
+#define ISR(vector, ...) extern "C" void vector(void)
+
+extern "C" {
+	void INT0_vect(void) __attribute__((weak));
+	void INT1_vect(void) __attribute__((weak));
+	void PCINT0_vect(void) __attribute__((weak));
+	void PCINT1_vect(void) __attribute__((weak));
+	void PCINT2_vect(void) __attribute__((weak));
+	void TIMER2_COMPA_vect(void) __attribute__((weak));
+	void TIMER2_COMPB_vect(void) __attribute__((weak));
+	void TIMER2_OVF_vect(void) __attribute__((weak));
+	void TIMER1_CAPT_vect(void) __attribute__((weak));
+	void TIMER1_COMPA_vect(void) __attribute__((weak));
+	void TIMER1_COMPB_vect(void) __attribute__((weak));
+	void TIMER1_OVF_vect(void) __attribute__((weak));
+	void ADC_vect(void) __attribute__((weak));
+
+	void hal_sei(void);
+	void hal_cli(void);
+}
+
+#define sei() hal_sei()
+#define cli() hal_cli()
+
+#endif
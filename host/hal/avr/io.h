@@ -0,0 +1,200 @@
+/*
+	avr/io.h (host) - ATmega328P registers and bit names for the host build.
+
+	The registers are plain variables owned by the simulator (see "HalSim.h").
+	Only the registers that the libraries touch are declared. The ports and
+	the 8 bit compare registers, which the step functions write on every
+	step, charge their accesses to the clock (see "IoRegister").
+
+	GNU GPL License
+ */
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+// The MCU that is emulated, for code that depends on its pin map
+#ifndef __AVR_ATmega328P__
+#define __AVR_ATmega328P__
+#endif
+
+// Interrupt flag registers. Writing a one to a flag clears it, like on the AVR,
+// so "TIFR1 = _BV(OCF1A);" clears a pending compare match. The simulator sets
+// the flags through "value".
+struct FlagRegister{
+	volatile uint8_t value;
+
+	operator uint8_t() const { return value; }
+	FlagRegister& operator=(const uint8_t& written) { value &= ~written; return *this; }
+	FlagRegister& operator|=(const uint8_t& bits) { const uint8_t written = value | bits; value &= ~written; return *this; }
+	FlagRegister& operator&=(const uint8_t& bits) { const uint8_t written = value & bits; value &= ~written; return *this; }
+};
+
+// Port and compare registers written by the libraries on every (micro)step. Every read or write charges
+// Hal::cost().io_access cycles to the clock and a "|=" or "&=" charges io_bit, the rest of the code is free
+// (see "HalSim.h"). The simulator uses "value".
+struct IoRegister{
+	volatile uint8_t value;
+
+	operator uint8_t() const;
+	IoRegister& operator=(const uint8_t& written);
+	IoRegister& operator|=(const int& bits);
+	IoRegister& operator&=(const int& bits);	// int: "~mask" is one, as on the board
+};
+
+// Pointer to an IoRegister, what the libraries keep as IO_REGISTER_PTR (a "volatile uint8_t*" on the board).
+// Every access through it also charges Hal::cost().io_pointer for loading the pointer.
+class IoRegisterPtr{
+  public:
+	IoRegisterPtr(IoRegister* reg = 0) : reg(reg) {}
+	IoRegister& operator*() const;
+	explicit operator bool() const { return reg != 0; }
+	friend bool operator==(const IoRegisterPtr& a, const IoRegisterPtr& b) { return a.reg == b.reg; }
+	friend bool operator!=(const IoRegisterPtr& a, const IoRegisterPtr& b) { return a.reg != b.reg; }
+  private:
+	IoRegister* reg;
+};
+
+#define IO_REGISTER IoRegister
+#define IO_REGISTER_PTR IoRegisterPtr
+
+// Status register (only the global interrupt flag is emulated)
+extern volatile uint8_t SREG;
+#define SREG_I 7
+
+// Digital I/O ports
+extern volatile uint8_t PINB, DDRB, PINC, DDRC, PIND, DDRD;
+extern IoRegister PORTB, PORTC, PORTD;
+
+// External interrupts
+extern volatile uint8_t EICRA, EIMSK;
+extern FlagRegister EIFR;
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define INT0 0
+#define INT1 1
+#define INTF0 0
+#define INTF1 1
+
+// Pin change interrupts
+extern volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+extern FlagRegister PCIFR;
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCIF0 0
+#define PCIF1 1
+#define PCIF2 2
+
+// Timer/Counter 0 (8 bit, used by millis()/micros() and PWM on pins 5, 6)
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, TIMSK0;
+extern IoRegister OCR0A, OCR0B;
+extern FlagRegister TIFR0;
+// Timer/Counter 1 (16 bit, PWM on pins 9, 10)
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+extern FlagRegister TIFR1;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+// Timer/Counter 2 (8 bit, PWM on pins 3, 11)
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, TIMSK2;
+extern IoRegister OCR2A, OCR2B;
+extern FlagRegister TIFR2;
+
+#define COM0A1 7
+#define COM0A0 6
+#define COM0B1 5
+#define COM0B0 4
+#define WGM01 1
+#define WGM00 0
+#define WGM02 3
+#define CS02 2
+#define CS01 1
+#define CS00 0
+
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+
+#define COM2A1 7
+#define COM2A0 6
+#define COM2B1 5
+#define COM2B0 4
+#define WGM21 1
+#define WGM20 0
+#define WGM22 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+
+#define ICIE1  5
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1  0
+#define ICF1   5
+#define OCF1B  2
+#define OCF1A  1
+#define TOV1   0
+
+#define OCIE0B 2
+#define OCIE0A 1
+#define TOIE0  0
+#define OCF0B  2
+#define OCF0A  1
+#define TOV0   0
+#define OCIE2B 2
+#define OCIE2A 1
+#define TOIE2  0
+#define OCF2B  2
+#define OCF2A  1
+#define TOV2   0
+
+// Analog to digital converter
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0;
+extern volatile uint16_t ADC;
+#define ADCL (*(volatile uint8_t*)&ADC)
+#define ADCH (*((volatile uint8_t*)&ADC + 1))
+#define ADCW ADC
+
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define MUX3  3
+#define MUX2  2
+#define MUX1  1
+#define MUX0  0
+#define ADEN  7
+#define ADSC  6
+#define ADATE 5
+#define ADIF  4
+#define ADIE  3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define ACME  6
+#define ADTS2 2
+#define ADTS1 1
+#define ADTS0 0
+
+// USART 0
+extern volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0;
+extern volatile uint16_t UBRR0;
+#define RXC0  7
+#define TXC0  6
+#define UDRE0 5
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+
+#endif
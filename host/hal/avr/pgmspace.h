@@ -0,0 +1,19 @@
+/*
+	avr/pgmspace.h (host) - Flash (PROGMEM) access for the host build.
+	There is a single address space on the host, so this is a plain read.
+
+	GNU GPL License
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr)  (*(const uint8_t*)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+
+#endif
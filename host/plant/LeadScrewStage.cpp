@@ -0,0 +1,202 @@
+/*
+	LeadScrewStage.cpp (host) - Simulated linear actuator, see LeadScrewStage.h
+
+
+	GNU GPL License
+ */
+
+#include "LeadScrewStage.h"
+#include <math.h>
+
+
+static const double TWO_PI = 6.283185307179586;
+static const double DT = Plant::STEP_CYCLES / 16e6;
+
+
+Plant::StageSettings Plant::defaultSettings(){
+
+	Plant::StageSettings settings;
+
+	static const uint8_t pins[4] = {7, 4, 6, 5};
+	for (uint8_t i = 0; i < 4; i++){
+		settings.pins[i] = pins[i];
+	}
+	settings.driver          = Plant::DRIVER_SIGNED_MAGNITUDE;
+	settings.encoder_pins[0] = 2;
+	settings.encoder_pins[1] = 3;
+	settings.cpr             = 4000;
+	settings.steps_per_rev   = 200;
+	settings.lead_mm         = 12;
+
+	settings.holding_torque    = 0.5;
+	settings.corner_rps        = 5;
+	settings.rotor_inertia     = 1.2e-5;
+	settings.carriage_mass     = 0.5;
+	settings.damping           = 2e-4;
+	settings.friction_torque   = 0.02;
+	settings.carriage_friction = 5;
+	settings.load_force        = 0;
+	settings.backlash_mm       = 0.02;
+	settings.travel_mm         = 100;
+
+	return settings;
+}
+
+
+Plant::LeadScrewStage::LeadScrewStage(const Plant::StageSettings& settings)
+	: settings(settings), angle(0), velocity(0), carriage(0), field_turns(0), last_field(0), energized(false),
+	  encoder_target(0), encoder_out(0), encoder_state(0) {
+
+	// Carry on from the levels the encoder pins are at, so that the count doesn't jump
+	static const uint8_t gray_to_state[4] = { 0, 1, 3, 2 };
+	uint8_t levels = (Hal::pinLevel(settings.encoder_pins[0]) ? 2 : 0) | (Hal::pinLevel(settings.encoder_pins[1]) ? 1 : 0);
+	encoder_state = gray_to_state[levels];
+	next = Hal::cycles() + Plant::STEP_CYCLES;
+}
+
+
+uint64_t Plant::LeadScrewStage::nextEvent(){
+	return next;
+}
+
+
+// Current in the coils, -1 .. 1, from the levels and PWM duties of the driver pins
+void Plant::LeadScrewStage::readCoils(double& current_1, double& current_2) const{
+
+	double level[4];
+	for (uint8_t i = 0; i < 4; i++){
+		uint8_t duty = Hal::pwmDuty(settings.pins[i]);
+		level[i] = (duty > 0) ? duty / 255.0 : (Hal::pinLevel(settings.pins[i]) ? 1.0 : 0.0);
+	}
+
+	if (settings.driver == Plant::DRIVER_SIGNED_MAGNITUDE){
+		current_1 = (level[0] > 0.5 ? 1 : -1) * level[2];
+		current_2 = (level[1] > 0.5 ? 1 : -1) * level[3];
+	}
+	else {
+		// the field turns forward with coil 2 leading coil 1, see Stepper::sequence_4_wire
+		current_1 = level[2] - level[3];
+		current_2 = level[0] - level[1];
+	}
+}
+
+
+void Plant::LeadScrewStage::onEvent(const uint64_t& cycle){
+
+	next = cycle + Plant::STEP_CYCLES;
+
+	double current_1, current_2;
+	readCoils(current_1, current_2);
+	double current = sqrt(current_1*current_1 + current_2*current_2);
+
+	const double radius = settings.lead_mm / 1000.0 / TWO_PI; // m of travel per rad
+	const double poles  = settings.steps_per_rev / 4.0;      // electrical turns per turn
+
+	// Direction of the field, unwrapped so that lost steps can be counted. No current: no field.
+	// When the motor is switched on, the rotor snaps to the closest pole, that is not a lost step.
+	if (current > 1e-6){
+		double field = atan2(current_1, current_2) / TWO_PI;
+		double change = field - (energized ? last_field : angle / TWO_PI * poles);
+		change -= floor(change + 0.5);
+		field_turns = (energized ? field_turns : angle / TWO_PI * poles) + change;
+		last_field = field;
+	}
+	energized = current > 1e-6;
+	double screw = angle / TWO_PI * settings.lead_mm;
+	double half_backlash = settings.backlash_mm / 2;
+
+	// Carriage: pressed against one side by the load, or only pushed along by the screw
+	bool pressed = fabs(settings.load_force) > settings.carriage_friction;
+	if (pressed){
+		carriage = screw + (settings.load_force > 0 ? half_backlash : -half_backlash);
+	}
+	else if (screw - carriage > half_backlash){
+		carriage = screw - half_backlash;
+	}
+	else if (carriage - screw > half_backlash){
+		carriage = screw + half_backlash;
+	}
+	bool engaged = pressed || fabs(screw - carriage) >= half_backlash - 1e-9;
+
+	double inertia  = settings.rotor_inertia + (engaged ? settings.carriage_mass * radius * radius : 0);
+	double friction = settings.friction_torque + (engaged ? settings.carriage_friction * radius : 0);
+	double load     = engaged ? settings.load_force * radius : 0;
+
+	double rps = fabs(velocity) / TWO_PI;
+	double motor = settings.holding_torque * current / (1 + rps / settings.corner_rps)
+	               * sin(TWO_PI * (field_turns - angle / TWO_PI * poles));
+	double drive = motor + load - settings.damping * velocity;
+
+	// Dry friction: holds the rotor while it is stopped, brakes it while it moves
+	if (velocity == 0 && fabs(drive) <= friction){
+		// stuck
+	}
+	else {
+		double direction = (velocity != 0) ? (velocity > 0 ? 1 : -1) : (drive > 0 ? 1 : -1);
+		double new_velocity = velocity + (drive - direction * friction) / inertia * DT;
+		velocity = (new_velocity * direction < 0) ? 0 : new_velocity;
+		angle += velocity * DT;
+	}
+
+	double end = settings.travel_mm / 2 / settings.lead_mm * TWO_PI;
+	if (fabs(angle) > end){
+		angle = (angle > 0) ? end : -end;
+		velocity = 0;
+	}
+
+	updateEncoder();
+}
+
+
+// Puts out the quadrature edges of the shaft position, one per step of the integration
+void Plant::LeadScrewStage::updateEncoder(){
+
+	static const uint8_t gray[4] = { 0, 1, 3, 2 };
+
+	encoder_target = static_cast<long>(floor(angle / TWO_PI * settings.cpr));
+	if (encoder_out == encoder_target){
+		return;
+	}
+
+	if (encoder_target > encoder_out){
+		encoder_out++;
+		encoder_state = (encoder_state + 1) & 3;
+	}
+	else {
+		encoder_out--;
+		encoder_state = (encoder_state + 3) & 3;
+	}
+	Hal::setInput(settings.encoder_pins[0], gray[encoder_state] & 2);
+	Hal::setInput(settings.encoder_pins[1], gray[encoder_state] & 1);
+}
+
+
+double Plant::LeadScrewStage::getShaft() const{
+	return angle / TWO_PI * settings.lead_mm;
+}
+
+
+double Plant::LeadScrewStage::getCarriage() const{
+	return carriage;
+}
+
+
+double Plant::LeadScrewStage::getSpeed() const{
+	return velocity / TWO_PI * settings.lead_mm;
+}
+
+
+long Plant::LeadScrewStage::getEncoderCounts() const{
+	return encoder_out;
+}
+
+
+long Plant::LeadScrewStage::getLostSteps() const{
+	double rotor_turns = angle / TWO_PI * settings.steps_per_rev / 4.0;
+	return static_cast<long>(floor((field_turns - rotor_turns) * 4 + 0.5));
+}
+
+
+void Plant::LeadScrewStage::setLoadForce(const double& load_force){
+	settings.load_force = load_force;
+}
@@ -0,0 +1,112 @@
+/*
+	LeadScrewStage.h (host) - Simulated linear actuator for the host build:
+	a 2-phase stepper motor turning a lead screw that moves a carriage, with
+	an incremental encoder on the motor shaft (same as the ET-100 setup, see
+	README). It is a Hal::Device, so the libraries drive it through the
+	emulated pins exactly as they drive the real motor driver, and its
+	encoder edges go through the real RotaryEncoder interrupts.
+
+	Motor:
+	The currents in the two coils are read from the pins of the motor driver
+	(see Driver) and give the direction of the magnetic field. The rotor is
+	pulled towards the field with "holding_torque * |I| * sin(error)", the
+	error being the electrical angle between field and rotor (one full step
+	is 90 electrical degrees). The torque falls off with speed as the back
+	EMF eats the supply voltage (see "corner_rps"). The rotor turns the
+	screw against its own inertia, the inertia of the carriage seen through
+	the screw, viscous damping, dry friction and an external force on the
+	carriage. Nothing forces the rotor to follow the field: when the motor
+	is asked for more torque than it has, it falls behind by whole steps and
+	those steps are lost (see "getLostSteps"), same as on the bench.
+
+	Carriage:
+	The carriage is moved by the screw through a backlash of "backlash_mm".
+	While the screw turns within the backlash the carriage stays where it
+	is, unless an external force larger than the friction presses it
+	against one side. The encoder is on the motor shaft, so it doesn't see
+	the backlash; "getCarriage" gives the real position of the carriage. At
+	either end of the travel the screw hits a hard stop.
+
+	The equations are integrated every STEP_CYCLES of the virtual clock
+	(semi-implicit Euler), which is short compared to the time the rotor
+	takes to swing around a step.
+
+
+	GNU GPL License
+ */
+
+#ifndef LEADSCREWSTAGE_H
+#define LEADSCREWSTAGE_H
+
+#include <stdint.h>
+#include "HalSim.h"
+
+namespace Plant{
+
+	// How the four pins, in the order given to LinActStepper::init, drive the coils
+	enum Driver{
+		DRIVER_SIGNED_MAGNITUDE, // Direction and PWM/enable per coil: {dir 1, dir 2, pwm 1, pwm 2}, e.g., the L298P shield
+		DRIVER_FULL_BRIDGE       // Two H-bridge inputs per coil: {coil 1 +, coil 1 -, coil 2 +, coil 2 -}
+	};
+
+	struct StageSettings{
+		uint8_t pins[4];
+		uint8_t driver;
+		uint8_t encoder_pins[2];
+		uint16_t cpr;              // Encoder's counts per revolution
+		uint16_t steps_per_rev;    // Full steps of the motor
+		double lead_mm;            // Lead of the screw, see LinActStepper::Settings
+
+		double holding_torque;     // N m at full current
+		double corner_rps;         // Speed (rev/s) at which the torque has fallen to half
+		double rotor_inertia;      // kg m^2
+		double carriage_mass;      // kg
+		double damping;            // N m per rad/s
+		double friction_torque;    // N m, dry friction of motor and screw
+		double carriage_friction;  // N, dry friction of the carriage on its guide
+		double load_force;         // N on the carriage, positive pushes it forward
+		double backlash_mm;
+		double travel_mm;          // The carriage starts in the middle, the screw stops dead at either end
+	};
+
+	static const uint32_t STEP_CYCLES = 80; // Integration step, 5 us
+
+	StageSettings defaultSettings(); // Close to the ET-100 with its NEMA 23 motor on the L298P shield
+
+
+	class LeadScrewStage : public Hal::Device{
+	  public:
+		explicit LeadScrewStage(const StageSettings& settings);
+
+		uint64_t nextEvent();
+		void onEvent(const uint64_t& cycle);
+
+		double getShaft() const;       // Position of the motor shaft in mm of travel of the screw
+		double getCarriage() const;    // Position of the carriage in mm
+		double getSpeed() const;       // mm/s of the screw
+		long getEncoderCounts() const; // Counts that the encoder has put out so far
+		long getLostSteps() const;     // Full steps that the rotor fell behind (or ahead of) the field
+
+		void setLoadForce(const double& load_force);
+
+	  private:
+		void readCoils(double& current_1, double& current_2) const;
+		void updateEncoder();
+
+		StageSettings settings;
+		uint64_t next;
+
+		double angle;       // Rotor, rad
+		double velocity;    // rad/s
+		double carriage;    // mm
+		double field_turns; // Electrical angle of the field, unwrapped, in turns
+		double last_field;  // Electrical angle of the last step, -0.5 .. 0.5 turns
+		bool energized;
+
+		long encoder_target; // Counts the shaft is at
+		long encoder_out;    // Counts already put out on the pins
+		uint8_t encoder_state;
+	};
+}
+
+#endif
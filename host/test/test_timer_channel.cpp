@@ -0,0 +1,106 @@
+/*
+	test_timer_channel.cpp - Checks that the moves on Timer1 channel A wait
+	for each other, on the host build: a group of LinActMultiAxis is moving
+	when a single actuator is moved with "LinActStepper::moveAsync" and when
+	"Stepper::setVelocity" is called (like the servo of LinActWithRotEnc
+	does), and every move has to finish with all of its steps. The steps are
+	counted on the STEP pins of three STEP/DIR drivers.
+
+	Returns 0 if every check passed.
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "LinActStepper.h"
+#include "LinActMultiAxis.h"
+
+
+static const StepDirDriver DRIVERS[3] = {
+	{ 8, 9, StepDirDriver::NO_PIN, 1, 2, 1 },
+	{ 10, 11, StepDirDriver::NO_PIN, 1, 2, 1 },
+	{ 12, 13, StepDirDriver::NO_PIN, 1, 2, 1 },
+};
+static const double TIMEOUT_S = 10.0;
+
+static int failures = 0;
+
+
+static void check(const bool& passed, const char* what){
+	printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+	if (!passed) failures++;
+}
+
+
+// Rising edges of the STEP pin of each driver since the trace was cleared
+static void countSteps(long steps[3]){
+	const std::vector<Hal::PinEvent>& trace = Hal::pinTrace();
+	for (uint8_t i = 0; i < 3; i++){
+		steps[i] = 0;
+		for (size_t k = 0; k < trace.size(); k++){
+			if (trace[k].pin == DRIVERS[i].step_pin && trace[k].level) steps[i]++;
+		}
+	}
+}
+
+
+int main(){
+
+	Hal::reset();
+	LinActStepper::Obj actuators[3] = {
+		LinActStepper::init(DRIVERS[0], 200, 12),
+		LinActStepper::init(DRIVERS[1], 200, 12),
+		LinActStepper::init(DRIVERS[2], 200, 12),
+	};
+	for (uint8_t i = 0; i < 3; i++){
+		LinActStepper::setSpeed(actuators[i], 300); // 1000 steps/s
+	}
+	LinActStepper::Obj* const axes[2] = { &actuators[0], &actuators[1] };
+	LinActMultiAxis::Obj my_group = LinActMultiAxis::init(axes, 2);
+	long steps[3];
+
+	// A single actuator moved while the group moves waits for the group, then both are done
+	Hal::tracePins(true);
+	Hal::clearPinTrace();
+	const int32_t group_steps[2] = { 400, 300 };
+	LinActMultiAxis::moveAsync(my_group, group_steps);
+	Hal::run(F_CPU / 10);
+	LinActStepper::moveAsync(actuators[2], static_cast<int32_t>(250));
+	check(!LinActMultiAxis::isMoving(my_group), "moveAsync of an actuator waited for the group");
+	bool done = Hal::runUntil([&]{ return !LinActStepper::isMoving(actuators[2]); },
+	                          static_cast<uint64_t>(TIMEOUT_S * F_CPU), 1600);
+	check(done, "the move of the actuator finished");
+	countSteps(steps);
+	check(steps[0] == 400 && steps[1] == 300, "the group took all of its steps");
+	check(steps[2] == 250, "the actuator took all of its steps");
+
+	// The speed of a stepper set while the group moves doesn't take the timer
+	Hal::clearPinTrace();
+	LinActMultiAxis::moveAsync(my_group, group_steps);
+	Hal::run(F_CPU / 10);
+	check(!actuators[2].stepper_obj.setVelocity(500), "setVelocity returns false while the group moves");
+	done = Hal::runUntil([&]{ return !LinActMultiAxis::isMoving(my_group); }, static_cast<uint64_t>(TIMEOUT_S * F_CPU), 1600);
+	check(done, "the group finished after setVelocity of another stepper");
+	countSteps(steps);
+	check(steps[0] == 400 && steps[1] == 300 && steps[2] == 0, "only the group took steps");
+
+	// Once the group is done the timer is free again
+	Hal::clearPinTrace();
+	check(actuators[2].stepper_obj.setVelocity(500), "setVelocity returns true once the group is done");
+	Hal::run(F_CPU / 10);
+	actuators[2].stepper_obj.setVelocity(0);
+	countSteps(steps);
+	check(steps[2] >= 49 && steps[2] <= 51, "setVelocity runs once the group is done");
+
+	// A group started while an actuator moves waits for it
+	Hal::clearPinTrace();
+	LinActStepper::moveAsync(actuators[2], static_cast<int32_t>(250));
+	LinActMultiAxis::move(my_group, group_steps);
+	check(!LinActStepper::isMoving(actuators[2]), "the group waited for the actuator");
+	countSteps(steps);
+	check(steps[0] == 400 && steps[1] == 300 && steps[2] == 250, "both took all of their steps");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+/*
+	test_wirings.cpp - Checks the coil pins and the PWM duties of every
+	wiring of Stepper on the host build, step by step, against reference
+	tables that are worked out here and not taken from the library: the
+	sequences of the 2, 4 and 5 wire motors as in the description of
+	Stepper.cpp, and the microsteps of the 2 and 4 wire + PWM motors from
+	sin/cos of the electrical angle, at 2 to 32 micro steps.
+
+	Each wiring takes two and a half cycles forward and then as many back
+	with "stepOnce", so the phase wraps both ways. The coil pins are checked
+	with the port writes and with digitalWrite() (pins on three ports), the
+	steps of "FixedStepper" (set up with "init", and attached to a Stepper)
+	against the same tables and step by step against the ones of Stepper,
+	and "off" after "init" has to clear the pins. A STEP/DIR driver has
+	to give one pulse per step, DIR set to the direction, and EN back low on
+	the first step after "off".
+
+	Returns 0 if every check passed.
+
+	GNU GPL License
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "HalSim.h"
+#include "Arduino.h"
+#include "Stepper.h"
+#include "FixedStepper.h"
+
+
+static const uint8_t PHASES = 4 * MICROSTEP_RESOLUTION; // of the microstep table, one cycle of the coil currents
+
+// Levels of C0 .. C4 for each step of the sequences, bit 0 is C0 (the first pin)
+static const uint8_t SEQUENCE_2_WIRE[4] = { 0b10, 0b11, 0b01, 0b00 };
+static const uint8_t SEQUENCE_4_WIRE[4] = { 0b0101, 0b0110, 0b1010, 0b1001 };
+static const uint8_t SEQUENCE_5_WIRE[10] = {
+	0b10110, 0b10010, 0b11010, 0b01010, 0b01011,
+	0b01001, 0b01101, 0b00101, 0b10101, 0b10100
+};
+
+static int failures = 0;
+
+
+static void check(const bool& passed, const char* what){
+	printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+	if (!passed) failures++;
+}
+
+
+// What the pins of a motor are after a step
+struct PinState{
+	uint8_t levels; // bit i: pin i of the motor
+	uint8_t duty_1; // PWM pins, 0 .. 255
+	uint8_t duty_2;
+
+	bool operator==(const PinState& other) const{
+		return levels == other.levels && duty_1 == other.duty_1 && duty_2 == other.duty_2;
+	}
+};
+
+
+// Duty of a PWM pin, through the compare register or analogWrite (which sets 0 and 255 as plain levels)
+static uint8_t dutyOf(const uint8_t& pin){
+	uint8_t duty = Hal::pwmDuty(pin);
+	return (duty == 0 && Hal::pinLevel(pin)) ? 255 : duty;
+}
+
+
+static PinState readPins(const uint8_t* pins, const uint8_t& num_pins, const uint8_t* pwm_pins){
+	PinState state = { 0, 0, 0 };
+	for (uint8_t i = 0; i < num_pins; i++){
+		if (Hal::pinLevel(pins[i])) state.levels |= 1 << i;
+	}
+	if (pwm_pins != 0){
+		state.duty_1 = dutyOf(pwm_pins[0]);
+		state.duty_2 = dutyOf(pwm_pins[1]);
+	}
+	return state;
+}
+
+
+// Microstep at phase p of the table: |sin| and |cos| of 90 deg * p / MICROSTEP_RESOLUTION as duties, and
+// which of the two currents are positive
+static PinState microStep(const uint8_t& phase, const uint8_t& num_pins){
+	const double angle = M_PI / 2 * phase / MICROSTEP_RESOLUTION;
+	const double current_1 = sin(angle), current_2 = cos(angle);
+	const bool positive_1 = current_1 > 1e-9, positive_2 = current_2 > 1e-9;
+
+	PinState state;
+	state.duty_1 = static_cast<uint8_t>(fabs(current_1) * 255 + 0.5);
+	state.duty_2 = static_cast<uint8_t>(fabs(current_2) * 255 + 0.5);
+	if (num_pins == 2){
+		// pin 1 gives the direction of coil 1, pin 2 the one of coil 2
+		state.levels = (positive_1 ? 0b01 : 0) | (positive_2 ? 0b10 : 0);
+	}
+	else {
+		// coil 1 across pins 1 and 2, coil 2 across pins 3 and 4
+		state.levels = (positive_1 ? 0b0001 : 0b0010) | (positive_2 ? 0b0100 : 0b1000);
+	}
+	return state;
+}
+
+
+// Steps "stepper" 2.5 cycles forward and as many back, checks every step against "expected" (of the phase
+// the step ends on), and returns what the pins were after each step
+static std::vector<PinState> walk(Stepper& stepper, const uint8_t* pins, const uint8_t& num_pins, const uint8_t* pwm_pins,
+                                  const uint8_t& cycle, const uint8_t& stride,
+                                  PinState (*expected)(const uint8_t& phase, const uint8_t& num_pins), const char* label){
+	std::vector<PinState> states;
+	const int num_steps = cycle / stride * 5 / 2;
+	int phase = 0, wrong = -1;
+
+	for (int k = 0; k < 2 * num_steps; k++){
+		const bool forward = (k < num_steps);
+		stepper.stepOnce(forward);
+		phase = (phase + (forward ? stride : cycle - stride)) % cycle;
+
+		PinState state = readPins(pins, num_pins, pwm_pins);
+		states.push_back(state);
+		if (wrong < 0 && !(state == expected(phase, num_pins))) wrong = k;
+	}
+
+	char what[80];
+	if (wrong >= 0){
+		const PinState& state = states[wrong];
+		printf("  step %d: pins %02x, duties %u %u\n", wrong, state.levels, state.duty_1, state.duty_2);
+	}
+	snprintf(what, sizeof(what), "%s, forward and back", label);
+	check(wrong < 0, what);
+	return states;
+}
+
+
+static PinState sequence2(const uint8_t& phase, const uint8_t&){ return PinState{ SEQUENCE_2_WIRE[phase], 0, 0 }; }
+static PinState sequence4(const uint8_t& phase, const uint8_t&){ return PinState{ SEQUENCE_4_WIRE[phase], 0, 0 }; }
+static PinState sequence5(const uint8_t& phase, const uint8_t&){ return PinState{ SEQUENCE_5_WIRE[phase], 0, 0 }; }
+
+
+// Two-wire + PWM microsteps on the pins of the EM_RRL actuator: Stepper, then FixedStepper the same way
+template<uint8_t MICRO_STEPS>
+static void checkFixed(){
+	static const uint8_t pins[2] = { 7, 4 };
+	static const uint8_t pwm_pins[2] = { 6, 5 };
+	char label[80];
+
+	Hal::reset();
+	Stepper generic(200, true, MICRO_STEPS, pins[0], pins[1], pwm_pins[0], pwm_pins[1]);
+	snprintf(label, sizeof(label), "2 wire + PWM, %u micro steps", MICRO_STEPS);
+	std::vector<PinState> expected = walk(generic, pins, 2, pwm_pins, PHASES, MICROSTEP_RESOLUTION / MICRO_STEPS, microStep, label);
+
+	Hal::reset();
+	Stepper fixed;
+	FixedStepper<7, 4, 6, 5, MICRO_STEPS>::init(fixed, 200);
+	snprintf(label, sizeof(label), "FixedStepper<7,4,6,5,%u>::init", MICRO_STEPS);
+	std::vector<PinState> states = walk(fixed, pins, 2, pwm_pins, PHASES, MICROSTEP_RESOLUTION / MICRO_STEPS, microStep, label);
+	snprintf(label, sizeof(label), "FixedStepper<7,4,6,5,%u>::init same as Stepper", MICRO_STEPS);
+	check(states == expected, label);
+	fixed.off();
+	snprintf(label, sizeof(label), "FixedStepper<7,4,6,5,%u>::init, off clears the PWM duties", MICRO_STEPS);
+	check(dutyOf(pwm_pins[0]) == 0 && dutyOf(pwm_pins[1]) == 0, label);
+
+	Hal::reset();
+	Stepper attached(200, true, MICRO_STEPS, pins[0], pins[1], pwm_pins[0], pwm_pins[1]);
+	FixedStepper<7, 4, 6, 5, MICRO_STEPS>::attach(attached);
+	snprintf(label, sizeof(label), "FixedStepper<7,4,6,5,%u>::attach", MICRO_STEPS);
+	states = walk(attached, pins, 2, pwm_pins, PHASES, MICROSTEP_RESOLUTION / MICRO_STEPS, microStep, label);
+	snprintf(label, sizeof(label), "FixedStepper<7,4,6,5,%u>::attach same as Stepper", MICRO_STEPS);
+	check(states == expected, label);
+}
+
+
+// Four-wire + PWM microsteps, PWM on Timer2
+static void checkFourWirePwm(const uint8_t& micro_steps){
+	static const uint8_t pins[4] = { 7, 4, 8, 12 };
+	static const uint8_t pwm_pins[2] = { 11, 3 };
+	char label[80];
+
+	Hal::reset();
+	Stepper stepper(200, true, micro_steps, pins[0], pins[1], pins[2], pins[3], pwm_pins[0], pwm_pins[1]);
+	snprintf(label, sizeof(label), "4 wire + PWM, %u micro steps", micro_steps);
+	walk(stepper, pins, 4, pwm_pins, PHASES, MICROSTEP_RESOLUTION / micro_steps, microStep, label);
+}
+
+
+static void checkStepDir(){
+	static const StepDirDriver driver = { 8, 9, 10, 16, 2, 1 };
+
+	Hal::reset();
+	Stepper stepper(200, driver);
+	Hal::tracePins(true);
+
+	bool right = true;
+	for (int k = 0; k < 20; k++){
+		const bool forward = (k < 10);
+		Hal::clearPinTrace();
+		stepper.stepOnce(forward);
+
+		int pulses = 0;
+		const std::vector<Hal::PinEvent>& trace = Hal::pinTrace();
+		for (size_t i = 0; i < trace.size(); i++){
+			if (trace[i].pin == driver.step_pin && trace[i].level) pulses++;
+		}
+		right = right && pulses == 1 && !Hal::pinLevel(driver.step_pin) && Hal::pinLevel(driver.dir_pin) == forward;
+	}
+	check(right, "STEP/DIR: one pulse per step, DIR is the direction");
+
+	stepper.off();
+	const bool off = Hal::pinLevel(driver.enable_pin);
+	stepper.stepOnce(true);
+	check(off && !Hal::pinLevel(driver.enable_pin), "STEP/DIR: off sets EN, the next step clears it");
+	Hal::tracePins(false);
+}
+
+
+int main(){
+
+	// Full steps: the coils on the ports, and with digitalWrite() when the pins are on three ports
+	{
+		static const uint8_t pins[2] = { 7, 4 };
+		Hal::reset();
+		Stepper stepper(200, pins[0], pins[1]);
+		walk(stepper, pins, 2, 0, 4, 1, sequence2, "2 wire");
+	}
+	{
+		static const uint8_t pins[4] = { 7, 4, 6, 5 };
+		Hal::reset();
+		Stepper stepper(200, pins[0], pins[1], pins[2], pins[3]);
+		walk(stepper, pins, 4, 0, 4, 1, sequence4, "4 wire");
+
+		Hal::reset();
+		Stepper fixed;
+		FixedStepper<7, 4, 6, 5, 1>::init(fixed, 200);
+		walk(fixed, pins, 4, 0, 4, 1, sequence4, "FixedStepper<7,4,6,5,1>::init");
+		fixed.off();
+		check(readPins(pins, 4, 0).levels == 0, "FixedStepper<7,4,6,5,1>::init, off clears the coil pins");
+	}
+	{
+		static const uint8_t pins[4] = { 2, 8, 14, 13 };
+		Hal::reset();
+		Stepper stepper(200, pins[0], pins[1], pins[2], pins[3]);
+		walk(stepper, pins, 4, 0, 4, 1, sequence4, "4 wire on ports B, C and D (digitalWrite)");
+	}
+	{
+		static const uint8_t pins[5] = { 2, 3, 4, 5, 6 };
+		Hal::reset();
+		Stepper stepper(200, pins[0], pins[1], pins[2], pins[3], pins[4]);
+		walk(stepper, pins, 5, 0, 10, 1, sequence5, "5 wire");
+	}
+
+	// Microsteps
+	checkFixed<2>();
+	checkFixed<4>();
+	checkFixed<8>();
+	checkFixed<16>();
+	checkFixed<32>();
+	for (uint8_t micro_steps = 2; micro_steps <= 32; micro_steps *= 2){
+		checkFourWirePwm(micro_steps);
+	}
+
+	checkStepDir();
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/*
+	AnalogFilter.h - Library that filters and decimates the samples of the
+	ADC with integer math.
+
+	GNU GPL License
+ */
+
+#include "AnalogFilter.h"
+
+
+namespace ns_flt = Sensor::Analog::Filter;
+
+
+static ns_flt::Obj make(const uint8_t& type, const uint16_t& decimation, const uint8_t& extra_bits, const uint8_t& param){
+	ns_flt::Obj my_filter;
+	my_filter.settings.type = type;
+	my_filter.settings.decimation = (decimation == 0) ? 1 : decimation;
+	my_filter.settings.extra_bits = extra_bits;
+	my_filter.settings.param = param;
+	ns_flt::reset(my_filter);
+	return my_filter;
+}
+
+
+ns_flt::Obj ns_flt::none(){
+	return make(ns_flt::NONE, 1, 0, 0);
+}
+
+
+ns_flt::Obj ns_flt::oversample(const uint8_t& extra_bits){
+	uint8_t bits = (extra_bits < 1) ? 1 : ((extra_bits > ns_flt::MAX_EXTRA_BITS) ? ns_flt::MAX_EXTRA_BITS : extra_bits);
+	return make(ns_flt::OVERSAMPLE, 1 << (2 * bits), bits, bits);
+}
+
+
+ns_flt::Obj ns_flt::movingAverage(const uint8_t& window_bits, const uint16_t& decimation){
+	uint8_t bits = (window_bits > ns_flt::MAX_WINDOW_BITS) ? ns_flt::MAX_WINDOW_BITS : window_bits;
+	return make(ns_flt::MOVING_AVERAGE, decimation, bits, bits);
+}
+
+
+ns_flt::Obj ns_flt::lowPass(const uint8_t& shift, const uint16_t& decimation){
+	uint8_t bits = (shift < 1) ? 1 : ((shift > ns_flt::MAX_SHIFT) ? ns_flt::MAX_SHIFT : shift);
+	uint8_t extra_bits = (bits > ns_flt::MAX_EXTRA_BITS) ? ns_flt::MAX_EXTRA_BITS : bits;
+	return make(ns_flt::LOW_PASS, decimation, extra_bits, bits);
+}
+
+
+void ns_flt::reset(Obj& my_filter){
+	my_filter.state.sum = 0;
+	my_filter.state.count = 0;
+	my_filter.state.index = 0;
+	my_filter.state.primed = false;
+	for (uint8_t i = 0; i < (1 << ns_flt::MAX_WINDOW_BITS); i++){
+		my_filter.state.window[i] = 0;
+	}
+}
+
+
+bool ns_flt::update(Obj& my_filter, const uint16_t& sample, uint16_t& output){
+	const Settings& settings = my_filter.settings;
+	State& state = my_filter.state;
+
+	switch (settings.type){
+		case ns_flt::OVERSAMPLE:
+			state.sum += sample;
+			if (++state.count < settings.decimation){
+				return false;
+			}
+			output = state.sum >> settings.extra_bits;
+			state.sum = 0;
+			state.count = 0;
+			return true;
+
+		case ns_flt::MOVING_AVERAGE: {
+			const uint8_t mask = (1 << settings.param) - 1;
+			state.sum += sample;
+			state.sum -= state.window[state.index];
+			state.window[state.index] = sample;
+			state.index = (state.index + 1) & mask;
+			if (state.index == 0){
+				state.primed = true;
+			}
+			if (++state.count < settings.decimation || !state.primed){ // No output till the window is full
+				return false;
+			}
+			output = state.sum;
+			state.count = 0;
+			return true;
+		}
+
+		case ns_flt::LOW_PASS:
+			// sum = y * 2^(shift + MAX_EXTRA_BITS). The bits below the LSB of the sample keep the filter from getting stuck
+			// up to 1 LSB away from the mean of the input (sum / 2^shift is rounded down every time)
+			if (!state.primed){ // Starts at the first sample instead of climbing up from 0
+				state.sum = static_cast<uint32_t>(sample) << (settings.param + ns_flt::MAX_EXTRA_BITS);
+				state.primed = true;
+			}
+			else {
+				state.sum -= state.sum >> settings.param;
+				state.sum += static_cast<uint32_t>(sample) << ns_flt::MAX_EXTRA_BITS;
+			}
+			if (++state.count < settings.decimation){
+				return false;
+			}
+			{
+				const uint8_t drop = settings.param + ns_flt::MAX_EXTRA_BITS - settings.extra_bits;
+				output = (state.sum + (1UL << (drop - 1))) >> drop;
+			}
+			state.count = 0;
+			return true;
+
+		default:
+			output = sample;
+			return true;
+	}
+}
+
+
+uint16_t ns_flt::getDecimation(const Obj& my_filter){
+	return my_filter.settings.decimation;
+}
+
+
+uint8_t ns_flt::getExtraBits(const Obj& my_filter){
+	return my_filter.settings.extra_bits;
+}
@@ -0,0 +1,113 @@
+/*
+	AnalogFilter.h - Library that filters and decimates the samples of the
+	ADC on the arduino, with integer math, so that fewer samples of a
+	higher resolution go out over Serial.
+
+	Why:
+	The ADC gives 10 bits and some noise. Sending every raw sample and
+	filtering on the PC uses up the serial port for samples that are
+	thrown away later, and the PC can't get back the resolution that the
+	rounding to 10 bits lost. Averaging N samples on the arduino cuts the
+	noise by sqrt(N) and, as long as there is about 1 LSB of noise to dither
+	the input, gives bits below the LSB of the ADC.
+
+	Filters:
+	- OVERSAMPLE (oversample): 4^extra_bits samples are added up and the sum
+	  is shifted right by extra_bits, i.e., 10 + extra_bits bits per output
+	  (Atmel AVR121). The decimation is fixed at 4^extra_bits, every input
+	  counts once.
+	- MOVING_AVERAGE (movingAverage): the sum of the last 2^window_bits
+	  samples, 10 + window_bits bits, given out every "decimation" samples.
+	  It doesn't lag behind a step by more than the window, and it removes a
+	  frequency (e.g., 50 Hz) fully when the window is one period of it.
+	- LOW_PASS (lowPass): first order IIR low-pass,
+	  y += (x - y) / 2^shift, kept with shift + MAX_EXTRA_BITS fractional
+	  bits (10 + up to MAX_EXTRA_BITS bits given out), every "decimation"
+	  samples. Cutoff at
+	  about sample rate / (2 pi 2^shift), the noise goes down by about
+	  sqrt(2^(shift+1)). Pick "decimation" so that the output rate is at least
+	  twice the cutoff, else the noise above the output rate folds back.
+	- NONE: every sample as it is (10 bits).
+
+	The output is an unsigned 16 bit value in units of 1 / 2^getExtraBits
+	of an LSB of the ADC, e.g., 0-4095 for 2 extra bits. Divide by
+	2^getExtraBits on the PC to get back to the scale of analogRead.
+
+	Where:
+	"update" takes one sample and returns true when an output is ready. It
+	is a few additions and shifts, no multiplication or division, so it can
+	run in an interrupt (AnalogSampler runs it in its ADC interrupt, with
+	the other interrupts enabled, see AnalogSampler.h).
+	Only the decimated samples then go into the ring buffer, with the time
+	and position of the last of the samples that went into them.
+
+
+	About Code:
+	Similar style as in RotaryEncoder.h. An Obj holds the settings of the
+	filter and its state (the sums, the window), get one from "oversample",
+	"movingAverage" or "lowPass" and pass it to "update".
+
+
+	GNU GPL License
+ */
+
+
+#include "Arduino.h"
+
+
+#ifndef ANALOGFILTER_H
+#define ANALOGFILTER_H
+
+namespace Sensor{
+	namespace Analog{
+		namespace Filter{
+
+			static const uint8_t NONE = 0;
+			static const uint8_t OVERSAMPLE = 1;
+			static const uint8_t MOVING_AVERAGE = 2;
+			static const uint8_t LOW_PASS = 3;
+
+			static const uint8_t MAX_EXTRA_BITS = 6; // 16 bits of output
+			static const uint8_t MAX_WINDOW_BITS = 4; // Window of 16 samples
+			static const uint8_t MAX_SHIFT = 8; // Of the low-pass
+
+			struct Settings {
+				uint8_t type;
+				uint16_t decimation; // Num of samples per output
+				uint8_t extra_bits;  // Output bits above the 10 of the ADC
+				uint8_t param; // window_bits or shift
+			};
+
+			struct State {
+				uint32_t sum; // Of the samples so far (OVERSAMPLE), of the window (MOVING_AVERAGE) or the output << (shift + MAX_EXTRA_BITS) (LOW_PASS)
+				uint16_t count; // Samples since the last output
+				uint8_t index; // Oldest sample of the window
+				bool primed; // LOW_PASS: started at the first sample, MOVING_AVERAGE: window filled once
+				uint16_t window[1 << MAX_WINDOW_BITS];
+			};
+
+			typedef struct MyObj{
+				Settings settings;
+				State state;
+			} Obj;
+
+			Obj none(); // Gives every sample as it is
+			Obj oversample(const uint8_t& extra_bits); // 1 to MAX_EXTRA_BITS, 4^extra_bits samples per output
+			Obj movingAverage(const uint8_t& window_bits, const uint16_t& decimation); // Window of 2^window_bits samples
+			Obj lowPass(const uint8_t& shift, const uint16_t& decimation); // shift 1 to MAX_SHIFT
+
+			// Takes a sample (0-1023), true when "output" has a new value (see "getExtraBits" for its scale)
+			bool update(Obj& my_filter, const uint16_t& sample, uint16_t& output);
+			void reset(Obj& my_filter); // Forgets the samples so far, the settings stay
+
+			uint16_t getDecimation(const Obj& my_filter); // Num of samples per output
+			uint8_t getExtraBits(const Obj& my_filter);   // Output bits above the 10 of the ADC
+		}
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace AnalogFilter = Sensor::Analog::Filter;
+
+#endif
@@ -0,0 +1,214 @@
+/*
+	AnalogSampler.h - Library that samples an analog pin at a fixed rate in
+	the background, into a ring buffer.
+
+	GNU GPL License
+ */
+
+#include "AnalogSampler.h"
+
+
+namespace ns_smp = Sensor::Analog::Sampler;
+
+static const uint8_t MASK = ns_smp::BUFFER_SIZE - 1;
+
+static const uint8_t ADC_PRESCALER_128 = (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0); // 125 kHz, same as analogRead
+static const uint8_t ADC_PRESCALER_64  = (1 << ADPS2) | (1 << ADPS1);                // 250 kHz
+static const uint32_t ADC_FAST_RATE = 5000; // Hz, above this the ADC runs at 250 kHz
+
+
+// I'm creating "static" because I cannot pass args to ISR. The ring buffer: samples from "tail" to "head" are
+// waiting to be read. Only the ISR writes "head" and the samples, only "read" writes "tail".
+static volatile uint32_t times[ns_smp::BUFFER_SIZE];
+static volatile long positions[ns_smp::BUFFER_SIZE];
+static volatile uint16_t values[ns_smp::BUFFER_SIZE];
+static volatile uint8_t head = 0;
+static volatile uint8_t tail = 0;
+static volatile uint16_t overruns = 0;
+
+static RotaryEncoder::Obj* volatile encoder = 0;
+static AnalogFilter::Obj* volatile filter = 0;
+static bool timer_triggered = false;
+static uint16_t skip = 0; // Free running only: conversions dropped between two kept ones
+static volatile uint16_t countdown = 0;
+static double rate = 0;
+
+
+void ns_smp::start(const uint8_t& pin, const uint32_t& sample_rate, RotaryEncoder::Obj* my_rotary,
+                   AnalogFilter::Obj* my_filter){
+	ns_smp::stop();
+
+	uint8_t sreg = SREG;
+	cli();
+
+	head = 0;
+	tail = 0;
+	overruns = 0;
+	encoder = my_rotary;
+	filter = my_filter;
+	if (my_filter != 0){
+		AnalogFilter::reset(*my_filter);
+	}
+
+	// Same reference (AVcc) and channel numbers as analogRead, the digital input of the pin is turned off
+	const uint8_t channel = (pin >= 14) ? pin - 14 : pin;
+	ADMUX = (1 << REFS0) | (channel & 0x07);
+	DIDR0 |= (1 << (channel & 0x07));
+
+	uint32_t clamped = (sample_rate < ns_smp::MIN_RATE) ? ns_smp::MIN_RATE : ((sample_rate > ns_smp::MAX_RATE) ? ns_smp::MAX_RATE : sample_rate);
+
+	// Timer1 is taken while StepTimer runs (its setup would be gone), the rate is then kept by dropping conversions
+	const bool timer_taken = StepTimer::isRunning(StepTimer::CHANNEL_A) || StepTimer::isRunning(StepTimer::CHANNEL_B);
+
+	timer_triggered = (sample_rate != ns_smp::FREE_RUNNING) && !timer_taken;
+	skip = 0;
+	if (!timer_triggered){
+		uint32_t prescaler = 128;
+		uint8_t adc_prescaler = ADC_PRESCALER_128;
+		if (sample_rate != ns_smp::FREE_RUNNING){
+			if (clamped > ADC_FAST_RATE){
+				prescaler = 64;
+				adc_prescaler = ADC_PRESCALER_64;
+			}
+			uint32_t conversion_rate = F_CPU / prescaler / 13;
+			uint32_t keep = (conversion_rate + clamped / 2) / clamped; // Every "keep"th conversion
+			skip = (keep > 1) ? keep - 1 : 0;
+		}
+		countdown = skip;
+
+		ADCSRB = 0; // Auto trigger source: free running
+		ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | (1 << ADSC) | adc_prescaler;
+		rate = F_CPU / static_cast<double>(prescaler) / 13 / (skip + 1);
+	}
+	else {
+
+		// Timer1 in CTC mode: counts from 0 to OCR1A. Prescaler of 8, or 64 for the rates that need more than 16 bits.
+		uint32_t prescaler = 8;
+		uint8_t clock_select = (1 << CS11);
+		uint32_t ticks = (F_CPU / 8 + clamped / 2) / clamped;
+		if (ticks > 0x10000){
+			prescaler = 64;
+			clock_select = (1 << CS11) | (1 << CS10);
+			ticks = (F_CPU / 64 + clamped / 2) / clamped;
+		}
+
+		TCCR1B = 0;
+		TCCR1A = 0;
+		TIMSK1 = 0;
+		TCNT1 = 0;
+		OCR1A = ticks - 1;
+		OCR1B = 0; // Compare match B when the counter starts over, it triggers the conversion
+		TIFR1 = (1 << OCF1B);
+
+		ADCSRB = (1 << ADTS2) | (1 << ADTS0); // Auto trigger source: Timer1 compare match B
+		ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | ((clamped > ADC_FAST_RATE) ? ADC_PRESCALER_64 : ADC_PRESCALER_128);
+		TCCR1B = (1 << WGM12) | clock_select;
+		rate = F_CPU / static_cast<double>(prescaler) / ticks;
+	}
+	if (my_filter != 0){
+		rate /= AnalogFilter::getDecimation(*my_filter);
+	}
+
+	SREG = sreg;
+}
+
+
+void ns_smp::stop(){
+	uint8_t sreg = SREG;
+	cli();
+
+	if (timer_triggered){
+		TCCR1B = 0;
+		timer_triggered = false;
+	}
+	// Back to what analogRead expects. A conversion that is still running is finished without an interrupt.
+	ADCSRA = (1 << ADEN) | ADC_PRESCALER_128;
+	ADCSRB = 0;
+	rate = 0;
+
+	SREG = sreg;
+}
+
+
+bool ns_smp::read(ns_smp::Sample& sample){
+	uint8_t first = tail;
+	if (first == head){
+		return false;
+	}
+
+	sample.time = times[first];
+	sample.position = positions[first];
+	sample.analog = values[first];
+	tail = (first + 1) & MASK; // Only now the ISR can use the slot again
+	return true;
+}
+
+
+uint8_t ns_smp::available(){
+	return (head - tail) & MASK;
+}
+
+
+uint16_t ns_smp::getOverruns(){
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t value = overruns;
+	SREG = sreg;
+	return value;
+}
+
+
+double ns_smp::getRate(){
+	return rate;
+}
+
+
+// A conversion is done. Only taking the value and restarting the trigger holds up the other interrupts, the
+// filter and the ring buffer run with them enabled, so the encoder doesn't miss edges in the meantime.
+ISR(ADC_vect){
+	uint16_t value = ADC;
+
+	// The next compare match only starts a conversion if the flag was cleared (there is no Timer1 interrupt to do it)
+	if (timer_triggered){
+		TIFR1 = (1 << OCF1B);
+	}
+
+	// Free running in place of Timer1: only every "skip + 1"th conversion is kept
+	if (countdown != 0){
+		countdown--;
+		return;
+	}
+	countdown = skip;
+
+	// This interrupt must not run again before it is over (it would change the filter and "head" under itself), so it
+	// is masked till then. ADIF is written as 0, writing it as 1 would clear a conversion that is already done.
+	ADCSRA &= ~((1 << ADIE) | (1 << ADIF));
+	sei();
+
+	// Only the outputs of the filter go on, the conversions in between just add to its state
+	bool ready = true;
+	if (filter != 0){
+		uint16_t sample = value;
+		ready = AnalogFilter::update(*filter, sample, value);
+	}
+
+	if (ready){
+		uint8_t slot = head;
+		uint8_t next = (slot + 1) & MASK;
+		if (next == tail){
+			if (overruns < 0xFFFF){
+				overruns++;
+			}
+		}
+		else {
+			times[slot] = micros();
+			positions[slot] = (encoder != 0) ? RotaryEncoder::getPosition(*encoder) : 0;
+			values[slot] = value;
+			head = next;
+		}
+	}
+
+	// A conversion that was done in the meantime interrupts right after the return
+	cli();
+	ADCSRA = (ADCSRA & ~(1 << ADIF)) | (1 << ADIE);
+}
@@ -0,0 +1,121 @@
+/*
+	AnalogSampler.h - Library that samples an analog pin at a fixed rate in
+	the background, with the ADC started by hardware, and keeps the samples
+	(with their time and the position of an encoder) in a ring buffer till
+	the sketch reads them. The samples can be filtered and decimated on the
+	way (see AnalogFilter.h).
+
+	Why:
+	"analogRead" starts a conversion and waits till it is done, about 110 us
+	of the 16 MHz Arduino for every sample. Polled from loop() at the rate of
+	a timer, the sample rate is limited by everything else loop() does
+	(printing the samples for one) and the time of the sample jitters by as
+	much as loop() takes.
+
+	How:
+	The ADC is put in auto trigger mode. Either it converts back to back
+	("FREE_RUNNING", F_CPU / 128 / 13 = 9615 Hz), or every conversion is
+	started by Timer1 (CTC mode, compare match B), at any rate from
+	MIN_RATE to MAX_RATE. The conversion is started by the hardware, so the
+	samples are evenly spaced whatever the sketch is doing. When it is done,
+	the ADC interrupt stores the value, the time (micros) and the position
+	of the encoder in the ring buffer, in a few micro seconds. "read" takes
+	the samples out in loop(), in the same order. The interrupt only blocks
+	the other ones while it takes the value from the ADC, the rest (filter,
+	ring buffer) runs with them enabled and only the ADC interrupt masked.
+
+	With a filter ("my_filter" of "start"), the interrupt passes every
+	conversion through AnalogFilter::update and only stores the outputs,
+	with the time and position of the conversion that completed them. So
+	the ADC can run at several kHz while the buffer, the main program and
+	the serial port only see the decimated rate (see "getRate").
+
+	The ring buffer has a single producer (the ADC interrupt) and a single
+	consumer (the main program), so it needs no locks: the interrupt only
+	moves "head" and the main program only moves "tail", both a single
+	byte. If loop() doesn't keep up, the buffer fills up and new samples
+	are dropped, counted in "getOverruns". Sending them in frames with
+	SerialComm::sendSamples keeps up with several kHz at 2 Mbaud, printing
+	them as text does not.
+
+	Note:
+	- Timer1 is used for the rates other than FREE_RUNNING, it can't be used
+	  for anything else in the meantime: StepTimer (i.e., moving a stepper in
+	  the background), PWM on pins 9 and 10, the Servo library. "start"
+	  reprograms Timer1, so if StepTimer is running by then it leaves Timer1
+	  alone: the ADC runs free and only every n-th conversion is kept, the
+	  closest to the rate asked (9615 Hz / n, or 19231 Hz / n above 5 kHz).
+	  The samples are still evenly spaced, see "getRate" for the actual
+	  rate. Don't start StepTimer (e.g., "stepAsync", "moveAsync") while
+	  sampling with Timer1, it would stop the conversions: start the moves
+	  first, or call "start" again once they are running.
+	- Don't call "analogRead" between "start" and "stop".
+	- The encoder is read from the interrupt with RotaryEncoder::getPosition,
+	  which updates its Obj. Don't use the same Obj in the main program while
+	  sampling.
+	- The time is the one at the end of the conversion. The analog value was
+	  taken 1.5 ADC clocks after the trigger, i.e., about 100 us before
+	  (CONVERSION_US), and the position when the time was taken.
+	- The registers used here are the ones of the ATmega328p (Arduino
+	  Uno/Nano).
+
+
+	About Code:
+	Similar style as in StepTimer.h. There is only one ADC per arduino, so the
+	state is kept in static variables local to "AnalogSampler.cpp" and there
+	is no object to pass around.
+
+
+	GNU GPL License
+ */
+
+
+#include "Arduino.h"
+#include "RotaryEncoder.h"
+#include "AnalogFilter.h"
+#include "StepTimer.h"
+
+
+#ifndef ANALOGSAMPLER_H
+#define ANALOGSAMPLER_H
+
+namespace Sensor{
+	namespace Analog{
+		namespace Sampler{
+
+			struct Sample{
+				uint32_t time; // micros() at the end of the conversion
+				long position; // Of the encoder, 0 if there is none
+				uint16_t analog; // 0-1023, same as analogRead. With a filter, in units of its output (see AnalogFilter.h)
+			};
+
+			static const uint8_t BUFFER_SIZE = 32; // Power of 2. Num of samples that can wait to be read is BUFFER_SIZE - 1
+
+			static const uint32_t FREE_RUNNING = 0; // As rate: the ADC converts back to back, F_CPU / 128 / 13 = 9615 Hz
+			static const uint32_t MIN_RATE = 4;     // Hz, slowest rate of Timer1 (prescaler of 64) and of the free running ADC
+			static const uint32_t MAX_RATE = 15000; // Hz, above 5 kHz the ADC runs at 250 kHz, which costs some accuracy
+			static const uint8_t CONVERSION_US = 108; // Time of a conversion at the rates up to 5 kHz (54 us above)
+
+			// Starts sampling "pin" (0-5 or A0-A5) at "sample_rate" conversions per second, or FREE_RUNNING. With "my_rotary",
+			// its position is stored with every sample. With "my_filter", only its outputs are stored (it is reset here and
+			// used by the interrupt till "stop", don't touch it in the meantime). Restarts if it is already running, the
+			// buffer is emptied. Leaves Timer1 alone while StepTimer runs (see Note above).
+			void start(const uint8_t& pin, const uint32_t& sample_rate, RotaryEncoder::Obj* my_rotary = 0,
+			           AnalogFilter::Obj* my_filter = 0);
+			void stop(); // No more samples. The ones in the buffer can still be read. analogRead can be used again
+
+			bool read(Sample& sample); // Takes the oldest sample out of the buffer, false if there is none
+			uint8_t available(); // Num of samples in the buffer
+
+			uint16_t getOverruns(); // Num of samples dropped because the buffer was full
+			double getRate(); // Actual rate in Hz of the samples in the buffer: the conversions (the closest to the rate asked
+			                  // that Timer1, or the free running ADC, can do) over the decimation of the filter
+		}
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace AnalogSampler = Sensor::Analog::Sampler;
+
+#endif
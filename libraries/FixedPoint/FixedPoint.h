@@ -0,0 +1,134 @@
+/*
+	FixedPoint.h - Integer math for the unit conversions of the other
+	libraries (mm, encoder counts, steps, degrees), so that the code that
+	runs on every move or every interrupt doesn't need floating point. The
+	AVR has no FPU: a float multiplication, and the conversions from and to
+	long around it, take a few hundred cycles of library code each.
+
+	Scale:
+	A conversion factor is turned into a "Scale" once, at "init", with
+	"toScale". A Scale is a 16 bit mantissa and a shift, factor = mantissa /
+	2^shift, with the mantissa between 0x8000 and 0xFFFF (normalized, like a
+	tiny float), so any factor from 1/2^31 to 65535 keeps 16 significant
+	bits. "scale" then converts a value with two 16x16 bit multiplications
+	(that the AVR does in hardware) and shifts, and rounds to the nearest.
+
+	Rounding error:
+	The mantissa is off by at most half a bit, i.e., the factor by at most
+	1 part in 65536, and the result is rounded once more. So the result of
+	"scale" is within 0.5 + |value * factor| / 65536 of the exact one, e.g.,
+	within 1 step for any move up to 65536 steps. The result must fit in a
+	long: |value * factor| < 2^31.
+
+	About Code:
+	Header only, everything is inline, so it compiles down to the few
+	instructions that are needed where it is used. This file doesn't depend
+	on Arduino either, so it can be checked on the PC.
+
+
+	GNU GPL License
+ */
+
+
+#include <stdint.h>
+
+
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+namespace Math{
+	namespace FixedPoint{
+
+		struct Scale{
+			uint16_t mantissa; // factor = mantissa / 2^shift
+			uint8_t shift;
+		};
+
+		static const uint8_t MAX_SHIFT = 47;
+
+
+		// Uses floating point, call it once when setting up (e.g., in "init"), not per move
+		inline Scale toScale(double factor){
+
+			Scale scale = { 0, 0 };
+			if (factor <= 0){
+				return scale;
+			}
+			if (factor >= 65535.0){
+				scale.mantissa = 0xFFFF;
+				return scale;
+			}
+
+			while (factor < 32768.0 && scale.shift < MAX_SHIFT){
+				factor *= 2;
+				scale.shift++;
+			}
+			uint32_t mantissa = static_cast<uint32_t>(factor + 0.5);
+			if (mantissa > 0xFFFF){ // rounded up to the next power of 2
+				mantissa >>= 1;
+				scale.shift--;
+			}
+			scale.mantissa = mantissa;
+			return scale;
+		}
+
+
+		// value * factor, rounded to the nearest. |value * factor| must be below 2^31.
+		inline int32_t scale(int32_t value, const Scale& factor){
+
+			uint32_t magnitude = (value < 0) ? -static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+			uint32_t low  = static_cast<uint32_t>(static_cast<uint16_t>(magnitude)) * factor.mantissa;
+			uint32_t high = static_cast<uint32_t>(static_cast<uint16_t>(magnitude >> 16)) * factor.mantissa;
+
+			// (high * 2^16 + low) / 2^shift
+			uint32_t result;
+			if (factor.shift >= 16){
+				uint32_t sum = high + (low >> 16); // the product / 2^16, the 16 bits that drop out only matter for a tie
+				uint8_t shift = factor.shift - 16;
+				if (shift == 0){
+					result = sum + ((low & 0x8000) ? 1 : 0);
+				}
+				else if (shift < 32){
+					result = (sum >> shift) + ((sum >> (shift - 1)) & 1);
+				}
+				else {
+					result = 0;
+				}
+			}
+			else if (factor.shift > 0){
+				result = (high << (16 - factor.shift)) + (low >> factor.shift) + ((low >> (factor.shift - 1)) & 1);
+			}
+			else {
+				result = (high << 16) + low;
+			}
+
+			return (value < 0) ? -static_cast<int32_t>(result) : static_cast<int32_t>(result);
+		}
+
+
+		// Integer square root, rounded down
+		inline uint32_t squareRoot(uint32_t value){
+
+			uint32_t root = 0;
+			uint32_t bit = 1UL << 30;
+			while (bit > value) bit >>= 2;
+			while (bit != 0){
+				if (value >= root + bit){
+					value -= root + bit;
+					root = (root >> 1) + bit;
+				}
+				else {
+					root >>= 1;
+				}
+				bit >>= 2;
+			}
+			return root;
+		}
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace FixedPoint = Math::FixedPoint;
+
+#endif
@@ -0,0 +1,196 @@
+/*
+	LinActMultiAxis.h - Library that moves several linear actuators
+	together, so that they all start and finish their moves at the same
+	time (linear interpolation).
+
+	GNU GPL License
+ */
+
+#include "LinActMultiAxis.h"
+#include "StepTimer.h"
+#include "SerialLog.h"
+
+
+namespace ns_act = Actuator::Linear::WithStepper;
+namespace ns_mul = Actuator::Linear::MultiAxis;
+
+
+// I'm creating "static" because I cannot pass args to ISR. Group that the timer is moving.
+static ns_mul::Obj* volatile running_group = 0;
+
+
+ns_mul::Obj ns_mul::init(LinActStepper::Obj* const actuators[], const uint8_t& num_axes){
+
+	ns_mul::Obj my_group;
+
+	my_group.num_axes = (num_axes > ns_mul::MAX_AXES) ? ns_mul::MAX_AXES : num_axes;
+	for (uint8_t i = 0; i < my_group.num_axes; i++){
+		my_group.axes[i].pActuator = actuators[i];
+		my_group.axes[i].max_rate  = 0;
+		my_group.axes[i].delta     = 0;
+		my_group.axes[i].error     = 0;
+		my_group.axes[i].forward   = true;
+	}
+
+	my_group.state.steps_left     = 0;
+	my_group.state.major_steps    = 0;
+	my_group.state.moving         = false;
+	my_group.state.aggregate_rate = 0;
+
+	my_group.printStatus = false;
+
+	return my_group;
+}
+
+
+// One step of the major axis and the Bresenham steps of the others, from the Timer1 interrupt.
+static uint32_t onTimer(){
+	ns_mul::Obj* my_group = running_group;
+	if (my_group == 0){
+		return 0;
+	}
+	ns_mul::State& state = my_group->state;
+
+	for (uint8_t i = 0; i < my_group->num_axes; i++){
+		ns_mul::Axis& axis = my_group->axes[i];
+		axis.error -= axis.delta;
+		if (axis.error < 0){
+			axis.error += state.major_steps;
+			axis.pActuator->stepper_obj.stepOnce(axis.forward);
+		}
+	}
+
+	if (--state.steps_left <= 0){
+		state.moving = false;
+		running_group = 0;
+		return 0;
+	}
+
+	// whole ticks, the fraction is carried over to keep the average rate
+	uint16_t sum = state.fraction + (state.interval & 0xFF);
+	state.fraction = sum & 0xFF;
+	return (state.interval >> 8) + (sum >> 8);
+}
+
+
+void ns_mul::move(ns_mul::Obj& my_group, const int32_t num_steps[]){
+	ns_mul::moveAsync(my_group, num_steps);
+	while (ns_mul::isMoving(my_group)){
+		SerialLog::drain();
+		yield();
+	}
+}
+
+
+void ns_mul::move(ns_mul::Obj& my_group, const double relative_disp_mm[]){
+	int32_t num_steps[ns_mul::MAX_AXES];
+	for (uint8_t i = 0; i < my_group.num_axes; i++){
+		num_steps[i] = ns_act::getSteps(*my_group.axes[i].pActuator, relative_disp_mm[i]);
+	}
+	ns_mul::move(my_group, num_steps);
+}
+
+
+void ns_mul::moveAsync(ns_mul::Obj& my_group, const double relative_disp_mm[]){
+	int32_t num_steps[ns_mul::MAX_AXES];
+	for (uint8_t i = 0; i < my_group.num_axes; i++){
+		num_steps[i] = ns_act::getSteps(*my_group.axes[i].pActuator, relative_disp_mm[i]);
+	}
+	ns_mul::moveAsync(my_group, num_steps);
+}
+
+
+void ns_mul::moveAsync(ns_mul::Obj& my_group, const int32_t num_steps[]){
+
+	if (my_group.printStatus == true){
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Group >> Move >> Time(millis), Num of Steps: ");
+		record.print(millis());
+		for (uint8_t i = 0; i < my_group.num_axes; i++){
+			record.print(", ");
+			record.print(num_steps[i]);
+		}
+		record.println();
+
+		SerialLog::end();
+	}
+
+	// Same timer channel as the moves of a single actuator, and as the other groups
+	while (running_group != 0 || StepTimer::isRunning(StepTimer::CHANNEL_A)){
+		SerialLog::drain();
+		yield();
+	}
+
+	// The major axis takes a step on every interrupt
+	long major_steps = 0;
+	long total_steps = 0;
+	for (uint8_t i = 0; i < my_group.num_axes; i++){
+		long delta = abs(num_steps[i]);
+		if (delta > major_steps){
+			major_steps = delta;
+		}
+		total_steps += delta;
+	}
+	if (major_steps == 0){
+		return;
+	}
+
+	// Fastest rate of the major axis at which no axis goes over its own limit
+	double major_rate = StepTimer::TICKS_PER_SEC / static_cast<double>(StepTimer::MIN_INTERVAL);
+	for (uint8_t i = 0; i < my_group.num_axes; i++){
+		ns_mul::Axis& axis = my_group.axes[i];
+		axis.max_rate = axis.pActuator->stepper_obj.getStepRate();
+		axis.delta    = abs(num_steps[i]);
+		axis.forward  = num_steps[i] > 0;
+		axis.error    = major_steps / 2;
+
+		if (axis.delta > 0){
+			double limit = (axis.max_rate > 0 ? axis.max_rate : 1) * (static_cast<double>(major_steps) / axis.delta);
+			if (limit < major_rate){
+				major_rate = limit;
+			}
+		}
+	}
+
+	ns_mul::State& state = my_group.state;
+	state.major_steps    = major_steps;
+	state.interval       = (static_cast<double>(StepTimer::TICKS_PER_SEC) * 256) / major_rate;
+	state.fraction       = 0;
+	state.aggregate_rate = major_rate * total_steps / major_steps + 0.5;
+	state.steps_left     = major_steps;
+	state.moving         = true;
+	running_group = &my_group;
+
+	StepTimer::start(StepTimer::CHANNEL_A, onTimer, StepTimer::MIN_INTERVAL);
+}
+
+
+bool ns_mul::isMoving(const ns_mul::Obj& my_group){
+	return my_group.state.moving;
+}
+
+
+void ns_mul::stop(ns_mul::Obj& my_group){
+
+	uint8_t sreg = SREG;
+	cli();
+
+	if (running_group == &my_group){
+		StepTimer::stop(StepTimer::CHANNEL_A);
+		running_group = 0;
+	}
+	my_group.state.steps_left = 0;
+	my_group.state.moving     = false;
+
+	SREG = sreg;
+}
+
+
+uint32_t ns_mul::getAggregateRate(const ns_mul::Obj& my_group){
+	return my_group.state.aggregate_rate;
+}
+
+
+void ns_mul::printCommands(ns_mul::Obj& my_group, const bool& status){
+	my_group.printStatus = status;
+}
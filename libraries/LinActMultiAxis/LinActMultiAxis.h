@@ -0,0 +1,106 @@
+/*
+	LinActMultiAxis.h - Library that moves several linear actuators
+	together, so that they all start and finish their moves at the same
+	time (linear interpolation). This library builds on "LinActStepper"
+	and "StepTimer" libraries.
+
+	How the moves are coordinated:
+	The actuator that has to take the most steps is the "major" axis. It
+	takes one step on every Timer1 interrupt (see StepTimer.h). On the same
+	interrupt every other axis adds its num of steps to an error term, and
+	steps when the error goes past the num of steps of the major axis
+	(Bresenham's line algorithm). So all the steps are interleaved from one
+	timer, with integer math only, and each axis ends exactly on its target.
+
+	Speed:
+	Each axis is limited to the speed set on its actuator (see
+	"LinActStepper::setSpeed" or "setMaxSpeed"). The interval between the
+	interrupts is chosen so that no axis goes faster than its own limit,
+	i.e., the axis that is the most limited for this move sets the pace.
+	"getAggregateRate" gives the total num of steps per second of all the
+	axes together, which is what the interrupt has to keep up with.
+	There are no acceleration ramps, keep the speeds below the speed at
+	which the motors can start and stop without losing steps.
+
+	"moveAsync" starts the move and returns immediately, "move" waits till
+	all the axes are at their targets. Only one group can move at a time
+	and it uses the same timer channel as "LinActStepper::moveAsync", so it
+	waits for the actuators that are moving by themselves, and a move of a
+	single actuator (or the servo of LinActWithRotEnc) waits for the group.
+
+
+	About Code:
+	Similar style as in RotaryEncoder.h. The group only keeps pointers to
+	the actuators, so they have to outlive it. There is only one Timer1, so
+	the group that is moving is kept in a static variable local to
+	"LinActMultiAxis.cpp". Don't copy the "Obj" of a group while it is moving.
+
+
+	GNU GPL License
+ */
+
+
+#include "Arduino.h"
+#include "LinActStepper.h"
+
+
+#ifndef LINACTMULTIAXIS_H
+#define LINACTMULTIAXIS_H
+
+namespace Actuator {
+	namespace Linear {
+		namespace MultiAxis {
+
+			static const uint8_t MAX_AXES = 4; // Max num of actuators in a group
+
+			struct Axis{
+				LinActStepper::Obj* pActuator;
+				uint32_t max_rate; // Speed limit in steps/s, from the speed set on the actuator
+				long delta;        // Num of steps of the current move, always positive
+				long error;        // Bresenham error term
+				bool forward;      // Direction of the current move
+			};
+
+			// Used by the timer interrupt
+			struct State{
+				volatile long steps_left; // Steps of the major axis still to be taken
+				long major_steps;         // Num of steps of the major axis
+				uint32_t interval;        // Between two steps of the major axis, in Timer1 ticks with 8 fractional bits
+				uint8_t fraction;         // Fraction of a tick carried over to the next interval
+				volatile bool moving;
+				uint32_t aggregate_rate;  // Steps per second of all the axes together
+			};
+
+			typedef struct MyObj{
+				uint8_t num_axes;
+				Axis axes[MAX_AXES];
+				State state;
+				bool printStatus; // Set this to true or false via "printCommands", to print the commands broadcasted. Default: False
+			} Obj;
+
+
+			// Send an array with the addresses of the actuators (see LinActStepper library) and the num of actuators.
+			// The order of the actuators is the order of the displacements/steps in "move".
+			Obj init(LinActStepper::Obj* const actuators[], const uint8_t& num_axes);
+
+			// One value per axis. Move by relative (from current position) num of steps or displacement in mm.
+			void move(Obj& my_group, const int32_t num_steps[]);
+			void move(Obj& my_group, const double relative_disp_mm[]);
+
+			// Same as "move" but returns immediately, the actuators move in the background.
+			void moveAsync(Obj& my_group, const int32_t num_steps[]);
+			void moveAsync(Obj& my_group, const double relative_disp_mm[]);
+			bool isMoving(const Obj& my_group); // True till all the axes are at their targets
+			void stop(Obj& my_group); // Stops all the axes after the step in progress
+
+			uint32_t getAggregateRate(const Obj& my_group); // Steps per second of all the axes together, of the last move
+			void printCommands(Obj& my_group, const bool& status); // Prints to serial all the commands broadcasted to the group
+		}
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace LinActMultiAxis = Actuator::Linear::MultiAxis;
+
+#endif
@@ -8,93 +8,245 @@
  */
 
 #include "LinActStepper.h"
+#include "SerialLog.h"
 
 
 namespace ns_act = Actuator::Linear::WithStepper;
 
 
-ns_act::Obj ns_act::init(const uint8_t (&pins)[4], const uint16_t& num_steps, const uint8_t& lead_length, const uint8_t& micro_steps){
+// Num of actuators created so far, gives the "id" of the next one
+static uint8_t count = 0;
 
-	static uint8_t count = 0;
 
-	ns_act::Obj my_actuator;
+void ns_act::initSettings(ns_act::Obj& my_actuator, const uint16_t& num_steps, const uint8_t& lead_length, const uint8_t& micro_steps){
+
 	my_actuator.id = count;
 	count++;
 
+	my_actuator.settings.steps_per_rev = num_steps*micro_steps;
+	my_actuator.settings.lead_length = lead_length;
+	my_actuator.convert.disp2steps = my_actuator.settings.steps_per_rev / static_cast<double>(lead_length);
+	my_actuator.convert.um2steps   = FixedPoint::toScale(my_actuator.convert.disp2steps / 1000);
+	my_actuator.convert.mm2steps   = FixedPoint::toScale(my_actuator.convert.disp2steps);
+	my_actuator.printStatus = false;
+}
+
+
+ns_act::Obj ns_act::init(const uint8_t (&pins)[4], const uint16_t& num_steps, const uint8_t& lead_length, const uint8_t& micro_steps){
+
+	ns_act::Obj my_actuator;
+
 	if (micro_steps == 1)	{
 		my_actuator.stepper_obj = ::Stepper(num_steps, pins[0], pins[1], pins[2], pins[3]);
 	} else {
 		my_actuator.stepper_obj = ::Stepper(num_steps, true, micro_steps, pins[0], pins[1], pins[2], pins[3]);
 	}
 
-	my_actuator.settings.steps_per_rev = num_steps*micro_steps;
-	my_actuator.settings.lead_length = lead_length;
-	my_actuator.convert.disp2steps = my_actuator.settings.steps_per_rev / static_cast<double>(lead_length);
-	my_actuator.printStatus = false;
+	ns_act::initSettings(my_actuator, num_steps, lead_length, micro_steps);
+	return my_actuator;
+}
 
+
+ns_act::Obj ns_act::init(const StepDirDriver& driver, const uint16_t& num_steps, const uint8_t& lead_length){
+
+	ns_act::Obj my_actuator;
+	my_actuator.stepper_obj = ::Stepper(num_steps, driver);
+
+	ns_act::initSettings(my_actuator, num_steps, lead_length, (driver.micro_steps > 1) ? driver.micro_steps : 1);
 	return my_actuator;
 }
 
 
 void ns_act::move(Obj& my_actuator, const int32_t& num_steps){
+	ns_act::moveAsync(my_actuator, num_steps);
+
+	// Wait till the timer has taken all the steps
+	while (ns_act::isMoving(my_actuator)){
+		SerialLog::drain();
+		yield();
+	}
+}
+
+
+void ns_act::move(Obj& my_actuator, const double& relative_disp_mm){
+	ns_act::moveAsync(my_actuator, relative_disp_mm);
+
+	// Wait till the timer has taken all the steps
+	while (ns_act::isMoving(my_actuator)){
+		SerialLog::drain();
+		yield();
+	}
+}
+
+
+void ns_act::moveAsync(Obj& my_actuator, const int32_t& num_steps){
 
 	if (my_actuator.printStatus == true){
-		Serial.print("Linear Actuator Stepper #");
-		Serial.print(my_actuator.id);
-		Serial.print(" >> Move >> Time(millis), No. of Steps: ");
-		Serial.print(millis());
-		Serial.print(", ");
-		Serial.println(num_steps);
-
-		Serial.flush();
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Stepper #");
+		record.print(my_actuator.id);
+		record.print(" >> Move >> Time(millis), No. of Steps: ");
+		record.print(millis());
+		record.print(", ");
+		record.println(num_steps);
+
+		SerialLog::end();
 	}
 
-	my_actuator.stepper_obj.step(num_steps);
+	my_actuator.stepper_obj.stepAsync(num_steps);
 }
 
 
-void ns_act::move(Obj& my_actuator, const double& relative_disp_mm){
+void ns_act::moveAsync(Obj& my_actuator, const double& relative_disp_mm){
 	int32_t num_steps = ns_act::getSteps(my_actuator, relative_disp_mm);
 
 	if (my_actuator.printStatus == true){
-		Serial.print("Linear Actuator Stepper #");
-		Serial.print(my_actuator.id);
-		Serial.print(" >> Move >> Time(millis), Rel. Disp(mm), No. of Steps: ");
-		Serial.print(millis());
-		Serial.print(", ");
-		Serial.print(relative_disp_mm);
-		Serial.print(", ");
-		Serial.println(num_steps);
-
-		Serial.flush();
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Stepper #");
+		record.print(my_actuator.id);
+		record.print(" >> Move >> Time(millis), Rel. Disp(mm), No. of Steps: ");
+		record.print(millis());
+		record.print(", ");
+		record.print(relative_disp_mm);
+		record.print(", ");
+		record.println(num_steps);
+
+		SerialLog::end();
+	}
+
+	my_actuator.stepper_obj.stepAsync(num_steps);
+}
+
+
+bool ns_act::isMoving(const Obj& my_actuator){
+	return my_actuator.stepper_obj.isMoving();
+}
+
+
+int32_t ns_act::stepsRemaining(const Obj& my_actuator){
+	return my_actuator.stepper_obj.stepsRemaining();
+}
+
+
+void ns_act::stop(Obj& my_actuator){
+
+	if (my_actuator.printStatus == true){
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Stepper #");
+		record.print(my_actuator.id);
+		record.print(" >> Stop >> Time(millis), Steps Remaining: ");
+		record.print(millis());
+		record.print(", ");
+		record.println(my_actuator.stepper_obj.stepsRemaining());
+
+		SerialLog::end();
 	}
 
-	my_actuator.stepper_obj.step(num_steps);
+	my_actuator.stepper_obj.stop();
 }
 
 
 void ns_act::setSpeed(Obj& my_actuator, const uint16_t& rpm){
 
 	if (my_actuator.printStatus == true){
-		Serial.print("Linear Actuator Stepper #");
-		Serial.print(my_actuator.id);
-		Serial.print(" >> SetSpeed >> Time(millis), Speed(rpm): ");
-		Serial.print(millis());
-		Serial.print(", ");
-		Serial.println(rpm);
-
-		Serial.flush();
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Stepper #");
+		record.print(my_actuator.id);
+		record.print(" >> SetSpeed >> Time(millis), Speed(rpm): ");
+		record.print(millis());
+		record.print(", ");
+		record.println(rpm);
+
+		SerialLog::end();
 	}
 
 	my_actuator.stepper_obj.setSpeed(rpm);
 }
 
 
+void ns_act::setMaxSpeed(Obj& my_actuator, const double& speed_mm_s){
+
+	if (my_actuator.printStatus == true){
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Stepper #");
+		record.print(my_actuator.id);
+		record.print(" >> SetMaxSpeed >> Time(millis), Speed(mm/s): ");
+		record.print(millis());
+		record.print(", ");
+		record.println(speed_mm_s);
+
+		SerialLog::end();
+	}
+
+	my_actuator.stepper_obj.setStepRateMilli(speed_mm_s * my_actuator.convert.disp2steps * 1000 + 0.5);
+}
+
+
+void ns_act::setMaxSpeedUm(Obj& my_actuator, const int32_t& speed_um_s){
+
+	if (my_actuator.printStatus == true){
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Stepper #");
+		record.print(my_actuator.id);
+		record.print(" >> SetMaxSpeed >> Time(millis), Speed(um/s): ");
+		record.print(millis());
+		record.print(", ");
+		record.println(speed_um_s);
+
+		SerialLog::end();
+	}
+
+	// steps per mm are milli steps per um
+	my_actuator.stepper_obj.setStepRateMilli(FixedPoint::scale(speed_um_s, my_actuator.convert.mm2steps));
+}
+
+
+void ns_act::setAcceleration(Obj& my_actuator, const double& accel_mm_s2){
+
+	if (my_actuator.printStatus == true){
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Stepper #");
+		record.print(my_actuator.id);
+		record.print(" >> SetAcceleration >> Time(millis), Acceleration(mm/s^2): ");
+		record.print(millis());
+		record.print(", ");
+		record.println(accel_mm_s2);
+
+		SerialLog::end();
+	}
+
+	my_actuator.stepper_obj.setAcceleration(accel_mm_s2 * my_actuator.convert.disp2steps + 0.5);
+}
+
+
+void ns_act::setJerk(Obj& my_actuator, const double& jerk_mm_s3){
+
+	if (my_actuator.printStatus == true){
+		Print& record = SerialLog::begin();
+		record.print("Linear Actuator Stepper #");
+		record.print(my_actuator.id);
+		record.print(" >> SetJerk >> Time(millis), Jerk(mm/s^3): ");
+		record.print(millis());
+		record.print(", ");
+		record.println(jerk_mm_s3);
+
+		SerialLog::end();
+	}
+
+	my_actuator.stepper_obj.setJerk(jerk_mm_s3 * my_actuator.convert.disp2steps + 0.5);
+}
+
+
 int32_t ns_act::getSteps(const Obj& my_actuator, const double& displacement){
 	return displacement * my_actuator.convert.disp2steps;
 }
 
 
+int32_t ns_act::getStepsUm(const Obj& my_actuator, const int32_t& displacement_um){
+	return FixedPoint::scale(displacement_um, my_actuator.convert.um2steps);
+}
+
+
 void ns_act::printCommands(Obj& my_actuator, const bool& status){
 	my_actuator.printStatus = status;
 }
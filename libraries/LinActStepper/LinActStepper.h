@@ -27,6 +27,65 @@
 	For example, for double-start thread: lead_length = 2*pitch. 	
 	
 
+	Moving in the background:
+	"moveAsync" starts the move and returns immediately, the steps are then
+	taken from the Timer1 interrupt (see StepTimer.h) at the speed set with 
+	"setSpeed". Use "isMoving" or "stepsRemaining" to know where the move is, 
+	and "stop" to end it early. In the meantime the sketch can print, read the
+	encoder or parse commands. "move" does the same but waits till the move is
+	over. Only one actuator can move at a time: starting a move on another
+	actuator waits for the current one to finish. Don't copy the "Obj" of an
+	actuator while it is moving, the timer keeps moving the original.
+
+	Speed:
+	"setSpeed" takes whole rpm, "setMaxSpeed" and "setMaxSpeedUm" any
+	speed in mm/s or um/s. They all set the rate of the (micro)steps with a
+	resolution of 1/1000 step per second, and the Timer1 interrupt keeps
+	the interval between the steps to a fraction of a tick (see
+	Stepper::setStepRateMilli), so a long move runs at the speed that was
+	set, e.g., 0.0125 mm/s (1.6667 steps/s) with 8 micro steps on the
+	EM_RRL actuator, and not at a whole number of steps per second or us
+	per step.
+
+	Acceleration:
+	By default a move starts and stops at full speed, which is fine as long
+	as the speed is low. At higher speeds the motor stalls and loses steps.
+	Set an acceleration with "setAcceleration" and the moves will ramp up to
+	the speed set with "setSpeed" or "setMaxSpeed", cruise, and ramp down to
+	stop at the target. A jerk set with "setJerk" makes the acceleration
+	itself ramp up and down (S-curve), which is gentler on the lead screw.
+	The ramps are computed in the Timer1 interrupt with integer math only.
+	Changes take effect on the next move.
+
+	Settings fixed at compile time:
+	When the pins, number of steps, lead length and micro steps don't
+	change while the sketch runs (i.e., almost always) use "Fixed<...>::init"
+	instead of "init". The Obj and all the functions are the same, but each
+	step is taken by FixedStepper (see FixedStepper.h), which has the wiring
+	and the microstep table folded in by the compiler instead of looking them
+	up on every step in the Timer1 interrupt. The Stepper is set up by
+	FixedStepper as well, so a sketch that only uses "Fixed" doesn't link the
+	constructors and the step functions of the generic wirings: less flash,
+	not more, next to the fixed step.
+
+	STEP/DIR drivers:
+	Instead of the L298P, the motor can be driven by a STEP/DIR driver
+	(A4988, DRV8825, TMC2208 ...), with the "init" that takes a
+	StepDirDriver (see Stepper.h): the STEP, DIR and EN pins, the micro
+	steps set on the driver's MS pins and its timing. Every step is then a
+	single short pulse on STEP instead of writing the coil pins, and the
+	driver limits the current of the coils, so much higher step rates are
+	possible: up to 50 kHz (see StepTimer::MIN_INTERVAL), e.g., 16 kHz for
+	60 mm/s with 16 micro steps on the EM_RRL actuator. All the functions below
+	work the same, "off" in Stepper uses the EN pin.
+
+	Printing the commands:
+	With "printCommands" set to true every command is printed via serial.
+	The messages go through "SerialLog" (see SerialLog.h): they are queued
+	in RAM and sent while the motor moves, so printing doesn't delay the
+	start of the move.
+
+
 	About Code:
 	Similar style as in RotaryEncoder.h. But without the need for any static variables because you can control as many
 	actuators as you want (depending upon the number of pins available). See "RotaryEncoder.h" for more details.
@@ -39,6 +98,8 @@
 
 #include "Arduino.h"
 #include "Stepper.h"
+#include "FixedStepper.h"
+#include "FixedPoint.h"
 
 
 #ifndef LINACTSTEPPER_H
@@ -55,6 +116,8 @@ namespace Actuator {
 			
 			struct ConversionFactor{ 
 				double disp2steps; 
+				FixedPoint::Scale um2steps; // Same as disp2steps but per micro meter, for the integer math (see FixedPoint.h)
+				FixedPoint::Scale mm2steps; // Same as disp2steps, for the integer math of the speeds in um/s
 			};
 
 			typedef struct MyObj{
@@ -68,16 +131,48 @@ namespace Actuator {
 
 			// Send the stepper motor pins according to the stepper library; the number of steps the stepper takes to complete one
 			// revolution; the lead length of the lead screw NOT the pitch in mm, see: https://www.youtube.com/watch?v=SK_PpWN296U; 
-			// and finally the number of micro steps (see stepper library) this value can be 1,2,4 or 8. 1 means NO microstepping.
+			// and finally the number of micro steps (see stepper library) this value can be 1,2,4,8,16 or 32. 1 means NO microstepping.
 			Obj init(const uint8_t (&pins)[4], const uint16_t& num_steps, const uint8_t& lead_length, const uint8_t& micro_steps);
+			// Same as "init" for a STEP/DIR driver, e.g., "init(StepDirDriver{8, 9, StepDirDriver::NO_PIN, 16, 2, 1}, 200, 12)".
+			// The micro steps are the ones of "driver", see "STEP/DIR drivers".
+			Obj init(const StepDirDriver& driver, const uint16_t& num_steps, const uint8_t& lead_length);
+			// Everything of "init" but the stepper itself, used by "Fixed"
+			void initSettings(Obj& my_actuator, const uint16_t& num_steps, const uint8_t& lead_length, const uint8_t& micro_steps);
+			// Same as "init" with the pins, num of steps, lead length and micro steps fixed at compile time, e.g.,
+			// "Obj my_actuator = Fixed<7,4,6,5, 200, 12, 8>::init();". The steps are taken by FixedStepper (see
+			// FixedStepper.h). Use the Obj with all the functions below, same as one from "init".
+			template<uint8_t PIN_1, uint8_t PIN_2, uint8_t PIN_3, uint8_t PIN_4, uint16_t NUM_STEPS, uint8_t LEAD_LENGTH, uint8_t MICRO_STEPS>
+			struct Fixed{
+				static Obj init(){
+					Obj my_actuator;
+					FixedStepper<PIN_1, PIN_2, PIN_3, PIN_4, MICRO_STEPS>::init(my_actuator.stepper_obj, NUM_STEPS);
+					initSettings(my_actuator, NUM_STEPS, LEAD_LENGTH, MICRO_STEPS);
+					return my_actuator;
+				}
+			};
+
 			// Note: The Num. of steps per revolution is multiplied by micro_steps
 
 			// You can give move with either displacement in mm or just directly num of steps.
 			void move(Obj& my_actuator, const int32_t& num_steps); // Move by relative(from current position) num of steps
 			void move(Obj& my_actuator, const double& relative_disp_mm);	// Move by the relative displacement in mm
 			void setSpeed(Obj& my_actuator, const uint16_t& rpm); // RPM at which the motor moves, see stepper library
+			void setMaxSpeed(Obj& my_actuator, const double& speed_mm_s); // Same as "setSpeed" but in mm/s, see "Speed"
+			void setMaxSpeedUm(Obj& my_actuator, const int32_t& speed_um_s); // Same in um/s, without floating point
+
+			// Acceleration profile of the moves. Default: 0, i.e., no ramps.
+			void setAcceleration(Obj& my_actuator, const double& accel_mm_s2); // Ramp up and down at this acceleration
+			void setJerk(Obj& my_actuator, const double& jerk_mm_s3); // 0: trapezoidal speed profile, otherwise S-curve
+
+			// Same as "move" but returns immediately, the motor moves in the background.
+			void moveAsync(Obj& my_actuator, const int32_t& num_steps);
+			void moveAsync(Obj& my_actuator, const double& relative_disp_mm);
+			bool isMoving(const Obj& my_actuator); // True till all the steps of the last move are taken
+			int32_t stepsRemaining(const Obj& my_actuator); // Num of steps the last move still has to take
+			void stop(Obj& my_actuator); // Stops the move that is in progress
 			
 			int32_t getSteps(const Obj& my_actuator, const double& displacement); // Gets the number of steps required for the given displacement
+			int32_t getStepsUm(const Obj& my_actuator, const int32_t& displacement_um); // Same, for a displacement in micro meters, without floating point
 			void printCommands(Obj& my_actuator, const bool& status); // Prints to serial all the commands broadcasted to linear actuator
 		}		
 	}
@@ -8,6 +8,8 @@
  */
 
 #include "LinActWithRotEnc.h"
+#include "StepTimer.h"
+#include "SerialLog.h"
 
 
 namespace ns_rot = Sensor::Encoder::Rotary;
@@ -15,6 +17,15 @@ namespace ns_act = Actuator::Linear::WithStepper;
 namespace ns_sys = System::StepperRotary;
 
 
+// I'm creating "static" because I cannot pass args to ISR. System that the servo is moving.
+static ns_sys::Obj* volatile servo_system = 0;
+// System whose open loop move is watched for stalls, on the same timer channel as the servo
+static ns_sys::Obj* volatile watched_system = 0;
+
+static const uint32_t SERVO_PERIOD = StepTimer::TICKS_PER_SEC / 1000000UL * ns_sys::SERVO_PERIOD_US;
+static const long MAX_ERROR = 1L << 16; // Error (in encoder counts) is clamped to this, to keep the math in 32 bits
+
+
 ns_sys::Obj ns_sys::init(RotaryEncoder::Obj& my_rotary, LinActStepper::Obj& my_actuator, 
 							   const float& tolerance_factor){
 
@@ -23,21 +34,509 @@ ns_sys::Obj ns_sys::init(RotaryEncoder::Obj& my_rotary, LinActStepper::Obj& my_a
 	my_system.constraint.encpos_tolerance = tolerance_factor*my_rotary.settings.cpr/static_cast<double>(my_actuator.settings.steps_per_rev);
 	my_system.convert.disp2encpos         = my_rotary.settings.cpr/static_cast<double>(my_actuator.settings.lead_length);
 	my_system.convert.encpos2steps        = my_actuator.settings.steps_per_rev/static_cast<double>(my_rotary.settings.cpr);
+	my_system.convert.um2encpos           = FixedPoint::toScale(my_system.convert.disp2encpos / 1000);
+	my_system.convert.steps_per_count     = FixedPoint::toScale(my_system.convert.encpos2steps);
 
 	my_system.pRotary   = &my_rotary;
 	my_system.pActuator = &my_actuator;
 
+	my_system.servo.gain     = ns_sys::DEFAULT_GAIN;
+	my_system.servo.max_rate = 0;
+	my_system.servo.accel    = 0;
+
+	my_system.state.target_encpos = 0;
+	my_system.state.rate          = 0;
+	my_system.state.at_target     = true;
+	my_system.state.starts        = 0;
+	my_system.state.settle_time   = 0;
+	my_system.state.next_encpos   = 0;
+	my_system.state.next_max_rate = 0;
+	my_system.state.exit_rate     = 0;
+	my_system.state.has_next      = false;
+	my_system.state.passed        = 0;
+
+	my_system.stall.threshold = 0;
+	my_system.stall.action    = ns_sys::STALL_FLAG;
+
+	my_system.stall_state.start_encpos    = 0;
+	my_system.stall_state.total_steps     = 0;
+	my_system.stall_state.stall_error     = 0;
+	my_system.stall_state.following_error = 0;
+	my_system.stall_state.stalls          = 0;
+	my_system.stall_state.rate_milli      = 0;
+
 	return my_system;
 }
 
 
+// One run of the servo, from the Timer1 compare B interrupt. Returns the ticks till the next run, 0 when settled.
+static uint32_t servoTick(){
+	ns_sys::Obj* my_system = servo_system;
+	if (my_system == 0){
+		return 0;
+	}
+	ns_sys::ServoState& state = my_system->state;
+
+	long position = ns_rot::getPosition(*my_system->pRotary);
+	long error = state.target_encpos - position;
+
+	// Going on to the next target: it takes over once this one is in the tolerance or was passed
+	if (state.has_next && (abs(error) <= my_system->constraint.encpos_tolerance || (state.rate > 0 && error < 0) ||
+	                       (state.rate < 0 && error > 0))){
+		state.target_encpos = state.next_encpos;
+		state.max_rate      = state.next_max_rate;
+		state.has_next      = false;
+		state.passed++;
+		state.starts        = 0;
+		state.start_time    = micros();
+		error = state.target_encpos - position;
+	}
+	uint32_t exit_rate = state.has_next ? state.exit_rate : 0;
+
+	bool in_tolerance = abs(error) <= my_system->constraint.encpos_tolerance;
+
+	if (error > MAX_ERROR) error = MAX_ERROR;
+	if (error < -MAX_ERROR) error = -MAX_ERROR;
+	long error_steps = FixedPoint::scale(error, my_system->convert.steps_per_count);
+	long rate = state.rate;
+
+	// Speed that the servo wants: proportional to the error, within the speed limit
+	long desired = 0;
+	if (!in_tolerance){
+		// Clamped before the product, which doesn't fit in 32 bits for a large error and gain
+		uint32_t distance = abs(error_steps);
+		uint16_t gain = my_system->servo.gain;
+		uint32_t magnitude = (gain != 0 && distance > state.max_rate / gain) ? state.max_rate : distance * gain;
+		if (magnitude < state.min_rate) magnitude = state.min_rate;
+		if (magnitude < exit_rate) magnitude = exit_rate;
+
+		// Brake when the distance to slow down to the exit speed (0: stop) reaches the error
+		uint32_t speed = abs(rate);
+		bool approaching = (rate > 0 && error > 0) || (rate < 0 && error < 0);
+		if (state.accel != 0 && approaching && speed > exit_rate &&
+		    (speed * speed - exit_rate * exit_rate) / 2 / state.accel >= static_cast<uint32_t>(abs(error_steps))){
+			magnitude = exit_rate;
+		}
+		desired = (error > 0) ? static_cast<long>(magnitude) : -static_cast<long>(magnitude);
+	}
+
+	// The speed changes by at most the acceleration
+	long new_rate = desired;
+	if (desired > rate + static_cast<long>(state.rate_change)){
+		new_rate = rate + state.rate_change;
+	}
+	else if (desired < rate - static_cast<long>(state.rate_change)){
+		new_rate = rate - state.rate_change;
+	}
+
+	// Too slow to be worth a step: start at the min speed, or stop
+	if (new_rate != 0 && static_cast<uint32_t>(abs(new_rate)) < state.min_rate){
+		if (desired == 0 || (desired > 0) != (new_rate > 0)){
+			new_rate = 0;
+		}
+		else {
+			new_rate = (desired > 0) ? static_cast<long>(state.min_rate) : -static_cast<long>(state.min_rate);
+		}
+	}
+
+	if (new_rate != rate){
+		// Another stepper or group has the step timer: the motor stays stopped and the next run tries again
+		if (!my_system->pActuator->stepper_obj.setVelocity(new_rate)){
+			new_rate = 0;
+		}
+		else if (rate == 0){
+			state.starts++;
+		}
+		state.rate = new_rate;
+	}
+
+	// Settled when the encoder stays in the tolerance with the motor stopped
+	if (in_tolerance && new_rate == 0){
+		if (state.settle_count == 0){
+			state.enter_time = micros();
+		}
+		if (++state.settle_count >= ns_sys::SETTLE_PERIODS){
+			state.settle_time = state.enter_time - state.start_time;
+			state.at_target = true;
+			servo_system = 0;
+			return 0;
+		}
+	}
+	else {
+		state.settle_count = 0;
+	}
+
+	return SERVO_PERIOD;
+}
+
+
+// Puts back the step rate of the actuator that the stall detection halved
+static void restoreRate(ns_sys::Obj& my_system){
+	ns_sys::StallState& state = my_system.stall_state;
+	if (state.rate_milli != 0){
+		my_system.pActuator->stepper_obj.setStepRateMilli(state.rate_milli);
+		state.rate_milli = 0;
+	}
+}
+
+
+// One check of the open loop move, from the Timer1 compare B interrupt. Returns the ticks till the next one, 0 when
+// the move is over.
+static uint32_t stallTick(){
+	ns_sys::Obj* my_system = watched_system;
+	if (my_system == 0){
+		return 0;
+	}
+	ns_sys::StallState& state = my_system->stall_state;
+	::Stepper& stepper = my_system->pActuator->stepper_obj;
+	bool moving = stepper.isMoving();
+
+	// Steps taken and the steps that the encoder saw, both since the start of the move
+	long taken = labs(state.total_steps) - stepper.stepsRemaining();
+	if (state.total_steps < 0){
+		taken = -taken;
+	}
+	long counts = ns_rot::getPosition(*my_system->pRotary) - state.start_encpos;
+	long error = taken - FixedPoint::scale(counts, my_system->convert.steps_per_count);
+	state.following_error = error;
+
+	uint32_t threshold = my_system->stall.threshold;
+	if (threshold != 0 && static_cast<uint32_t>(labs(error - state.stall_error)) > threshold){
+		state.stall_error = error;
+		state.stalls++;
+
+		if (my_system->stall.action == ns_sys::STALL_ABORT){
+			stepper.stop();
+			moving = false;
+		}
+		else if (my_system->stall.action == ns_sys::STALL_SLOW_DOWN){
+			uint32_t rate = stepper.getStepRateMilli();
+			if (rate / 2 >= ns_sys::MIN_SERVO_RATE * 1000UL){
+				if (state.rate_milli == 0){
+					state.rate_milli = rate;
+				}
+				stepper.setStepRateMilli(rate / 2);
+			}
+		}
+	}
+
+	if (!moving){
+		restoreRate(*my_system);
+		watched_system = 0;
+		return 0;
+	}
+	return SERVO_PERIOD;
+}
+
+
+// Speed limit of a move in steps/s, the one of the actuator unless set with "setServo"
+static uint32_t servoMaxRate(const ns_sys::Obj& my_system){
+
+	uint32_t max_rate = (my_system.servo.max_rate != 0) ? my_system.servo.max_rate : my_system.pActuator->stepper_obj.getStepRate();
+	if (max_rate < ns_sys::MIN_SERVO_RATE){
+		max_rate = ns_sys::MIN_SERVO_RATE;
+	}
+	if (max_rate > StepTimer::TICKS_PER_SEC / StepTimer::MIN_INTERVAL){
+		max_rate = StepTimer::TICKS_PER_SEC / StepTimer::MIN_INTERVAL; // also keeps v^2 in 32 bits
+	}
+	return max_rate;
+}
+
+
+// Micro meters, rounded to the nearest
+static int32_t toMicrons(const double& disp_mm){
+	return disp_mm * 1000 + ((disp_mm < 0) ? -0.5 : 0.5);
+}
+
+
 void ns_sys::moveTo(ns_sys::Obj& my_system, const double& absolute_disp_mm){
+	ns_sys::moveToUm(my_system, toMicrons(absolute_disp_mm));
+}
+
+
+void ns_sys::moveToUm(ns_sys::Obj& my_system, const int32_t& absolute_disp_um){
+
+	ns_sys::moveToAsyncUm(my_system, absolute_disp_um);
+	while (!ns_sys::atTarget(my_system)){
+		SerialLog::drain();
+		yield();
+	}
+}
+
+
+void ns_sys::moveToAsync(ns_sys::Obj& my_system, const double& absolute_disp_mm){
+	ns_sys::moveToAsyncUm(my_system, toMicrons(absolute_disp_mm));
+}
+
+
+void ns_sys::moveToAsyncUm(ns_sys::Obj& my_system, const int32_t& absolute_disp_um){
+
+	// There is only one timer channel for the servo and the stall detection
+	while ((servo_system != 0 && servo_system != &my_system) || watched_system != 0){
+		SerialLog::drain();
+		yield();
+	}
+	// Let a move of an actuator (or a group, see LinActMultiAxis) on the step timer finish
+	if (servo_system == 0){
+		while (StepTimer::isRunning(StepTimer::CHANNEL_A)){
+			SerialLog::drain();
+			yield();
+		}
+	}
+
+	// Limits in steps, the ones of the actuator unless set with "setServo"
+	uint32_t max_rate = servoMaxRate(my_system);
+	uint32_t accel    = (my_system.servo.accel != 0) ? my_system.servo.accel : my_system.pActuator->stepper_obj.getAcceleration();
+
+	// Without an acceleration the speed changes in one go. Otherwise the slowest speed is the one
+	// that the acceleration reaches in one step, like the ramps of the stepper.
+	uint32_t rate_change = max_rate;
+	uint32_t min_rate = ns_sys::MIN_SERVO_RATE;
+	if (accel != 0){
+		rate_change = accel / (1000000UL / ns_sys::SERVO_PERIOD_US);
+		if (rate_change == 0) rate_change = 1;
+		uint32_t start_rate = FixedPoint::squareRoot(2 * accel);
+		if (start_rate > min_rate) min_rate = start_rate;
+	}
+	if (min_rate > max_rate){
+		min_rate = max_rate;
+	}
+
+	uint8_t sreg = SREG;
+	cli();
+
+	ns_sys::ServoState& state = my_system.state;
+	state.target_encpos   = FixedPoint::scale(absolute_disp_um, my_system.convert.um2encpos);
+	state.max_rate        = max_rate;
+	state.rate_change     = rate_change;
+	state.min_rate        = min_rate;
+	state.accel           = accel;
+	state.settle_count    = 0;
+	state.at_target       = false;
+	state.starts          = 0;
+	state.start_time      = micros();
+	state.settle_time     = 0;
+	state.has_next        = false;
+	state.exit_rate       = 0;
+	state.passed          = 0;
+
+	// A new target while moving continues from the current speed
+	bool running = (servo_system == &my_system);
+	if (!running){
+		state.rate   = 0;
+		servo_system = &my_system;
+	}
+
+	SREG = sreg;
+
+	if (!running){
+		StepTimer::start(StepTimer::CHANNEL_B, servoTick, StepTimer::MIN_INTERVAL);
+	}
+}
+
+
+bool ns_sys::atTarget(const ns_sys::Obj& my_system){
+	return my_system.state.at_target;
+}
+
+
+// Not faster than the speed limits on either side of the target
+static uint32_t exitRate(const ns_sys::ServoState& state, const uint32_t& exit_rate){
+
+	uint32_t rate = exit_rate;
+	if (rate > state.max_rate) rate = state.max_rate;
+	if (rate > state.next_max_rate) rate = state.next_max_rate;
+	return rate;
+}
+
+
+bool ns_sys::setNextTargetUm(ns_sys::Obj& my_system, const int32_t& next_disp_um, const uint32_t& exit_rate){
+
+	uint32_t next_max_rate = servoMaxRate(my_system);
+	long next_encpos = FixedPoint::scale(next_disp_um, my_system.convert.um2encpos);
+
+	uint8_t sreg = SREG;
+	cli();
+
+	ns_sys::ServoState& state = my_system.state;
+	bool set = (servo_system == &my_system && !state.has_next);
+	if (set){
+		if (next_max_rate < state.min_rate){
+			next_max_rate = state.min_rate;
+		}
+		state.next_encpos   = next_encpos;
+		state.next_max_rate = next_max_rate;
+		state.exit_rate     = exitRate(state, exit_rate);
+		state.has_next      = true;
+	}
+
+	SREG = sreg;
+
+	return set;
+}
+
+
+void ns_sys::setExitRate(ns_sys::Obj& my_system, const uint32_t& exit_rate){
+
+	uint8_t sreg = SREG;
+	cli();
+
+	if (servo_system == &my_system && my_system.state.has_next){
+		my_system.state.exit_rate = exitRate(my_system.state, exit_rate);
+	}
+
+	SREG = sreg;
+}
+
+
+uint16_t ns_sys::getPassed(const ns_sys::Obj& my_system){
+
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t passed = my_system.state.passed;
+	SREG = sreg;
+
+	return passed;
+}
+
+
+void ns_sys::stop(ns_sys::Obj& my_system){
+
+	uint8_t sreg = SREG;
+	cli();
+
+	if (servo_system == &my_system){
+		StepTimer::stop(StepTimer::CHANNEL_B);
+		servo_system = 0;
+	}
+	if (watched_system == &my_system){
+		StepTimer::stop(StepTimer::CHANNEL_B);
+		watched_system = 0;
+		my_system.pActuator->stepper_obj.stop();
+		restoreRate(my_system);
+	}
+	my_system.pActuator->stepper_obj.setVelocity(0);
+	my_system.state.rate      = 0;
+	my_system.state.has_next  = false;
+	my_system.state.at_target = true;
+
+	SREG = sreg;
+}
+
+
+void ns_sys::move(ns_sys::Obj& my_system, const int32_t& num_steps){
+
+	ns_sys::moveAsync(my_system, num_steps);
+	while (ns_sys::isMoving(my_system)){
+		SerialLog::drain();
+		yield();
+	}
+}
+
+
+void ns_sys::move(ns_sys::Obj& my_system, const double& relative_disp_mm){
+	ns_sys::move(my_system, ns_act::getSteps(*my_system.pActuator, relative_disp_mm));
+}
+
+
+void ns_sys::moveAsync(ns_sys::Obj& my_system, const int32_t& num_steps){
+
+	// The timer channel is free once the servo and the last watched move are done
+	while (servo_system != 0 || watched_system != 0){
+		SerialLog::drain();
+		yield();
+	}
+	// Let a move of an actuator (or a group) on the step timer finish, the encoder is read at the start of this one
+	while (StepTimer::isRunning(StepTimer::CHANNEL_A)){
+		SerialLog::drain();
+		yield();
+	}
 
-	long target_encpos = absolute_disp_mm * my_system.convert.disp2encpos;
+	ns_sys::StallState& state = my_system.stall_state;
+	state.start_encpos    = ns_rot::getPosition(*my_system.pRotary);
+	state.total_steps     = num_steps;
+	state.stall_error     = 0;
+	state.following_error = 0;
+	state.stalls          = 0;
+	state.rate_milli      = 0;
 
-	// Keep moving till the encoder value is reached
-	while(abs(target_encpos - ns_rot::getPosition(*my_system.pRotary)) > my_system.constraint.encpos_tolerance){
-		int32_t num_steps = (target_encpos - ns_rot::getPosition(*my_system.pRotary)) * my_system.convert.encpos2steps;
-		ns_act::move(*my_system.pActuator, num_steps);
+	ns_act::moveAsync(*my_system.pActuator, num_steps);
+	if (num_steps == 0){
+		return;
 	}
+
+	watched_system = &my_system;
+	StepTimer::start(StepTimer::CHANNEL_B, stallTick, SERVO_PERIOD);
+}
+
+
+void ns_sys::moveAsync(ns_sys::Obj& my_system, const double& relative_disp_mm){
+	ns_sys::moveAsync(my_system, ns_act::getSteps(*my_system.pActuator, relative_disp_mm));
+}
+
+
+bool ns_sys::isMoving(const ns_sys::Obj& my_system){
+	return watched_system == &my_system || ns_act::isMoving(*my_system.pActuator);
+}
+
+
+void ns_sys::setStallDetection(ns_sys::Obj& my_system, const double& threshold_mm, const uint8_t& action){
+	my_system.stall.threshold = threshold_mm * my_system.pActuator->convert.disp2steps + 0.5;
+	my_system.stall.action    = action;
+}
+
+
+uint16_t ns_sys::getStalls(const ns_sys::Obj& my_system){
+
+	// It is written by the stall interrupt, read it in one go
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t stalls = my_system.stall_state.stalls;
+	SREG = sreg;
+
+	return stalls;
+}
+
+
+long ns_sys::getFollowingError(const ns_sys::Obj& my_system){
+
+	uint8_t sreg = SREG;
+	cli();
+	long following_error = my_system.stall_state.following_error;
+	SREG = sreg;
+
+	return following_error;
+}
+
+
+void ns_sys::setServo(ns_sys::Obj& my_system, const uint16_t& gain, const double& max_speed_mm_s, const double& accel_mm_s2){
+
+	double disp2steps = my_system.pActuator->convert.disp2steps;
+
+	my_system.servo.gain     = gain;
+	my_system.servo.max_rate = max_speed_mm_s * disp2steps + 0.5;
+	my_system.servo.accel    = accel_mm_s2 * disp2steps + 0.5;
+}
+
+
+unsigned long ns_sys::getSettleTime(const ns_sys::Obj& my_system){
+
+	// It is written by the servo interrupt, read it in one go
+	uint8_t sreg = SREG;
+	cli();
+	unsigned long settle_time = my_system.state.settle_time;
+	SREG = sreg;
+
+	return settle_time;
+}
+
+
+uint16_t ns_sys::getStarts(const ns_sys::Obj& my_system){
+
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t starts = my_system.state.starts;
+	SREG = sreg;
+
+	return starts;
 }
@@ -13,12 +13,85 @@
 	is calculated automatically from the ablosute postion that is specified in the "moveTo"
 	function.
 
-	
+	Servo:
+	The move is done by a position servo that runs in the background from
+	the Timer1 compare B interrupt (see StepTimer.h), every SERVO_PERIOD_US.
+	Each time it compares the encoder with the target and sets the speed of
+	the stepper (see Stepper::setVelocity) proportional to the error: "gain"
+	steps/s for every step of error. The speed is limited to the max speed,
+	it changes by at most the acceleration, and it starts braking when the
+	stopping distance at the current speed reaches the error. So the actuator
+	ramps up, cruises, slows down and stops at the target in one continuous
+	motion, correcting for lost steps on the way instead of stopping and
+	starting a new move for every correction. Below MIN_SERVO_RATE (or the
+	speed that the acceleration reaches in one step) the motor stops, the
+	encoder is in the tolerance by then.
+
+	"moveToAsync" starts the move and returns immediately, "atTarget" is
+	true once the encoder has stayed within the tolerance for SETTLE_PERIODS
+	with the motor stopped. "moveTo" does the same but waits. A new target
+	can be given while the servo is moving, it continues from its current
+	speed. By default the speed and acceleration are the ones set on the
+	actuator (see LinActStepper.h); "setServo" sets the gain and other limits.
+
+	To check how the move went, "getSettleTime" is the time in micro seconds
+	from "moveToAsync" till the encoder entered the tolerance for good and
+	"getStarts" the number of times the motor started from standstill. One
+	start means the actuator got there in one continuous motion.
+
+	Look-ahead:
+	While the servo moves, "setNextTargetUm" gives it the target after the
+	current one and the speed ("exit_rate", steps/s) at which to cross the
+	current one. The servo then brakes only down to that speed, and once the
+	encoder is in the tolerance of the current target (or went past it) the
+	next target takes over in the same interrupt, without stopping.
+	"getPassed" counts the targets that were crossed like this. Only one
+	target waits at a time, set the one after it once "getPassed" went up.
+	The caller has to pick an exit speed from which the servo can still
+	stop where it has to, with the acceleration, see WaveformSequencer.h.
+	"setExitRate" changes it while the next target still waits.
+
+	Stall detection:
+	"move" and "moveAsync" move the actuator open loop, the same as
+	LinActStepper::move, but with the encoder watched on the way. Every
+	SERVO_PERIOD_US the Timer1 compare B interrupt converts the encoder
+	counts since the start of the move to steps ("steps_per_count") and
+	takes them from the steps the stepper has taken so far. That is the
+	following error ("getFollowingError"), positive when the motor is
+	behind. When it has grown by more than the threshold set with
+	"setStallDetection" since the start (or the last stall), a stall is
+	counted ("getStalls") and, depending on the action, the move goes on
+	(STALL_FLAG), goes on at half the speed (STALL_SLOW_DOWN, not below
+	MIN_SERVO_RATE, the speed of the actuator is back to the one it had
+	when the move is over or stopped) or stops
+	(STALL_ABORT). So a stall is caught within a few milli seconds instead
+	of at the end of the move. Under load the rotor lags the field by up to
+	a full step before it slips, and then it loses steps 4 full steps at a
+	time, so a threshold of about 2 full steps (0.12 mm on the EM_RRL
+	actuator) catches every stall without false alarms. At the end of the
+	move "getFollowingError" is the num of steps that were lost.
+
+	Only one system can be servoed at a time, starting another one waits
+	for the first one to be at its target. Don't use "LinActStepper::move"
+	on the actuator while the servo runs. The encoder is read in the servo
+	interrupt, which adds up to SERVO_PERIOD_US to the reaction time, so
+	keep the gain low enough for the motor to not overshoot the tolerance.
+
+
+	Integer math:
+	The conversions between mm, encoder counts and steps are done with the
+	fixed point scales of "convert" (see FixedPoint.h), computed once in
+	"init", so neither a move nor the servo interrupt uses floating point.
+	"moveToUm" and "moveToAsyncUm" take the target in micro meters, as an
+	integer. "moveTo" and "moveToAsync" round the mm to micro meters and
+	do the same.
+
 
 	About Code:
-	Similar style as in RotaryEncoder.h. But without the need for any static variables. You can create as many
-	systems that consists of actuator and encoder as you want (depending upon the number of pins available and 
-	based on 1 encoder). See "RotaryEncoder.h" for more details.
+	Similar style as in RotaryEncoder.h. You can create as many systems that consists of actuator and encoder as
+	you want (depending upon the number of pins available and up to RotaryEncoder::MAX_ENCODERS encoders). See
+	"RotaryEncoder.h" for more details. The only static variable is the pointer to the system that the servo
+	interrupt is moving, so don't copy the "Obj" of a system while it is moving.
 
 
 	Created by Rahul Subramonian Bama, June 19, 2019
@@ -28,6 +101,7 @@
 
 #include "RotaryEncoder.h"
 #include "LinActStepper.h"
+#include "FixedPoint.h"
 
 
 #ifndef LINACTWITHROTENC_H
@@ -43,11 +117,70 @@ namespace System{
 		struct ConversionFactor{ 
 			double disp2encpos; // Calculates encoder position from the given displacement
 			double encpos2steps; 
+			FixedPoint::Scale um2encpos;       // Same as disp2encpos but per micro meter, for the integer math (see FixedPoint.h)
+			FixedPoint::Scale steps_per_count; // Same as encpos2steps, used by the servo interrupt
+		};
+
+		static const uint16_t SERVO_PERIOD_US = 1000; // Time between two runs of the servo interrupt
+		static const uint8_t SETTLE_PERIODS   = 10;   // Num of servo periods in the tolerance, motor stopped, to be at the target
+		static const uint16_t DEFAULT_GAIN    = 25;   // (steps/s) per step of error
+		static const uint16_t MIN_SERVO_RATE  = 50;   // steps/s, slower than this the motor stops. Not a limit of the stepper
+		                                              // (setVelocity goes down to 1 step/s): a new speed only takes
+		                                              // effect after the pending step, i.e., up to 1 / MIN_SERVO_RATE s late
+
+		static const uint8_t STALL_FLAG      = 0; // Count the stall and keep moving
+		static const uint8_t STALL_SLOW_DOWN = 1; // Count it and halve the speed for the rest of the move
+		static const uint8_t STALL_ABORT     = 2; // Count it and stop the move
+
+		struct ServoSettings{
+			uint16_t gain;     // Speed per step of error in steps/s, i.e., 1/s
+			uint32_t max_rate; // Speed limit in steps/s, 0: the speed set on the actuator
+			uint32_t accel;    // Acceleration limit in steps/s^2, 0: the acceleration set on the actuator
+		};
+
+		// Used by the servo interrupt
+		struct ServoState{
+			volatile long target_encpos;
+			volatile long rate;           // Speed of the stepper in steps/s, the sign is the direction
+			uint32_t max_rate;
+			uint32_t rate_change;         // Max change of the speed in one servo period
+			uint32_t min_rate;
+			uint32_t accel;
+			uint8_t settle_count;
+			volatile bool at_target;
+			volatile uint16_t starts;     // Num of times the motor started from standstill
+			unsigned long start_time;     // micros() at "moveToAsync", or when the target took over from the one before
+			long next_encpos;             // Target after this one, see "setNextTargetUm"
+			uint32_t next_max_rate;
+			volatile uint32_t exit_rate;  // Speed at which the target is crossed on the way to "next_encpos"
+			volatile bool has_next;
+			volatile uint16_t passed;     // Num of targets crossed without stopping since "moveToAsync"
+			unsigned long enter_time;     // micros() when the encoder entered the tolerance
+			volatile unsigned long settle_time;
+		};
+
+		struct StallSettings{
+			uint32_t threshold; // Growth of the following error in steps that is a stall, 0: no detection
+			uint8_t action;     // STALL_FLAG, STALL_SLOW_DOWN or STALL_ABORT
+		};
+
+		// Used by the stall interrupt
+		struct StallState{
+			long start_encpos;              // Encoder at the start of the move
+			long total_steps;               // Of the move, the sign is the direction
+			long stall_error;               // Following error at the last stall, 0 at the start
+			volatile long following_error;  // Steps taken minus the steps the encoder saw
+			volatile uint16_t stalls;
+			uint32_t rate_milli;            // Step rate before the first slow down, put back at the end. 0: not slowed down
 		};
 
 		typedef struct MyObj{
 			Constraint constraint;
 			ConversionFactor convert;
+			ServoSettings servo;
+			ServoState state;
+			StallSettings stall;
+			StallState stall_state;
 
 			// Pointers to store the address of the rotary and actuator combo
 			RotaryEncoder::Obj* pRotary;
@@ -59,6 +192,38 @@ namespace System{
 		// and tolerance factor - the factor by which enc_pos_tolerance is multiplied by.
 		Obj init(RotaryEncoder::Obj& my_rotary, LinActStepper::Obj& my_actuator, const float& tolerance_factor);
 		void moveTo(Obj& my_system, const double& absolute_disp_mm); // Move to the absolute displacement in mm
+		void moveToUm(Obj& my_system, const int32_t& absolute_disp_um); // Same, in micro meters
+
+		// Same as "moveTo" but returns immediately, the servo moves the actuator in the background.
+		void moveToAsync(Obj& my_system, const double& absolute_disp_mm);
+		void moveToAsyncUm(Obj& my_system, const int32_t& absolute_disp_um);
+		bool atTarget(const Obj& my_system); // True once the move has settled at the target
+
+		// Crosses the current target at "exit_rate" steps/s and goes on to the next one (at the speed limit set now),
+		// see "Look-ahead". False if the servo isn't moving or another target is waiting already.
+		bool setNextTargetUm(Obj& my_system, const int32_t& next_disp_um, const uint32_t& exit_rate);
+		void setExitRate(Obj& my_system, const uint32_t& exit_rate); // Of the current target, while the next one waits
+		uint16_t getPassed(const Obj& my_system); // Num of targets crossed without stopping since "moveToAsync"
+		void stop(Obj& my_system); // Stops the servo and the motor where they are
+
+		// Gain in (steps/s) per step of error; speed and acceleration limits. 0: use the ones of the actuator.
+		void setServo(Obj& my_system, const uint16_t& gain, const double& max_speed_mm_s, const double& accel_mm_s2);
+
+		// Moves the actuator open loop like LinActStepper::move, with the encoder watched for stalls, see "Stall detection"
+		void move(Obj& my_system, const int32_t& num_steps);
+		void move(Obj& my_system, const double& relative_disp_mm);
+		void moveAsync(Obj& my_system, const int32_t& num_steps); // Returns immediately
+		void moveAsync(Obj& my_system, const double& relative_disp_mm);
+		bool isMoving(const Obj& my_system); // True till all the steps of "moveAsync" are taken or it is aborted
+
+		// Following error in mm that is a stall (0: no detection, the default) and what to do then
+		void setStallDetection(Obj& my_system, const double& threshold_mm, const uint8_t& action);
+		uint16_t getStalls(const Obj& my_system); // Of the last "move", num of times the following error passed the threshold
+		long getFollowingError(const Obj& my_system); // Steps taken minus the steps the encoder saw, since the start of the last "move"
+
+		// Of the last move. Settle time: micro seconds from the start till it was in the tolerance for good (0 while moving).
+		unsigned long getSettleTime(const Obj& my_system);
+		uint16_t getStarts(const Obj& my_system); // Num of times the motor started from standstill, 1: one continuous motion
 	}	
 }
 
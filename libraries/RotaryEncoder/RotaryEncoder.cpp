@@ -6,40 +6,164 @@
  */
 
 #include "RotaryEncoder.h"
+#include "SerialLog.h"
 
 namespace ns_rot = Sensor::Encoder::Rotary;
 
-ns_rot::Obj ns_rot::init(const uint8_t (&pins)[2], const uint16_t& cpr){
-
-  // Set the pins to be External Interrupt
-	pinMode(pins[0], INPUT);
-	pinMode(pins[1], INPUT);
 
-  digitalWrite(pins[0], HIGH); // turn on pull up resistor. 
-	digitalWrite(pins[1], HIGH);
+// Everything the ISR needs to decode one encoder
+struct Decoder{
+  volatile uint8_t* pin_reg[2]; // PIN registers of channel A and B
+  uint8_t pin_mask[2];
+  uint8_t last_reading;         // (A << 1) | B at the previous interrupt
+  ns_rot::State state;
+};
+
+// I'm creating "static" because I cannot pass args to ISR. "id" of the Obj is the index.
+static Decoder decoders[ns_rot::MAX_ENCODERS];
+static uint8_t num_decoders = 0;
+static volatile uint8_t group_decoders[3] = { 0, 0, 0 }; // Bit i set if decoder i has a pin in that PCINT group
+
+// Time stamp of the edges, same as micros() but without the function call. The ISR
+// already has the interrupts turned off. Timer0 ticks every 64 cycles, 256 ticks
+// per overflow, and the overflows are counted by the Arduino core (wiring.c).
+extern volatile unsigned long timer0_overflow_count;
+
+static inline unsigned long edgeTime() {
+  unsigned long overflows = timer0_overflow_count;
+  uint8_t ticks = TCNT0;
+  if ((TIFR0 & (1 << TOV0)) && ticks < 255) {
+    overflows++; // Overflow that the core didn't count yet
+  }
+  return ((overflows << 8) + ticks) * (64 / clockCyclesPerMicrosecond());
+}
 
-	attachInterrupt(digitalPinToInterrupt(pins[0]), doEncoderChannelA, CHANGE);
-	attachInterrupt(digitalPinToInterrupt(pins[1]), doEncoderChannelB, CHANGE);
+// Change in position for each (previous reading << 2) | current reading. Going
+// forward the readings are 00 -> 01 -> 11 -> 10 -> 00. ILLEGAL: both channels changed.
+static const int8_t ILLEGAL = 2;
+static const int8_t transition[16] = {
+   0,  1, -1, ILLEGAL,
+  -1,  0, ILLEGAL,  1,
+   1, ILLEGAL,  0, -1,
+  ILLEGAL, -1,  1,  0
+};
 
-  // Set static variables
-  ns_rot::pins[0] = pins[0];
-  ns_rot::pins[1] = pins[1];
-  ns_rot::state.pos = 0;
+ns_rot::Obj ns_rot::init(const uint8_t (&pins)[2], const uint16_t& cpr){
 
   // Setup the Rotary encoder
   ns_rot::Obj my_rotary;
 
+  my_rotary.id = num_decoders;
+  if (num_decoders < ns_rot::MAX_ENCODERS) {
+    num_decoders++;
+
+    // Set the pins to be inputs with pull up resistors
+    pinMode(pins[0], INPUT_PULLUP);
+    pinMode(pins[1], INPUT_PULLUP);
+
+    // Set static variables. The ISR reads the channels from the port registers.
+    Decoder& decoder = decoders[my_rotary.id];
+    decoder.pin_reg[0] = portInputRegister(digitalPinToPort(pins[0]));
+    decoder.pin_reg[1] = portInputRegister(digitalPinToPort(pins[1]));
+    decoder.pin_mask[0] = digitalPinToBitMask(pins[0]);
+    decoder.pin_mask[1] = digitalPinToBitMask(pins[1]);
+    decoder.last_reading = ((*decoder.pin_reg[0] & decoder.pin_mask[0]) ? 2 : 0) | ((*decoder.pin_reg[1] & decoder.pin_mask[1]) ? 1 : 0);
+    decoder.state.pos = 0;
+    decoder.state.errors = 0;
+    decoder.state.last_edge = micros();
+    decoder.state.edge_period = 0;
+    decoder.state.direction = 1;
+
+    // Turn on the pin change interrupts of both pins, and of their groups (ports)
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < 2; i++) {
+      if (digitalPinToPCICR(pins[i]) != 0) {
+        group_decoders[digitalPinToPCICRbit(pins[i])] |= (1 << my_rotary.id);
+        *digitalPinToPCMSK(pins[i]) |= (1 << digitalPinToPCMSKbit(pins[i]));
+        *digitalPinToPCICR(pins[i]) |= (1 << digitalPinToPCICRbit(pins[i]));
+      }
+    }
+    SREG = sreg;
+  }
+
   my_rotary.state.pos = 0;
+  my_rotary.state.errors = 0;
+  my_rotary.state.last_edge = (my_rotary.id < num_decoders) ? decoders[my_rotary.id].state.last_edge : 0;
+  my_rotary.state.edge_period = 0;
+  my_rotary.state.direction = 1;
+  my_rotary.velocity.pos = 0;
+  my_rotary.velocity.time = my_rotary.state.last_edge;
+  my_rotary.velocity.value = 0;
   my_rotary.settings.cpr = cpr;
   my_rotary.convert.pos2angle = 360 / static_cast<double>(cpr);
   my_rotary.convert.pos2rev = 1 / static_cast<double>(cpr);
+  my_rotary.convert.pos2millideg = FixedPoint::toScale(my_rotary.convert.pos2angle * 1000);
+  my_rotary.convert.pos2millirev = FixedPoint::toScale(my_rotary.convert.pos2rev * 1000);
 
   return my_rotary;
 }
 
 
 void ns_rot::update(ns_rot::Obj& my_rotary){
-  my_rotary.state.pos = ns_rot::state.pos;
+  if (my_rotary.id >= num_decoders) {
+    return; // More encoders than MAX_ENCODERS, this one is not tracked
+  }
+  const ns_rot::State& state = decoders[my_rotary.id].state;
+
+  // The ISR must not change the state in the middle of the copy, see "Snapshots"
+  uint8_t sreg = SREG;
+  cli();
+  my_rotary.state.pos = state.pos;
+  my_rotary.state.errors = state.errors;
+  my_rotary.state.last_edge = state.last_edge;
+  my_rotary.state.edge_period = state.edge_period;
+  my_rotary.state.direction = state.direction;
+  SREG = sreg;
+}
+
+
+ns_rot::Snapshot ns_rot::getSnapshot(ns_rot::Obj& my_rotary){
+  ns_rot::update(my_rotary);
+
+  ns_rot::Snapshot snapshot;
+  snapshot.pos = my_rotary.state.pos;
+  snapshot.time = my_rotary.state.last_edge;
+  snapshot.period = my_rotary.state.edge_period;
+  snapshot.direction = my_rotary.state.direction;
+  return snapshot;
+}
+
+
+double ns_rot::getVelocity(ns_rot::Obj& my_rotary){
+  ns_rot::Snapshot snapshot = ns_rot::getSnapshot(my_rotary);
+  ns_rot::Velocity& velocity = my_rotary.velocity;
+
+  long counts = snapshot.pos - velocity.pos;
+  unsigned long window = snapshot.time - velocity.time;
+
+  // Fast: counts between two edge time stamps
+  if (abs(counts) >= ns_rot::VELOCITY_MIN_COUNTS && window > 0 && window <= ns_rot::VELOCITY_TIMEOUT) {
+    velocity.value = counts * 1e6 / window;
+    velocity.pos = snapshot.pos;
+    velocity.time = snapshot.time;
+    return velocity.value;
+  }
+
+  // Slow: 1 count over the time between the last two edges, or over the time since the last edge if it is longer
+  unsigned long still = micros() - snapshot.time;
+  if (window > ns_rot::VELOCITY_TIMEOUT) {
+    velocity.pos = snapshot.pos;  // Too old to start the next edge count from
+    velocity.time = snapshot.time;
+  }
+
+  if (snapshot.period == 0 || still > ns_rot::VELOCITY_TIMEOUT) {
+    velocity.value = 0;
+  } else {
+    unsigned long period = (still > snapshot.period) ? still : snapshot.period;
+    velocity.value = snapshot.direction * 1e6 / period;
+  }
+  return velocity.value;
 }
 
 
@@ -67,55 +191,91 @@ double ns_rot::getRevolutions(ns_rot::Obj& my_rotary, const long& position){
 }
 
 
+long ns_rot::getMilliDegrees(ns_rot::Obj& my_rotary){
+  ns_rot::update(my_rotary);
+  return FixedPoint::scale(my_rotary.state.pos, my_rotary.convert.pos2millideg);
+}
+
+
+long ns_rot::getMilliRevolutions(ns_rot::Obj& my_rotary){
+  ns_rot::update(my_rotary);
+  return FixedPoint::scale(my_rotary.state.pos, my_rotary.convert.pos2millirev);
+}
+
+
+unsigned long ns_rot::getErrors(ns_rot::Obj& my_rotary){
+  ns_rot::update(my_rotary);
+  return my_rotary.state.errors;
+}
+
+
 void ns_rot::printPosition(ns_rot::Obj& my_rotary){
   ns_rot::update(my_rotary);
 
-  Serial.print("Encoder >> Time(millis), Counts: ");
-  Serial.print(millis());
-  Serial.print(", ");
-  Serial.println(my_rotary.state.pos);
+  Print& record = SerialLog::begin();
+  record.print("Encoder >> Time(millis), Counts: ");
+  record.print(millis());
+  record.print(", ");
+  record.println(my_rotary.state.pos);
 
-  Serial.flush(); // Makes sure that the program proceeds only after printing all statements via serial.
-                  // If you don't do this, then you will see that sometimes the statements will not be fully printed
+  SerialLog::end(); // Sent in the background, see SerialLog.h. Doesn't wait for the serial port.
 }
 
 
 void ns_rot::printAll(ns_rot::Obj& my_rotary){
   ns_rot::update(my_rotary);
 
-  Serial.print("Encoder >> Time(millis), Counts, Angle, Revolutions: ");
-  Serial.print(millis());
-  Serial.print(", ");
-  Serial.print(my_rotary.state.pos);
-  Serial.print(", ");
-  Serial.print(my_rotary.state.pos * my_rotary.convert.pos2angle);
-  Serial.print(", ");
-  Serial.println(my_rotary.state.pos * my_rotary.convert.pos2rev);
-
-  Serial.flush(); // Makes sure that the program proceeds only after printing all statements via serial.
-                  // If you don't do this, then you will see that sometimes the statements will not be fully printed
+  Print& record = SerialLog::begin();
+  record.print("Encoder >> Time(millis), Counts, Angle, Revolutions: ");
+  record.print(millis());
+  record.print(", ");
+  record.print(my_rotary.state.pos);
+  record.print(", ");
+  record.print(my_rotary.state.pos * my_rotary.convert.pos2angle);
+  record.print(", ");
+  record.println(my_rotary.state.pos * my_rotary.convert.pos2rev);
+
+  SerialLog::end(); // Sent in the background, see SerialLog.h. Doesn't wait for the serial port.
 }
 
 
-void doEncoderChannelA() {
-  /* For channel A, if A and B are both high or both low, it is spinning
-     forward. If they're different, it's going backward.
+static inline void decode(Decoder& decoder) {
+  /* If A and B are both high or both low after an edge of channel A, or different
+     after an edge of channel B, it is spinning forward. The table gives the same,
+     without having to know which channel changed.
   */
-  if (digitalRead(ns_rot::pins[0]) == digitalRead(ns_rot::pins[1])) {
-    ns_rot::state.pos++;
-  } else {
-    ns_rot::state.pos--;
+  uint8_t input_a = *decoder.pin_reg[0];
+  uint8_t input_b = (decoder.pin_reg[1] == decoder.pin_reg[0]) ? input_a : *decoder.pin_reg[1]; // Same port: read it once
+  uint8_t reading = ((input_a & decoder.pin_mask[0]) ? 2 : 0) | ((input_b & decoder.pin_mask[1]) ? 1 : 0);
+
+  int8_t change = transition[(decoder.last_reading << 2) | reading];
+  decoder.last_reading = reading;
+
+  if (change == ILLEGAL) {
+    decoder.state.errors++;
+  } else if (change != 0) {
+    unsigned long now = edgeTime();
+    decoder.state.pos += change;
+    decoder.state.edge_period = (change == decoder.state.direction) ? now - decoder.state.last_edge : 0; // Not a period if it turned back
+    decoder.state.last_edge = now;
+    decoder.state.direction = change;
   }
 }
 
 
-void doEncoderChannelB() {
-  /* For channel B, if A and B are both high or both low, it is spinning
-     backward. If they're different, it's going forward.
-  */
-  if (digitalRead(ns_rot::pins[0]) == digitalRead(ns_rot::pins[1])) {
-    ns_rot::state.pos--;
-  } else {
-    ns_rot::state.pos++;
+// A pin of the group changed. Only the encoders that have a pin in it are decoded,
+// the ones that didn't move see the same reading as before and don't change.
+static inline void dispatch(const uint8_t& group) {
+  uint8_t list = group_decoders[group];
+  for (uint8_t i = 0; list != 0; i++, list >>= 1) {
+    if (list & 1) {
+      decode(decoders[i]);
+    }
   }
-}
\ No newline at end of file
+}
+
+
+// Pin change interrupts: port B (pins 8-13), port C (A0-A5), port D (pins 0-7)
+ISR(PCINT0_vect) { dispatch(0); }
+ISR(PCINT1_vect) { dispatch(1); }
+ISR(PCINT2_vect) { dispatch(2); }
@@ -14,15 +14,32 @@
 	signals from channels A and B respectively. This can be used when there is a lot of
 	noise in the signals.
 
-	In order to faithfully track the position of the encoder, the channels A and B must be
-	connected to the external digital interrupt pins of the micrcontroller. This library
-	keeps track of the encoder position using digital interrupts.
-
-	For Arduino UNO only pins 2 and 3 are external interrupt pins.
-	See https://www.arduino.cc/reference/en/language/functions/external-interrupts/attachinterrupt/
+	In order to faithfully track the position of the encoder, the channels A and B must
+	trigger an interrupt whenever they change. This library uses the pin change interrupts,
+	which every digital and analog pin of the Arduino UNO has, so the encoder can be
+	connected to any two pins (not only to the external interrupt pins 2 and 3). The pins
+	are grouped by port: pins 8-13 (PCINT0), A0-A5 (PCINT1) and pins 0-7 (PCINT2), each
+	group has a single interrupt. Up to MAX_ENCODERS encoders can be tracked at the same
+	time, e.g., the encoder of the linear actuator on pins 2 and 3 and the one of a load
+	cell stage on pins 8 and 9. Encoders on different groups don't slow each other down.
+	See https://playground.arduino.cc/Main/PinChangeInterrupt/
+
+	Note: 
+	The pin change interrupt vectors are defined by this library, so it can't be used
+	together with other libraries that define them, like SoftwareSerial. Pins 0 and 1
+	are the serial port.
 
 	This code has been inspired from: https://playground.arduino.cc/Main/RotaryEncoders/
 
+	Decoding:
+	Both channels trigger the interrupt of their group. It reads the two channels straight from
+	the PIN register of their port (no digitalRead()), puts them together with the
+	previous reading as a 4 bit index and looks up the change in position in a 16 entry
+	transition table. If both channels changed since the last interrupt, an edge was
+	missed (the interrupt came too late, e.g., because another interrupt was running).
+	This "illegal" transition doesn't change the position, it is counted as an error
+	instead, see "getErrors". If it is not 0, the position can't be trusted.
+
 
 
 
@@ -31,11 +48,10 @@
 	and State. In order to get the struct object pass in the required parameters
 	(pins[2] and encoder's counts per revolution) as arguments to the "init" function.
 
-	I also maintain separate "pins[2]" and "position" variables (local to this file, hence "static") that helps
-	to run ISR function, since I cannot pass arguments to the ISR. 
-
-	Note that I'm also creating just a single pins[2] and position since for each arduino I can use only 1 encoder 
-	(because of the availability of external interrupt pins), so I cannot scale the library to add more encoders.
+	I also maintain a separate array of pin registers, previous reading and "state" variables (local to
+	"RotaryEncoder.cpp", hence "static") that helps to run ISR function, since I cannot pass arguments to the ISR.
+	Each encoder gets one entry of the array, the "id" of its struct object is the index. For each pin change
+	group there is a list of the encoders that have a pin in it, the ISR of the group decodes only those.
 
 	I update the struct object with the "position" variable using the "update" function. You, the programmer can
 	choose to directly use the "pos" variable AFTER calling the update function:
@@ -43,10 +59,29 @@
 	update(Object);
 	long position = Object.state.pos;
 
-	OR use the libraries in-built functions like "getPosition", "getAngle", "getRevolutions" to get the updated values:
+	OR use the libraries in-built functions like "getPosition", "getAngle", "getRevolutions" (or "getMilliDegrees",
+	"getMilliRevolutions", which are integers and skip the floating point) to get the updated values:
 	long position = getPosition(Object); // This gives the updated value always.
 
 	The libraries in-built "printPosition" and "printAll" also updates the state and then prints via serial.
+	They print through "SerialLog" (see SerialLog.h), so they return right away instead of waiting for the
+	serial port to send the text.
+
+	Snapshots:
+	The position is a 4 byte variable that the ISR changes at any moment, while the arduino reads it 1 byte
+	at a time. "update" (and so all the functions above) copies it with the interrupts turned off for the few
+	cycles the copy takes, so the value is never half old and half new. "getSnapshot" gives the same copy
+	together with the time (micros) of the edge that gave this position and the time between the last two
+	edges, which the ISR stamps on every edge from the registers of Timer0 (the same clock as micros()).
+
+	Velocity:
+	"getVelocity" estimates the speed in counts per second from the snapshots, choosing the method by speed:
+	- Fast: when at least VELOCITY_MIN_COUNTS counts went by since the previous estimate, the counts are
+	  divided by the time between the edges at both ends (edge count method). 
+	- Slow: otherwise it is 1 count over the time between the last two edges (edge period method). If the
+	  encoder has been still for longer than that, the speed can't be higher than 1 count over that time, and
+	  after VELOCITY_TIMEOUT it is 0.
+	Both use the edge time stamps, not the time of the call, so calling it at an irregular rate is fine.
 	
 	
 	Created by Rahul Subramonian Bama, June 19, 2019
@@ -55,6 +90,7 @@
 
 
 #include "Arduino.h"
+#include "FixedPoint.h"
 
 
 #ifndef ROTARYENCODER_H
@@ -71,26 +107,49 @@ namespace Sensor{
 			struct ConversionFactor	{ 
 				double pos2angle; 
 				double pos2rev; 
+				FixedPoint::Scale pos2millideg; // Same as above in thousandths, for the integer math (see FixedPoint.h)
+				FixedPoint::Scale pos2millirev;
 			};
 
 			struct State { 
 				volatile long pos; 
+				volatile unsigned long errors; // Num of illegal transitions, i.e., edges that were missed
+				volatile unsigned long last_edge; // Time in us of the last edge
+				volatile unsigned long edge_period; // Time in us between the last two edges, 0 if there aren't two yet
+				volatile int8_t direction; // Of the last edge: 1 or -1
+			};
+
+			struct Snapshot {
+				long pos;
+				unsigned long time;   // Time in us (micros) of the edge that gave this position
+				unsigned long period; // Time in us between that edge and the one before, 0 if unknown
+				int8_t direction;     // Of that edge: 1 or -1
+			};
+
+			struct Velocity {
+				long pos;           // Snapshot at which the last edge count estimate ended
+				unsigned long time;
+				double value;       // Last estimate in counts per second
 			};
 
+			static const uint8_t VELOCITY_MIN_COUNTS = 8; // Counts since the last estimate to use the edge count method
+			static const unsigned long VELOCITY_TIMEOUT = 100000; // in us. No edge for this long: the velocity is 0
+
+			static const uint8_t MAX_ENCODERS = 4; // Num of encoders that can be tracked at the same time
+
 			typedef struct MyObj{
+				uint8_t id; // This is an unique ID for each encoder that you create
 				// I'm not declaring settings and convert as const because of the extra 
 				// code that I have to write as constructor especially to copy arrays and structs.
 				// The programmer must promise that he/she won't be changing these values.
 				Settings settings; 
 				ConversionFactor convert;
 				State state;
+				Velocity velocity;
 			} Obj;
 
-			static uint8_t pins[2];	// I'm creating "static" because I cannot pass args to ISR.
-			static State state;	    // Also note that I can only use 1 encoder/arduino. 
-			
 			// I'm returning an Object of encoder so that I can pass it to other systems.
-			Obj init(const uint8_t (&pins)[2], const uint16_t& cpr); // Send external interrupt pins and 
+			Obj init(const uint8_t (&pins)[2], const uint16_t& cpr); // Send the pins of channel A and B and 
 																	 // counts per revolution of encoder as args
 			void update(Obj& my_rotary); // You MUST call this function to get the most updated values if you are
 										 // directly reading the Obj values like: my_rotary.state.pos; else
@@ -101,6 +160,11 @@ namespace Sensor{
 			double getAngle(Obj& my_rotary);  // Updates and sends counts of encoder converted to angles in degrees not radians
 			double getRevolutions(Obj& my_rotary); // Updates and sends counts in num of revolutions: Counts/CPR
 			double getRevolutions(Obj& my_rotary, const long& position); // Gives num of revolutions for a given position
+			long getMilliDegrees(Obj& my_rotary);     // Same as "getAngle" in thousandths of a degree, without floating point
+			long getMilliRevolutions(Obj& my_rotary); // Same as "getRevolutions" in thousandths of a revolution, without floating point
+			unsigned long getErrors(Obj& my_rotary); // Updates and sends the num of illegal transitions seen so far
+			Snapshot getSnapshot(Obj& my_rotary); // Updates and sends the position with the time of its edge, see "Snapshots"
+			double getVelocity(Obj& my_rotary); // Updates and sends the estimated velocity in counts/s, see "Velocity"
 
 			void printPosition(Obj& my_rotary); // Updates and prints time and position via serial
 			void printAll(Obj& my_rotary);     // Updates and prints time, position, angle and revolutions via serial
@@ -109,11 +173,6 @@ namespace Sensor{
 }
 
 
-// Encoder digital interrupt functions
-static void doEncoderChannelA();	// They are declared outside the namespace because ISR needs the function to be global
-static void doEncoderChannelB();	// ISR: Interrupt Service Routine.
-
-
 // Set the namespace as library name so that it is easier to access the functions
 namespace RotaryEncoder = Sensor::Encoder::Rotary;
 
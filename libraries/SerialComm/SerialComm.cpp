@@ -6,6 +6,7 @@
  */
 
 #include "SerialComm.h"
+#include "SerialLog.h"
 
 void Communication::MySerial::waitForSignal(){
 	// Wait till arduino receives a serial data
@@ -13,5 +14,163 @@ void Communication::MySerial::waitForSignal(){
 	{ 
 	if (Serial.available()>0)
 	    break;    
+	SerialLog::drain(); // Meanwhile send what is still in the log
 	}
-}
\ No newline at end of file
+}
+
+
+// Num of characters of the line that "readLine" has received so far
+static uint8_t line_length = 0;
+
+
+bool Communication::MySerial::readLine(char* line, const uint8_t& size){
+
+	while (Serial.available() > 0){
+		char c = Serial.read();
+
+		if (c == '\n'){
+			line[line_length] = '\0';
+			line_length = 0;
+			return true;
+		}
+		// Characters that don't fit are dropped, the line is cut
+		if (c != '\r' && line_length < size - 1){
+			line[line_length++] = c;
+		}
+	}
+	return false;
+}
+
+
+// Sequence number of the next frame, wraps around
+static uint16_t sequence = 0;
+
+
+void Communication::MySerial::sendFrame(const uint8_t& type, const uint8_t* payload, const uint8_t& length){
+
+	uint8_t frame[SerialFrame::HEADER_SIZE + SerialFrame::MAX_PAYLOAD + SerialFrame::CRC_SIZE];
+	uint8_t size = (length > SerialFrame::MAX_PAYLOAD) ? SerialFrame::MAX_PAYLOAD : length;
+
+	frame[0] = SerialFrame::SYNC_1;
+	frame[1] = SerialFrame::SYNC_2;
+	frame[2] = type;
+	frame[3] = static_cast<uint8_t>(sequence);
+	frame[4] = static_cast<uint8_t>(sequence >> 8);
+	frame[5] = size;
+	memcpy(frame + SerialFrame::HEADER_SIZE, payload, size);
+
+	// The CRC covers everything after the sync bytes
+	uint16_t crc = SerialFrame::crc16(frame + 2, SerialFrame::HEADER_SIZE - 2 + size);
+	frame[SerialFrame::HEADER_SIZE + size]     = static_cast<uint8_t>(crc);
+	frame[SerialFrame::HEADER_SIZE + size + 1] = static_cast<uint8_t>(crc >> 8);
+
+	// In one go, it is much faster than byte by byte
+	Serial.write(frame, SerialFrame::HEADER_SIZE + size + SerialFrame::CRC_SIZE);
+	sequence++;
+}
+
+
+void Communication::MySerial::sendSample(const SerialFrame::Sample& sample){
+	Communication::MySerial::sendSamples(&sample, 1);
+}
+
+
+void Communication::MySerial::sendSamples(const SerialFrame::Sample samples[], const uint8_t& num_samples){
+
+	uint8_t payload[SerialFrame::MAX_PAYLOAD];
+	uint8_t count = (num_samples > SAMPLES_PER_FRAME) ? SAMPLES_PER_FRAME : num_samples;
+
+	for (uint8_t i = 0; i < count; i++){
+		SerialFrame::packSample(samples[i], payload + i*SerialFrame::SAMPLE_SIZE);
+	}
+	Communication::MySerial::sendFrame(SerialFrame::TYPE_SAMPLE, payload, count*SerialFrame::SAMPLE_SIZE);
+}
+
+
+// Frame of TYPE_DELTA that "streamSample" fills, the last sample in it and its time step. Samples that didn't change
+// are counted in "stream_run" and written as one RUN record before the next record (or at the end of the frame).
+static uint8_t stream[SerialFrame::MAX_PAYLOAD];
+static uint8_t stream_length = 0;
+static SerialFrame::Sample stream_last;
+static uint32_t stream_step = 0;
+static uint16_t stream_run = 0;
+
+static const uint8_t RUN_SIZE = 2; // Most bytes the RUN record takes, always kept free while there is a run
+
+
+static void putRun(){
+	if (stream_run > 0){
+		uint32_t tag = (static_cast<uint32_t>(stream_run) << 2) | SerialFrame::TAG_RUN;
+		stream_length += SerialFrame::putVarint(tag, stream + stream_length);
+		stream_run = 0;
+	}
+}
+
+
+void Communication::MySerial::streamSample(const SerialFrame::Sample& sample){
+
+	if (stream_length > 0){
+		// Differences in unsigned math: the time wraps around after 71 minutes, so does the difference
+		uint32_t step = sample.time - stream_last.time;
+		int32_t step_change = static_cast<int32_t>(step - stream_step);
+		int32_t position_change = static_cast<int32_t>(static_cast<uint32_t>(sample.position) - static_cast<uint32_t>(stream_last.position));
+		int32_t analog_change = static_cast<int32_t>(sample.analog) - stream_last.analog;
+
+		if (step_change == 0 && position_change == 0 && analog_change == 0){
+			if (stream_run > 0 || stream_length + RUN_SIZE <= SerialFrame::MAX_PAYLOAD){
+				stream_last = sample;
+				if (++stream_run == SerialFrame::MAX_RUN){
+					putRun();
+				}
+				return;
+			}
+		}
+		else if (step_change <= static_cast<int32_t>(SerialFrame::MAX_STEP_CHANGE) && step_change >= -static_cast<int32_t>(SerialFrame::MAX_STEP_CHANGE)){
+			const int8_t SMALL = SerialFrame::MAX_SMALL_CHANGE;
+			uint8_t record[3 * SerialFrame::MAX_VARINT_SIZE];
+			uint8_t size;
+			if (step_change == 0 && position_change >= -SMALL && position_change <= SMALL && analog_change >= -SMALL && analog_change <= SMALL){
+				uint8_t code = 1 + (position_change + SMALL) * (2*SMALL + 1) + (analog_change + SMALL);
+				record[0] = (code << 2) | SerialFrame::TAG_SMALL;
+				size = 1;
+			}
+			else {
+				size  = SerialFrame::putVarint(SerialFrame::zigzag(step_change) << 1, record);
+				size += SerialFrame::putVarint(SerialFrame::zigzag(position_change), record + size);
+				size += SerialFrame::putVarint(SerialFrame::zigzag(analog_change), record + size);
+			}
+
+			if (stream_length + ((stream_run > 0) ? RUN_SIZE : 0) + size <= SerialFrame::MAX_PAYLOAD){
+				putRun();
+				memcpy(stream + stream_length, record, size);
+				stream_length += size;
+				stream_last = sample;
+				stream_step = step;
+				return;
+			}
+		}
+		// Doesn't fit (or the time jumped): this frame is done, the sample starts the next one
+		Communication::MySerial::flushSamples();
+	}
+
+	stream[0] = SerialFrame::TAG_KEY;
+	SerialFrame::packSample(sample, stream + 1);
+	stream_length = SerialFrame::KEY_SIZE;
+	stream_last = sample;
+	stream_step = 0;
+}
+
+
+void Communication::MySerial::flushSamples(){
+	if (stream_length == 0){
+		return;
+	}
+	putRun();
+	Communication::MySerial::sendFrame(SerialFrame::TYPE_DELTA, stream, stream_length);
+	stream_length = 0;
+}
+
+
+uint16_t Communication::MySerial::getSequence(){
+	return sequence;
+}
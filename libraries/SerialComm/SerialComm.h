@@ -1,5 +1,24 @@
 /*
 	This code gives general communication functions with PC via Serial
+
+	Binary frames:
+	Printing numbers as text takes about 25 bytes per sample (time, position
+	and analog value with the spaces and the new line) and the PC has to
+	parse them back. "sendSamples" sends them in binary frames instead (see
+	SerialFrame.h for the layout): 10 bytes per sample plus 8 bytes of
+	header and CRC per frame. Up to SAMPLES_PER_FRAME samples can share a
+	frame. The frames are numbered, so the PC knows which ones got lost,
+	and a CRC tells a corrupted frame apart. See host/FrameDecoder for the
+	decoder on the PC.
+
+	Delta frames:
+	"streamSample" sends the changes from one sample to the next instead of
+	the samples themselves (TYPE_DELTA, see SerialFrame.h), about 3 bytes
+	per sample while the values change a little, less while they don't
+	change at all, e.g., 4 to 6 times more samples per second on the same
+	baud rate. The samples are collected till the frame is full, call
+	"flushSamples" every few ms so that the PC gets them in time when they
+	come in slowly. Send samples in one way or the other, not both mixed.
 	
 	Created by Rahul Subramonian Bama, April 20, 2019
 	GNU GPL License
@@ -7,6 +26,7 @@
 
 
 #include "Arduino.h"
+#include "SerialFrame.h"
 
 #ifndef SERIALCOMM_H
 #define SERIALCOMM_H
@@ -14,6 +34,17 @@
 namespace Communication{
 	namespace MySerial{
 		void waitForSignal();
+		bool readLine(char* line, const uint8_t& size); // Doesn't wait. True when a whole line is in "line", without the new line
+
+		static const uint8_t SAMPLES_PER_FRAME = SerialFrame::MAX_PAYLOAD / SerialFrame::SAMPLE_SIZE;
+
+		// Sends a frame with the given type and payload (up to SerialFrame::MAX_PAYLOAD bytes, the rest is cut)
+		void sendFrame(const uint8_t& type, const uint8_t* payload, const uint8_t& length);
+		void sendSample(const SerialFrame::Sample& sample);
+		void sendSamples(const SerialFrame::Sample samples[], const uint8_t& num_samples); // Up to SAMPLES_PER_FRAME in one frame
+		void streamSample(const SerialFrame::Sample& sample); // Delta compressed, sent when the frame is full, see "Delta frames"
+		void flushSamples(); // Sends the samples that "streamSample" holds right away
+		uint16_t getSequence(); // Sequence number of the next frame
 	}
 }
 
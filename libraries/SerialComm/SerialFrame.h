@@ -0,0 +1,161 @@
+/*
+	SerialFrame.h - Layout of the binary frames that "SerialComm" sends
+	to the PC. This file doesn't depend on Arduino, so that the decoder
+	on the PC (see host/FrameDecoder) uses the very same definitions.
+
+	Frame:
+	| 0xA5 | 0x5A | type | seq (2) | length | payload (length) | crc (2) |
+
+	The two sync bytes mark the start of a frame. "seq" is incremented for
+	every frame that is sent, so a gap in the sequence tells exactly how
+	many frames were lost. "crc" is a CRC-16/CCITT (polynomial 0x1021,
+	initial value 0xFFFF) of everything from "type" to the end of the
+	payload. Numbers that take more than one byte are little endian (the
+	byte order of the AVR).
+
+	Records:
+	The payload is one or more records of the type given in the header,
+	each with a fixed layout. The records are packed byte by byte with
+	"pack"/"unpack" instead of copying structs, because the PC pads and
+	aligns structs differently than the AVR.
+
+	Delta frames (TYPE_DELTA):
+	Samples in a row differ by a few counts and an almost constant time
+	step, so most of the 10 bytes of a TYPE_SAMPLE record repeat what the
+	PC already knows. The payload of a TYPE_DELTA frame is a list of
+	records that each start with a varint "tag":
+	- KEY (tag 3): the next 10 bytes are a whole sample (packSample). Every
+	  frame starts with one, so a lost frame only loses its own samples.
+	- DELTA (tag bit 0 is 0): tag >> 1 is the zigzag of the change of the
+	  time step (this time step - the one before, 0 right after a KEY),
+	  then the zigzag varints of the change of position and analog value.
+	- RUN (tag bits 1-0 are 01): tag >> 2 (1 to MAX_RUN) samples in which
+	  nothing changed but the time, by the same time step as before.
+	- SMALL (tag bits 1-0 are 11, tag >> 2 from 1 to 25): the same time
+	  step as before and a change of position and of analog value of -2 to
+	  2 each, packed in the tag as 1 + (position + 2) * 5 + (analog + 2).
+	A varint takes 7 bits per byte, low bits first, the top bit set on all
+	bytes but the last. Zigzag maps 0, -1, 1, -2 ... to 0, 1, 2, 3 ..., so
+	small changes either way fit in one byte. A sample that changed a little
+	takes 1 byte (SMALL), a steady one 3 bytes (DELTA) and a sample that
+	didn't change is part of a 1 or 2 byte RUN.
+
+
+	GNU GPL License
+ */
+
+
+#include <stdint.h>
+
+
+#ifndef SERIALFRAME_H
+#define SERIALFRAME_H
+
+namespace Communication{
+	namespace Frame{
+
+		static const uint8_t SYNC_1 = 0xA5;
+		static const uint8_t SYNC_2 = 0x5A;
+		static const uint8_t HEADER_SIZE = 6;  // sync bytes, type, seq and length
+		static const uint8_t CRC_SIZE    = 2;
+		static const uint8_t MAX_PAYLOAD = 60; // A frame is never longer than HEADER_SIZE + MAX_PAYLOAD + CRC_SIZE
+
+		enum Type { TYPE_SAMPLE = 1, TYPE_DELTA = 2 };
+
+		// Record of TYPE_SAMPLE: time stamp in micro seconds, encoder position and analog reading
+		struct Sample{
+			uint32_t time;
+			int32_t position;
+			uint16_t analog;
+		};
+		static const uint8_t SAMPLE_SIZE = 10;
+
+		// Records of TYPE_DELTA
+		static const uint8_t TAG_KEY = 3;
+		static const uint8_t TAG_RUN = 1;     // In bits 1-0 of the tag, the length is above them
+		static const uint8_t TAG_SMALL = 3;   // In bits 1-0 of the tag, the changes are above them (never 0, that is TAG_KEY)
+		static const int8_t MAX_SMALL_CHANGE = 2;
+		static const uint16_t MAX_RUN = 4095; // So that the tag of a RUN takes 2 bytes at most
+		static const uint8_t KEY_SIZE = 1 + SAMPLE_SIZE;
+		static const uint8_t MAX_VARINT_SIZE = 5; // Of a 32 bit number
+		static const uint32_t MAX_STEP_CHANGE = 0x3FFFFFFF; // Larger changes of the time step are sent as a KEY
+
+
+		inline uint16_t crc16(uint16_t crc, const uint8_t& data){
+			crc ^= static_cast<uint16_t>(data) << 8;
+			for (uint8_t i = 0; i < 8; i++){
+				crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+			}
+			return crc;
+		}
+
+		inline uint16_t crc16(const uint8_t* data, const uint8_t& length){
+			uint16_t crc = 0xFFFF;
+			for (uint8_t i = 0; i < length; i++){
+				crc = crc16(crc, data[i]);
+			}
+			return crc;
+		}
+
+
+		inline void packSample(const Sample& sample, uint8_t* buffer){
+			for (uint8_t i = 0; i < 4; i++){
+				buffer[i]     = static_cast<uint8_t>(sample.time >> (8*i));
+				buffer[4 + i] = static_cast<uint8_t>(static_cast<uint32_t>(sample.position) >> (8*i));
+			}
+			buffer[8] = static_cast<uint8_t>(sample.analog);
+			buffer[9] = static_cast<uint8_t>(sample.analog >> 8);
+		}
+
+		inline Sample unpackSample(const uint8_t* buffer){
+			Sample sample;
+			uint32_t position = 0;
+			sample.time = 0;
+			for (uint8_t i = 0; i < 4; i++){
+				sample.time |= static_cast<uint32_t>(buffer[i]) << (8*i);
+				position    |= static_cast<uint32_t>(buffer[4 + i]) << (8*i);
+			}
+			sample.position = static_cast<int32_t>(position);
+			sample.analog   = buffer[8] | (static_cast<uint16_t>(buffer[9]) << 8);
+			return sample;
+		}
+
+
+		inline uint32_t zigzag(const int32_t& value){
+			return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+		}
+
+		inline int32_t unzigzag(const uint32_t& value){
+			return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+		}
+
+		// Writes "value" as a varint to "buffer", returns the num of bytes (1 to MAX_VARINT_SIZE)
+		inline uint8_t putVarint(uint32_t value, uint8_t* buffer){
+			uint8_t size = 0;
+			while (value >= 0x80){
+				buffer[size++] = static_cast<uint8_t>(value) | 0x80;
+				value >>= 7;
+			}
+			buffer[size++] = static_cast<uint8_t>(value);
+			return size;
+		}
+
+		// Reads a varint from "buffer" of "length" bytes, returns the num of bytes read or 0 if it is cut or too long
+		inline uint8_t getVarint(const uint8_t* buffer, const uint8_t& length, uint32_t& value){
+			value = 0;
+			for (uint8_t i = 0; i < length && i < MAX_VARINT_SIZE; i++){
+				value |= static_cast<uint32_t>(buffer[i] & 0x7F) << (7*i);
+				if (!(buffer[i] & 0x80)){
+					return i + 1;
+				}
+			}
+			return 0;
+		}
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace SerialFrame = Communication::Frame;
+
+#endif
@@ -0,0 +1,91 @@
+/*
+	SerialLog.h - Logging via Serial that never makes the caller wait.
+
+	GNU GPL License
+ */
+
+#include "SerialLog.h"
+
+
+namespace ns_log = Communication::Log;
+
+static const uint16_t MASK = ns_log::BUFFER_SIZE - 1;
+
+
+// The ring buffer. Bytes from "tail" to "head" are waiting to be sent, the record that is
+// being written goes from "head" to "record_head" till it is ended.
+static uint8_t buffer[ns_log::BUFFER_SIZE];
+static uint16_t head = 0;
+static uint16_t tail = 0;
+static uint16_t record_head = 0;
+static bool record_full = false;
+static uint16_t overflows = 0;
+
+
+// Formats into the ring buffer. A byte that doesn't fit marks the whole record as lost.
+class Writer : public Print {
+  public:
+	size_t write(uint8_t data){
+		uint16_t next = (record_head + 1) & MASK;
+		if (record_full || next == tail){
+			record_full = true;
+			return 0;
+		}
+
+		buffer[record_head] = data;
+		record_head = next;
+		return 1;
+	}
+};
+
+static Writer writer;
+
+
+Print& ns_log::begin(){
+	record_head = head;
+	record_full = false;
+
+	return writer;
+}
+
+
+void ns_log::end(){
+	if (record_full){
+		if (overflows < 0xFFFF){
+			overflows++;
+		}
+	}
+	else {
+		head = record_head;
+	}
+}
+
+
+void ns_log::drain(){
+	int room = Serial.availableForWrite();
+
+	while (room > 0 && tail != head){
+		Serial.write(buffer[tail]);
+		tail = (tail + 1) & MASK;
+		room--;
+	}
+}
+
+
+void ns_log::flush(){
+	while (tail != head){
+		ns_log::drain();
+		yield();
+	}
+	Serial.flush();
+}
+
+
+uint16_t ns_log::getOverflows(){
+	return overflows;
+}
+
+
+uint16_t ns_log::getPending(){
+	return (head - tail) & MASK;
+}
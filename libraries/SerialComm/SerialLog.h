@@ -0,0 +1,68 @@
+/*
+	SerialLog.h - Logging via Serial that never makes the caller wait.
+
+	Why:
+	"Serial.flush()" after every status message waits till the UART has sent
+	all of it, which takes about 0.5 ms for 100 bytes even at 2 Mbaud, and
+	"Serial.print" itself waits whenever the 64 byte transmit buffer of the
+	Arduino core is full. When the message is printed right before a move,
+	that time is added to the move.
+
+	How:
+	A record (one message) is formatted into a RAM ring buffer of
+	BUFFER_SIZE bytes instead, which takes a few micro seconds. "drain"
+	copies to Serial only as many bytes as its transmit buffer can take
+	without waiting (Serial.availableForWrite), and the UART data register
+	empty interrupt of the core sends them from there. Copying takes time
+	too (a few micro seconds per byte), so "end" doesn't do it. "drain" is
+	called from the places where the libraries wait anyway (moves, waiting
+	for serial input), i.e., from idle time. Call it in loop() too if the
+	sketch doesn't wait on anything, or "flush" to send everything now.
+
+	If a record doesn't fit in what is left of the buffer, the whole record
+	is dropped and counted in "getOverflows", so a full buffer never blocks
+	and the records that are sent are always complete.
+
+	Usage:
+	Print& record = SerialLog::begin();
+	record.print("Something >> Value: ");
+	record.println(value);
+	SerialLog::end();
+
+	Note:
+	Only log from the main program, not from interrupts. Text printed
+	directly with Serial can overtake records that are still in the buffer,
+	call "flush" before it if the order matters.
+
+
+	GNU GPL License
+ */
+
+
+#include "Arduino.h"
+
+
+#ifndef SERIALLOG_H
+#define SERIALLOG_H
+
+namespace Communication{
+	namespace Log{
+
+		static const uint16_t BUFFER_SIZE = 256; // Power of 2. Max length of a record is BUFFER_SIZE - 1
+
+		Print& begin(); // Starts a record, print it to the returned object
+		void end(); // Ends the record: it is sent from now on, or dropped if it didn't fit
+
+		void drain(); // Sends what Serial can take without waiting
+		void flush(); // Waits till everything is sent, like Serial.flush()
+
+		uint16_t getOverflows(); // Num of records dropped because the buffer was full
+		uint16_t getPending(); // Num of bytes in the buffer that are still to be sent
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace SerialLog = Communication::Log;
+
+#endif
@@ -0,0 +1,119 @@
+/*
+	StepTimer.h - Library that calls a function from the Timer1 compare
+	match interrupt, at an interval that the function itself decides.
+
+	GNU GPL License
+ */
+
+#include "StepTimer.h"
+
+
+namespace ns_tim = Timing::StepTimer;
+
+
+// I'm creating "static" because I cannot pass args to ISR. Index is the channel.
+static ns_tim::Callback volatile callbacks[2] = { 0, 0 };
+static uint32_t remaining[2] = { 0, 0 }; // Ticks of the current interval that are still to be scheduled
+
+
+// Adds the interval (or the first part of it, if it is too long) to the compare register of the channel
+static void schedule(const uint8_t& channel, uint32_t ticks){
+	if (ticks > 0x7FFF){
+		remaining[channel] = ticks - 0x4000;
+		ticks = 0x4000;
+	}
+	else {
+		remaining[channel] = 0;
+	}
+
+	volatile uint16_t& ocr = (channel == ns_tim::CHANNEL_A) ? OCR1A : OCR1B;
+	uint16_t next = ocr + ticks;
+
+	// If the compare value is already behind the timer (callback was late), the match would
+	// only happen after the timer overflows. Fire as soon as possible instead.
+	if (static_cast<int16_t>(next - TCNT1) < static_cast<int16_t>(ns_tim::MIN_INTERVAL / 2)){
+		next = TCNT1 + ns_tim::MIN_INTERVAL;
+	}
+	ocr = next;
+}
+
+
+static void serve(const uint8_t& channel){
+	if (remaining[channel] > 0){
+		schedule(channel, remaining[channel]);
+		return;
+	}
+
+	uint32_t next = (callbacks[channel] != 0) ? callbacks[channel]() : 0;
+
+	if (next == 0){
+		TIMSK1 &= ~(1 << ((channel == ns_tim::CHANNEL_A) ? OCIE1A : OCIE1B));
+		callbacks[channel] = 0;
+	}
+	else {
+		schedule(channel, next);
+	}
+}
+
+
+void ns_tim::start(const ns_tim::Channel& channel, ns_tim::Callback callback, const uint32_t& first_interval){
+	uint8_t sreg = SREG;
+	cli();
+
+	// Normal mode, prescaler of 8. Same for both channels, so it doesn't matter if the other one is running
+	TCCR1A = 0;
+	TCCR1B = (1 << CS11);
+
+	callbacks[channel] = callback;
+	if (channel == ns_tim::CHANNEL_A){
+		OCR1A = TCNT1;
+	}
+	else {
+		OCR1B = TCNT1;
+	}
+	schedule(channel, (first_interval < ns_tim::MIN_INTERVAL) ? ns_tim::MIN_INTERVAL : first_interval);
+
+	// Clear a compare match that happened before, and enable the interrupt
+	if (channel == ns_tim::CHANNEL_A){
+		TIFR1 = (1 << OCF1A);
+		TIMSK1 |= (1 << OCIE1A);
+	}
+	else {
+		TIFR1 = (1 << OCF1B);
+		TIMSK1 |= (1 << OCIE1B);
+	}
+
+	SREG = sreg;
+}
+
+
+void ns_tim::stop(const ns_tim::Channel& channel){
+	uint8_t sreg = SREG;
+	cli();
+
+	TIMSK1 &= ~(1 << ((channel == ns_tim::CHANNEL_A) ? OCIE1A : OCIE1B));
+	callbacks[channel] = 0;
+	remaining[channel] = 0;
+
+	SREG = sreg;
+}
+
+
+bool ns_tim::isRunning(const ns_tim::Channel& channel){
+	return TIMSK1 & (1 << ((channel == ns_tim::CHANNEL_A) ? OCIE1A : OCIE1B));
+}
+
+
+uint32_t ns_tim::usToTicks(const uint32_t& us){
+	return us * (ns_tim::TICKS_PER_SEC / 1000000UL);
+}
+
+
+// Timer1 compare match interrupts
+ISR(TIMER1_COMPA_vect){
+	serve(ns_tim::CHANNEL_A);
+}
+
+ISR(TIMER1_COMPB_vect){
+	serve(ns_tim::CHANNEL_B);
+}
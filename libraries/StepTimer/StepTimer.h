@@ -0,0 +1,71 @@
+/*
+	StepTimer.h - Library that calls a function from the Timer1 compare
+	match interrupt, at an interval that the function itself decides every
+	time it is called. This is what moves the stepper motor in the background
+	(see Stepper::stepAsync and LinActStepper::moveAsync), so that the sketch
+	can print, parse commands or read the encoder while the motor is moving.
+
+	About Timer1:
+	Timer1 is left free running (normal mode) with a prescaler of 8, i.e.,
+	one tick is 0.5 us for a 16 MHz Arduino. Both compare units of the timer
+	(A and B) can be used, each one is a "channel" with its own callback.
+	A channel is rescheduled by adding the next interval to its compare
+	register, NOT by resetting the timer. This way the time taken to enter
+	and execute the ISR doesn't add up from one interval to the next, and
+	the two channels don't disturb each other.
+
+	Intervals longer than what the 16 bit compare register can hold (32.7 ms)
+	are split into several compare matches. The callback is only called
+	when the full interval has elapsed.
+
+	Note:
+	Once a channel is started, Timer1 cannot be used for anything else: PWM
+	on pins 9 and 10 (analogWrite), the Servo library, or a sketch that
+	sets up Timer1 by itself like "em_rrl_sensor". The registers used here
+	are the ones of the ATmega328p (Arduino Uno/Nano).
+
+	Keep the callbacks short, they run inside the ISR. While they run, the
+	encoder interrupts have to wait (see the note in "em_rrl_sensor.ino").
+
+
+	About Code:
+	Similar style as in RotaryEncoder.h. There is only one Timer1 per arduino,
+	so the state is kept in static variables local to "StepTimer.cpp" and
+	there is no object to pass around.
+
+
+	GNU GPL License
+ */
+
+
+#include "Arduino.h"
+
+
+#ifndef STEPTIMER_H
+#define STEPTIMER_H
+
+namespace Timing{
+	namespace StepTimer{
+
+		enum Channel { CHANNEL_A = 0, CHANNEL_B = 1 };
+
+		// Called from the ISR. Returns the num of ticks after which it has to be called again, 0 stops the channel.
+		typedef uint32_t (*Callback)();
+
+		static const uint32_t TICKS_PER_SEC = F_CPU / 8; // Timer1 ticks per second (prescaler of 8)
+		static const uint16_t MIN_INTERVAL = 40; // Shortest interval in ticks (20us). Shorter ones are stretched to this.
+
+		// Starts calling "callback" after "first_interval" ticks. Restarts the channel if it is already running.
+		void start(const Channel& channel, Callback callback, const uint32_t& first_interval);
+		void stop(const Channel& channel); // The callback is not called anymore
+		bool isRunning(const Channel& channel);
+
+		uint32_t usToTicks(const uint32_t& us); // Converts time in micro seconds to timer ticks
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace StepTimer = Timing::StepTimer;
+
+#endif
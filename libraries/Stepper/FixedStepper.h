@@ -0,0 +1,172 @@
+/*
+ * FixedStepper.h - Step function of a Stepper whose pins and microsteps
+ * are known at compile time.
+ *
+ * Stepper takes every (micro)step through the step function of its
+ * wiring (see CoilWiring in Stepper.cpp), which reads the stride through
+ * the microstep table, the coil ports and their bits from the object.
+ * FixedStepper<pins, micro steps>::step does the same step with the pins
+ * and the microsteps as template parameters, so the compiler resolves
+ * them once, and a step is a counter, the lookup in the table and the pin
+ * writes with constant addresses (an sbi/cbi instruction per coil pin on
+ * the AVR, a store to the compare register per PWM pin, see
+ * Stepper::setupPwm).
+ *
+ * Wiring (same order as the constructors of Stepper):
+ * MICRO_STEPS 1: four-wire, {pin 1, pin 2, pin 3, pin 4}
+ * MICRO_STEPS 2, 4, 8, 16 or 32: two-wire + PWM, {pin 1, pin 2, pwm pin 1, pwm pin 2}
+ *
+ * Usage:
+ *   Stepper motor;
+ *   FixedStepper<7, 4, 6, 5, 8>::init(motor, 200);
+ * "init" sets up the pins and the fields of "motor" that the moves and
+ * off() use, without the constructors of Stepper: those pick the step
+ * function of their wiring at run time (see setupCoils in Stepper.cpp),
+ * so all the wirings they can pick, with their tables and port set up,
+ * would be linked in next to this step. Everything else (speed,
+ * acceleration, the moves in the background) works as before.
+ * LinActStepper::Fixed uses it. "attach" only swaps the step function of
+ * a Stepper that was made by a constructor with the same pins and
+ * microsteps (the generic wirings stay in the flash then).
+ *
+ * The ports are worked out from the pin map of the ATmega328P/168
+ * (Uno, Nano, Pro Mini). On other boards "init" uses the constructor of
+ * Stepper and "attach" keeps its generic step.
+ */
+
+#ifndef FixedStepper_h
+#define FixedStepper_h
+
+#include "Arduino.h"
+#include "Stepper.h"
+
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+#define FIXEDSTEPPER_PIN_MAP
+#endif
+
+template<uint8_t PIN_1, uint8_t PIN_2, uint8_t PIN_3, uint8_t PIN_4, uint8_t MICRO_STEPS>
+class FixedStepper {
+  public:
+    static_assert(MICRO_STEPS != 0 && (MICRO_STEPS & (MICRO_STEPS - 1)) == 0 && MICRO_STEPS <= MICROSTEP_RESOLUTION,
+                  "FixedStepper: the micro steps can be 1, 2, 4, 8, 16 or 32");
+
+    // sets up "stepper" for these pins and micro steps, with "number_of_steps" full steps per revolution, and
+    // makes it take its steps with "step"
+    static void init(Stepper& stepper, const uint16_t& number_of_steps)
+    {
+#ifdef FIXEDSTEPPER_PIN_MAP
+      stepper = Stepper();
+      stepper.number_of_steps = number_of_steps;
+      stepper.motor_pin_1 = PIN_1;
+      stepper.motor_pin_2 = PIN_2;
+      if (MICRO_STEPS == 1) {
+        // four-wire, same as its constructor
+        stepper.motor_pin_3 = PIN_3;
+        stepper.motor_pin_4 = PIN_4;
+        stepper.pin_count = 4;
+      }
+      else {
+        // two-wire + PWM, same as its constructor
+        stepper.motor_pwm_pin_1 = PIN_3;
+        stepper.motor_pwm_pin_2 = PIN_4;
+        stepper.pin_count = 2;
+        stepper.micro_stepping = true;
+        stepper.number_of_micro_steps = MICRO_STEPS;
+        stepper.micro_step_stride = MICROSTEP_RESOLUTION / MICRO_STEPS;
+      }
+
+      const uint8_t pins[4] = { PIN_1, PIN_2, PIN_3, PIN_4 };
+      for (uint8_t i = 0; i < 4; i++) {
+        pinMode(pins[i], OUTPUT);
+        digitalWrite(pins[i], LOW);
+      }
+      if (MICRO_STEPS != 1) {
+        stepper.setupPwm();
+      }
+      attach(stepper);
+#else
+      if (MICRO_STEPS == 1)
+        stepper = Stepper(number_of_steps, PIN_1, PIN_2, PIN_3, PIN_4);
+      else
+        stepper = Stepper(number_of_steps, true, MICRO_STEPS, PIN_1, PIN_2, PIN_3, PIN_4);
+#endif
+    }
+
+    // makes "stepper" take its steps with "step"
+    static void attach(Stepper& stepper)
+    {
+#ifdef FIXEDSTEPPER_PIN_MAP
+      stepper.step_function = FixedStepper::step;
+      stepper.phase = 0;
+#else
+      (void)stepper;
+#endif
+    }
+
+    // moves the motor one (micro)step in the direction of "stepper"
+    static void step(Stepper& stepper)
+    {
+      // Position in the cycle of 4 full steps of the coils: the step of the
+      // sequence, or the phase of the microstep table like MicroStepWiring
+      static const uint8_t PHASES = (MICRO_STEPS == 1) ? 4 : 4 * MICROSTEP_RESOLUTION;
+      static const uint8_t STRIDE = (MICRO_STEPS == 1) ? 1 : MICROSTEP_RESOLUTION / MICRO_STEPS;
+      uint8_t phase = (stepper.direction == 1) ? stepper.phase + STRIDE : stepper.phase - STRIDE;
+      phase &= PHASES - 1;
+      stepper.phase = phase;
+
+      if (MICRO_STEPS == 1) {
+        uint8_t levels = Stepper::sequence_4_wire[phase];
+        writePin<PIN_1>(levels & 0b0001);
+        writePin<PIN_2>(levels & 0b0010);
+        writePin<PIN_3>(levels & 0b0100);
+        writePin<PIN_4>(levels & 0b1000);
+        return;
+      }
+
+      const Stepper::MicroStep* micro_step = &Stepper::microstep_table[phase];
+      writeDuty<PIN_3>(pgm_read_byte(&micro_step->duty_1));
+      writeDuty<PIN_4>(pgm_read_byte(&micro_step->duty_2));
+
+      // direction of the current: pin 1 for coil 1, pin 2 for coil 2
+      uint8_t polarity = pgm_read_byte(&micro_step->polarity);
+      writePin<PIN_1>(polarity & 0b01);
+      writePin<PIN_2>(polarity & 0b10);
+    }
+
+  private:
+    template<uint8_t PIN> static void writePin(const bool& level)
+    {
+#ifdef FIXEDSTEPPER_PIN_MAP
+      static_assert(PIN < 20, "FixedStepper: not a digital pin of the ATmega328P");
+      IO_REGISTER& port = (PIN < 8) ? PORTD : ((PIN < 14) ? PORTB : PORTC);
+      const uint8_t mask = 1 << ((PIN < 8) ? PIN : ((PIN < 14) ? PIN - 8 : PIN - 14));
+      if (level)
+        port |= mask;
+      else
+        port &= ~mask;
+#else
+      digitalWrite(PIN, level ? HIGH : LOW);
+#endif
+    }
+
+    // PWM pins: the compare register of the timer, connected inverted by Stepper::setupPwm
+    template<uint8_t PIN> static void writeDuty(const uint8_t& duty)
+    {
+#ifdef STEPPER_TIMER_PWM
+      if (PIN == 6)
+        OCR0A = ~duty;
+      else if (PIN == 5)
+        OCR0B = ~duty;
+      else if (PIN == 11)
+        OCR2A = ~duty;
+      else if (PIN == 3)
+        OCR2B = ~duty;
+      else
+        analogWrite(PIN, duty);
+#else
+      analogWrite(PIN, duty);
+#endif
+    }
+};
+
+#endif
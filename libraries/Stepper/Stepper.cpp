@@ -1,5 +1,5 @@
 /*
- * Stepper.cpp - Stepper library for Wiring/Arduino - Version 1.2.1
+ * Stepper.cpp - Stepper library for Wiring/Arduino - Version 1.3.0
  *
  * Original library        (0.1)   by Tom Igoe.
  * Two-wire modifications  (0.2)   by Sebastian Gassner
@@ -10,6 +10,7 @@
  * Five phase five wire    (1.1.0) by Ryan Orendorff
  * Microstepping on bipolar(1.2.0) by Attila Kov�cs
  * Few corrections         (1.2.1) by Rahul Subramonian Bama
+ * Timer driven stepping   (1.3.0) by Rahul Subramonian Bama
  * 
  * v(1.2.1) Corrections Include: 
  * 1. Commenting out analogWriteFreq();
@@ -88,36 +89,300 @@
 
 #include "Arduino.h"
 #include "Stepper.h"
+#include "FixedPoint.h"
 
  /*
- * Setting the static members arrays to store the 1/2, 1/4, 1/8 microstepping sine, cosine tables
+ * Microstep table: the 4 full steps of the sequence, divided in
+ * MICROSTEP_RESOLUTION microsteps each. At phase p the current of coil 1
+ * is sin and the one of coil 2 is cos of the electrical angle 90 deg * p /
+ * MICROSTEP_RESOLUTION, stored as PWM duties (PWMRANGE * |sin|, |cos|)
+ * and the signs. A motor with fewer microsteps uses every
+ * "micro_step_stride"-th phase. The values are computed by the compiler
+ * (constexpr), the sine with its Taylor series.
  */
-int const Stepper::microstepping_1_2[4][2][2] = {
-	{ { 0, 100 },{ 71, 71 } },
-	{ { 100, 0 },{ 71, -71 } },
-	{ { 0, -100 },{ -71, -71 } },
-	{ { -100, 0 },{ -71, 71 } }
+static constexpr double sineSeries(const double& x2, const double& term, const uint8_t& n)
+{
+  return (n > 21) ? term : term + sineSeries(x2, -term * x2 / ((n + 1) * (n + 2)), n + 2);
+}
+
+static constexpr double microStepAngle(const uint8_t& i)
+{
+  return 1.5707963267948966 * i / MICROSTEP_RESOLUTION;
+}
+
+// PWM duty of sin(90 deg * i / MICROSTEP_RESOLUTION), i = 0 .. MICROSTEP_RESOLUTION
+static constexpr uint8_t microStepDuty(const uint8_t& i)
+{
+  return (uint8_t)(PWMRANGE * sineSeries(microStepAngle(i) * microStepAngle(i), microStepAngle(i), 1) + 0.5);
+}
+
+// The currents at phase p: in the odd quarters of the cycle sin and cos swap magnitudes
+constexpr Stepper::MicroStep Stepper::microStep(const uint8_t& p)
+{
+  return Stepper::MicroStep{
+    microStepDuty(((p / MICROSTEP_RESOLUTION) & 1) ? MICROSTEP_RESOLUTION - p % MICROSTEP_RESOLUTION : p % MICROSTEP_RESOLUTION),
+    microStepDuty(((p / MICROSTEP_RESOLUTION) & 1) ? p % MICROSTEP_RESOLUTION : MICROSTEP_RESOLUTION - p % MICROSTEP_RESOLUTION),
+    (uint8_t)(((p > 0 && p < 2 * MICROSTEP_RESOLUTION) ? 1 : 0) | ((p < MICROSTEP_RESOLUTION || p > 3 * MICROSTEP_RESOLUTION) ? 2 : 0))
+  };
+}
+
+static_assert(MICROSTEP_RESOLUTION == 32, "Stepper: the microstep table below has 4 * 32 phases");
+static_assert(microStepDuty(0) == 0 && microStepDuty(MICROSTEP_RESOLUTION) == PWMRANGE, "Stepper: microstep table");
+
+#define MICROSTEP_4(p)  microStep(p), microStep(p + 1), microStep(p + 2), microStep(p + 3)
+#define MICROSTEP_16(p) MICROSTEP_4(p), MICROSTEP_4(p + 4), MICROSTEP_4(p + 8), MICROSTEP_4(p + 12)
+#define MICROSTEP_64(p) MICROSTEP_16(p), MICROSTEP_16(p + 16), MICROSTEP_16(p + 32), MICROSTEP_16(p + 48)
+
+Stepper::MicroStep const Stepper::microstep_table[4 * MICROSTEP_RESOLUTION] PROGMEM = { MICROSTEP_64(0), MICROSTEP_64(64) };
+
+#undef MICROSTEP_4
+#undef MICROSTEP_16
+#undef MICROSTEP_64
+
+/*
+ * Levels of the coil pins for each step of the sequences in the description
+ * above, bit 0 is motor_pin_1. Used to build the port values (see setupCoils).
+ */
+uint8_t const Stepper::sequence_2_wire[4] = { 0b10, 0b11, 0b01, 0b00 };
+
+uint8_t const Stepper::sequence_4_wire[4] = { 0b0101, 0b0110, 0b1010, 0b1001 };
+
+uint8_t const Stepper::sequence_5_wire[10] = {
+	0b10110, 0b10010, 0b11010, 0b01010, 0b01011,
+	0b01001, 0b01101, 0b00101, 0b10101, 0b10100
+};
+
+/*
+ * Levels of the coil pins that give the direction of the current in the
+ * coils when microstepping (steps of the sequences above). Index: bit 0 set
+ * if coil 1 is positive, bit 1 for coil 2, as "polarity" of the microstep table.
+ */
+uint8_t const Stepper::polarity_2_wire[4] = { 0b00, 0b01, 0b10, 0b11 };
+
+uint8_t const Stepper::polarity_4_wire[4] = { 0b1010, 0b1001, 0b0110, 0b0101 };
+
+/*
+ * Stepper that is moved by the Timer1 interrupt (see stepAsync)
+ */
+Stepper* volatile Stepper::running = 0;
+
+const uint32_t Stepper::PWM_FREQUENCY_ULTRASONIC;
+
+/*
+ * Phases of the acceleration profile of an asynchronous move.
+ * The S-curve goes through all of them, the trapezoid skips the jerk ones.
+ */
+enum RampPhase {
+  RAMP_NONE = 0,   // no acceleration, every step uses step_interval
+  RAMP_JERK_UP,    // acceleration rising
+  RAMP_ACCEL,      // constant acceleration
+  RAMP_JERK_DOWN,  // acceleration falling, getting close to the set speed
+  RAMP_CRUISE,     // at the set speed
+  RAMP_DECEL,      // slowing down, mirror of the ramp up
+  RAMP_VELOCITY    // no profile, the speed is set with setVelocity()
+};
+
+static const uint32_t TICKS_SHIFTED = StepTimer::TICKS_PER_SEC << 8; // F, for intervals with 8 fractional bits
+
+/*
+ * Change of the step interval p over one step at acceleration m (a/F^2).
+ * From v^2 = v0^2 + 2a (one step), p_next = p / sqrt(1 + 2q) with q = m*p^2,
+ * i.e. p_next = p*(1 - q + 1.5q^2) when speeding up and p*(1 + q + 1.5q^2)
+ * when slowing down (a negative). The profile keeps q <= 0.25, where the
+ * error of the series is below 1%, and it doesn't add up because the next
+ * step starts from the interval that was actually used.
+ * Only multiplications, no division.
+ */
+static uint32_t rampChange(const uint32_t& interval, const uint32_t& m, const bool& speeding_up)
+{
+  uint32_t p = interval >> 8;                               // whole ticks, at most 0xFFFF
+  uint32_t q = ((uint64_t)m * (p * p)) >> 16;               // 32 fractional bits
+  uint32_t q2 = ((uint64_t)q * q) >> 32;
+  uint32_t factor = speeding_up ? q - q2 - (q2 >> 1) : q + q2 + (q2 >> 1);
+  return ((uint64_t)interval * factor) >> 32;
+}
+
+/*
+ * Change of the acceleration over one step of p ticks: j*p/F in a/F^2 units
+ */
+static uint32_t jerkChange(const uint32_t& jerk, const uint32_t& interval)
+{
+  return ((uint64_t)jerk * (interval >> 8)) >> 16;
+}
+
+/*
+ * Wirings of the coils. Each one is a policy with "next", which moves
+ * "phase" one (micro)step in "direction" and returns the row of
+ * "coil_bits" that the coil pins are set to. CoilWiring turns it into two
+ * step functions, "step" through the port registers (and the compare
+ * registers of the PWM pins) and "stepPins" with digitalWrite() (and
+ * analogWrite()), and the constructors pick one of them once (see
+ * setupCoils). The wiring and the way the pins are written are then
+ * fixed at compile time in each step function: no tests of pin_count or
+ * micro_stepping on every step.
+ */
+static IO_REGISTER no_port;  // coil_port[1] when the coil pins are all on one port, written to no effect
+
+template<class Wiring>
+struct Stepper::CoilWiring {
+  static void step(Stepper& stepper)
+  {
+    stepper.writePorts(stepper.coil_bits[Wiring::template next<true>(stepper)]);
+  }
+
+  static void stepPins(Stepper& stepper)
+  {
+    stepper.writePins(stepper.coil_bits[Wiring::template next<false>(stepper)][0]);
+  }
 };
 
-int const Stepper::microstepping_1_4[4][4][2] = {
-	{ { 0, 100 },{ 38, 92 },{ 71, 71 },{ 92, 38 } },
-	{ { 100, 0 },{ 92, -38 },{ 71, -71 },{ 38, -92 } },
-	{ { 0, -100 },{ -38, -92 },{ -71, -71 },{ -92, -38 } },
-	{ { -100, 0 },{ -92, 38 },{ -71, 71 },{ -38, 92 } }
+// Full steps of 2 and 4 wires: the 4 steps of the sequence
+struct Stepper::FullStepWiring : Stepper::CoilWiring<Stepper::FullStepWiring> {
+  static const bool PWM = false;
+
+  template<bool PORTS> static uint8_t next(Stepper& stepper)
+  {
+    stepper.phase = ((stepper.direction == 1) ? stepper.phase + 1 : stepper.phase - 1) & 3;
+    return stepper.phase;
+  }
 };
 
-int const Stepper::microstepping_1_8[4][8][2] = {
-	{ { 0, 100 },{ 20, 98 },{ 38, 92 },{ 56, 83 },{ 71, 71 },{ 83, 56 },{ 92, 38 },{ 98, 20 }, },
-	{ { 100, 0 },{ 98, -20 },{ 92, -38 },{ 83, -56 },{ 71, -71 },{ 56, -83 },{ 38, -92 },{ 20, -98 } },
-	{ { -0, -100 },{ -20, -98 },{ -38, -92 },{ -56, -83 },{ -71, -71 },{ -83, -56 },{ -92, -38 },{ -98, -20 }, },
-	{ { -100, 0 },{ -98, 20 },{ -92, 38 },{ -83, 56 },{ -71, 71 },{ -56, 83 },{ -38, 92 },{ -20, 98 } }
+// 5 phase motor: the 10 steps of the sequence
+struct Stepper::FivePhaseWiring : Stepper::CoilWiring<Stepper::FivePhaseWiring> {
+  static const bool PWM = false;
+
+  template<bool PORTS> static uint8_t next(Stepper& stepper)
+  {
+    if (stepper.direction == 1)
+      stepper.phase = (stepper.phase == 9) ? 0 : stepper.phase + 1;
+    else
+      stepper.phase = (stepper.phase == 0) ? 9 : stepper.phase - 1;
+    return stepper.phase;
+  }
 };
 
+// Microsteps of 2 and 4 wires + PWM: "micro_step_stride" phases of the microstep table per microstep.
+// The PWM pins get the duties, the coil pins the polarity (rows of polarity_2_wire or polarity_4_wire).
+struct Stepper::MicroStepWiring : Stepper::CoilWiring<Stepper::MicroStepWiring> {
+  static const bool PWM = true;
+
+  template<bool PORTS> static uint8_t next(Stepper& stepper)
+  {
+    stepper.phase = ((stepper.direction == 1) ? stepper.phase + stepper.micro_step_stride
+                                              : stepper.phase - stepper.micro_step_stride) & (4 * MICROSTEP_RESOLUTION - 1);
+    const MicroStep* micro_step = &microstep_table[stepper.phase];
+    uint8_t duty_1 = pgm_read_byte(&micro_step->duty_1);
+    uint8_t duty_2 = pgm_read_byte(&micro_step->duty_2);
+    if (PORTS) {
+      *stepper.pwm_ocr[0] = ~duty_1;  // inverted output, see setupPwm()
+      *stepper.pwm_ocr[1] = ~duty_2;
+    }
+    else {
+      analogWrite(stepper.motor_pwm_pin_1, duty_1);
+      analogWrite(stepper.motor_pwm_pin_2, duty_2);
+    }
+    return pgm_read_byte(&micro_step->polarity);
+  }
+};
+
+/*
+ * Resolves the coil pins to their port registers and bitmasks, and the
+ * "num_rows" levels of the pins of the wiring to the value of each port
+ * (coil_bits). The step function of the wiring writes the ports, or falls
+ * back to digitalWrite() if the pins are spread over more than two ports,
+ * the PWM pins are not on Timer0 or Timer2, or with STEPPER_DIGITALWRITE.
+ */
+template<class Wiring>
+void Stepper::setupCoils(const uint8_t* levels, const uint8_t& num_rows)
+{
+  const uint8_t pins[5] = { motor_pin_1, motor_pin_2, motor_pin_3, motor_pin_4, motor_pin_5 };
+  uint8_t pin_port[5];  // which of the two ports each pin is on
+  uint8_t pin_bit[5];
+  bool ports = true;
+
+  this->phase = 0;
+  this->coil_port[0] = 0;
+  this->coil_port[1] = 0;
+  this->coil_mask[0] = 0;
+  this->coil_mask[1] = 0;
+
+  for (uint8_t i = 0; i < this->pin_count; i++) {
+    // also turns off a PWM that may be running on the pin, the port write would not
+    digitalWrite(pins[i], LOW);
+
+    IO_REGISTER_PTR port = portOutputRegister(digitalPinToPort(pins[i]));
+    uint8_t k = (this->coil_port[0] == 0 || this->coil_port[0] == port) ? 0 : 1;
+    if (port == 0 || (k == 1 && this->coil_port[1] != 0 && this->coil_port[1] != port)) {
+      ports = false;
+      break;
+    }
+    this->coil_port[k] = port;
+    this->coil_mask[k] |= digitalPinToBitMask(pins[i]);
+    pin_port[i] = k;
+    pin_bit[i] = digitalPinToBitMask(pins[i]);
+  }
+
+#ifdef STEPPER_DIGITALWRITE
+  ports = false;
+#endif
+  if (Wiring::PWM && (this->pwm_ocr[0] == 0 || this->pwm_ocr[1] == 0)) {
+    ports = false;
+  }
+
+  if (!ports) {
+    for (uint8_t row = 0; row < num_rows; row++) {
+      this->coil_bits[row][0] = levels[row];
+    }
+    this->step_function = Wiring::stepPins;
+    return;
+  }
+
+  if (this->coil_port[1] == 0) {
+    this->coil_port[1] = &no_port;
+  }
+  for (uint8_t row = 0; row < num_rows; row++) {
+    this->coil_bits[row][0] = 0;
+    this->coil_bits[row][1] = 0;
+    for (uint8_t i = 0; i < this->pin_count; i++) {
+      if ((levels[row] >> i) & 1)
+        this->coil_bits[row][pin_port[i]] |= pin_bit[i];
+    }
+  }
+  this->step_function = Wiring::step;
+}
+
 /* Empty constructor.
    Used for initializing objects without passing arguments
  */
 Stepper::Stepper(){
-  
+  this->direction = 0;
+  this->number_of_steps = 0;
+  this->number_of_micro_steps = 1;
+
+  // no pins: the steps and off() don't write anything (pin_count is 0, the EN pin is not connected)
+  this->motor_pin_1 = StepDirDriver::NO_PIN;
+  this->motor_pin_2 = StepDirDriver::NO_PIN;
+  this->motor_pin_3 = StepDirDriver::NO_PIN;
+  this->motor_pin_4 = StepDirDriver::NO_PIN;
+  this->motor_pin_5 = StepDirDriver::NO_PIN;
+  this->motor_pwm_pin_1 = StepDirDriver::NO_PIN;
+  this->motor_pwm_pin_2 = StepDirDriver::NO_PIN;
+
+  this->coil_port[0] = &no_port;
+  this->coil_port[1] = &no_port;
+  this->coil_mask[0] = 0;
+  this->coil_mask[1] = 0;
+  for (uint8_t row = 0; row < 10; row++) {
+    this->coil_bits[row][0] = 0;
+    this->coil_bits[row][1] = 0;
+  }
+  // not the step function of a wiring: FixedStepper::init starts from here without linking them in
+  this->step_function = Stepper::noStep;
+}
+
+void Stepper::noStep(Stepper& stepper)
+{
+  (void)stepper;
 }
 
 /*
@@ -126,9 +391,7 @@ Stepper::Stepper(){
  */
 Stepper::Stepper(const uint16_t& number_of_steps, const uint8_t& motor_pin_1, const uint8_t& motor_pin_2)
 {
-  this->step_number = 0;    // which step the motor is on
   this->direction = 0;      // motor direction
-  this->last_step_time = 0; // time stamp in us of the last step taken
   this->number_of_steps = number_of_steps; // total number of steps for this motor
 
   // Arduino pins for the motor control connection:
@@ -144,8 +407,10 @@ Stepper::Stepper(const uint16_t& number_of_steps, const uint8_t& motor_pin_1, co
   this->motor_pin_4 = 0;
   this->motor_pin_5 = 0;
 
-  // pin_count is used by the stepMotor() method:
+  // pin_count is used by the step functions with digitalWrite():
   this->pin_count = 2;
+
+  setupCoils<FullStepWiring>(sequence_2_wire, 4);
 }
 
 /*
@@ -157,9 +422,7 @@ Stepper::Stepper(const uint16_t& number_of_steps, bool micro_stepping, const uin
 									const uint8_t& motor_pin_1, const uint8_t& motor_pin_2,
 									const uint8_t& motor_pwm_pin_1, const uint8_t& motor_pwm_pin_2)
 {
-  this->step_number = 0;    // which step the motor is on
   this->direction = 0;      // motor direction
-  this->last_step_time = 0; // time stamp in us of the last step taken
   this->number_of_steps = number_of_steps; // total number of steps for this motor
 
   // Arduino pins for the motor control connection:
@@ -180,14 +443,21 @@ Stepper::Stepper(const uint16_t& number_of_steps, bool micro_stepping, const uin
   // set microstepping mode
   this->micro_stepping = micro_stepping;
   this->number_of_micro_steps = number_of_micro_steps;
+  this->micro_step_stride = MICROSTEP_RESOLUTION / number_of_micro_steps;
 
   // When there are only 2 pins, set the others to 0:
   this->motor_pin_3 = 0;
   this->motor_pin_4 = 0;
   this->motor_pin_5 = 0;
 
-  // pin_count is used by the stepMotor() method:
+  // pin_count is used by the step functions with digitalWrite():
   this->pin_count = 2;
+
+  setupPwm();
+  if (this->micro_stepping)
+    setupCoils<MicroStepWiring>(polarity_2_wire, 4);
+  else
+    setupCoils<FullStepWiring>(sequence_2_wire, 4);
 }
 
 
@@ -198,9 +468,7 @@ Stepper::Stepper(const uint16_t& number_of_steps, bool micro_stepping, const uin
 Stepper::Stepper(const uint16_t& number_of_steps, const uint8_t& motor_pin_1, const uint8_t& motor_pin_2,
                                       const uint8_t& motor_pin_3, const uint8_t& motor_pin_4)
 {
-  this->step_number = 0;    // which step the motor is on
   this->direction = 0;      // motor direction
-  this->last_step_time = 0; // time stamp in us of the last step taken
   this->number_of_steps = number_of_steps; // total number of steps for this motor
 
   // Arduino pins for the motor control connection:
@@ -218,8 +486,10 @@ Stepper::Stepper(const uint16_t& number_of_steps, const uint8_t& motor_pin_1, co
   // When there are 4 pins, set the others to 0:
   this->motor_pin_5 = 0;
 
-  // pin_count is used by the stepMotor() method:
+  // pin_count is used by the step functions with digitalWrite():
   this->pin_count = 4;
+
+  setupCoils<FullStepWiring>(sequence_4_wire, 4);
 }
 
 
@@ -232,9 +502,7 @@ Stepper::Stepper(const uint16_t& number_of_steps, bool micro_stepping, const uin
 									const uint8_t& motor_pin_1, const uint8_t& motor_pin_2, const uint8_t& motor_pin_3, const uint8_t& motor_pin_4,
 									const uint8_t& motor_pwm_pin_1, const uint8_t& motor_pwm_pin_2)
 {
-	this->step_number = 0;    // which step the motor is on
 	this->direction = 0;      // motor direction
-	this->last_step_time = 0; // time stamp in us of the last step taken
 	this->number_of_steps = number_of_steps; // total number of steps for this motor
 
 											 // Arduino pins for the motor control connection:
@@ -260,14 +528,19 @@ Stepper::Stepper(const uint16_t& number_of_steps, bool micro_stepping, const uin
 	// set microstepping mode
 	this->micro_stepping = micro_stepping;
 	this->number_of_micro_steps = number_of_micro_steps;
+	this->micro_step_stride = MICROSTEP_RESOLUTION / number_of_micro_steps;
 
-	// When there are only 2 pins, set the others to 0:
-	this->motor_pin_3 = 0;
-	this->motor_pin_4 = 0;
+	// When there are 4 pins, set the others to 0:
 	this->motor_pin_5 = 0;
 
-	// pin_count is used by the stepMotor() method:
-	this->pin_count = 2;
+	// pin_count is used by the step functions with digitalWrite():
+	this->pin_count = 4;
+
+	setupPwm();
+	if (this->micro_stepping)
+		setupCoils<MicroStepWiring>(polarity_4_wire, 4);
+	else
+		setupCoils<FullStepWiring>(sequence_4_wire, 4);
 }
 
 
@@ -279,9 +552,7 @@ Stepper::Stepper(const uint16_t& number_of_steps, const uint8_t& motor_pin_1, co
                                       const uint8_t& motor_pin_3, const uint8_t& motor_pin_4,
                                       const uint8_t& motor_pin_5)
 {
-  this->step_number = 0;    // which step the motor is on
   this->direction = 0;      // motor direction
-  this->last_step_time = 0; // time stamp in us of the last step taken
   this->number_of_steps = number_of_steps; // total number of steps for this motor
 
   // Arduino pins for the motor control connection:
@@ -298,332 +569,716 @@ Stepper::Stepper(const uint16_t& number_of_steps, const uint8_t& motor_pin_1, co
   pinMode(this->motor_pin_4, OUTPUT);
   pinMode(this->motor_pin_5, OUTPUT);
 
-  // pin_count is used by the stepMotor() method:
+  // pin_count is used by the step functions with digitalWrite():
   this->pin_count = 5;
+
+  setupCoils<FivePhaseWiring>(sequence_5_wire, 10);
 }
 
 /*
- * Sets the speed in revs per minute
+ *   constructor for a STEP/DIR driver (A4988, DRV8825, TMC2208 ...)
+ *   Sets the STEP, DIR and EN pins, the number of full steps per
+ *   rotation and the microsteps that are set on the driver. The steps
+ *   are pulses on the STEP pin, see pulseStep().
+ */
+Stepper::Stepper(const uint16_t& number_of_steps, const StepDirDriver& driver)
+{
+  this->step_function = Stepper::pulseStep;
+  this->direction = 0;      // motor direction
+  this->number_of_steps = number_of_steps; // total number of steps for this motor
+
+  // Arduino pins for the driver:
+  this->motor_pin_1 = driver.step_pin;
+  this->motor_pin_2 = driver.dir_pin;
+  this->motor_pin_3 = driver.enable_pin;
+  this->motor_pin_4 = 0;
+  this->motor_pin_5 = 0;
+
+  // the speed settings count microsteps, same as with the coils
+  this->micro_stepping = (driver.micro_steps > 1);
+  this->number_of_micro_steps = (driver.micro_steps > 1) ? driver.micro_steps : 1;
+
+  this->driver.pulse_width = driver.pulse_width_us;
+  this->driver.dir_setup = driver.dir_setup_us;
+  this->driver.dir_level = 0;
+  this->driver.off = false;
+
+  // no coils: off() leaves the pins alone
+  this->pin_count = 0;
+
+  // setup the pins on the microcontroller, the driver starts enabled:
+  pinMode(this->motor_pin_1, OUTPUT);
+  pinMode(this->motor_pin_2, OUTPUT);
+  digitalWrite(this->motor_pin_1, LOW);
+  digitalWrite(this->motor_pin_2, LOW);
+  if (this->motor_pin_3 != StepDirDriver::NO_PIN) {
+    pinMode(this->motor_pin_3, OUTPUT);
+    digitalWrite(this->motor_pin_3, LOW);
+  }
+
+  // the STEP and DIR pins as port registers, like the coil pins
+  this->coil_port[0] = portOutputRegister(digitalPinToPort(this->motor_pin_1));
+  this->coil_port[1] = portOutputRegister(digitalPinToPort(this->motor_pin_2));
+  this->coil_mask[0] = digitalPinToBitMask(this->motor_pin_1);
+  this->coil_mask[1] = digitalPinToBitMask(this->motor_pin_2);
+}
+
+/*
+ * Sets the speed in revs per minute. Goes through the rate in milli steps
+ * per second, so the interval is not truncated to whole microseconds per
+ * step and again per microstep, e.g. 1000 rpm of 200 steps with 8
+ * microsteps is 26667 microsteps/s, not 1 / 37 us = 27027 (1.4% fast).
  */
 void Stepper::setSpeed(const uint16_t& whatSpeed)
 {
-  this->step_delay = 60L * 1000L * 1000L / static_cast<unsigned long>(this->number_of_steps) / whatSpeed;
-  if (this->micro_stepping) {
-	  this->micro_step_delay = step_delay / number_of_micro_steps;
-	  // the PWM signal frqequency is proprtinal to the RPM
-	  //analogWriteFreq(whatSpeed * 100);
+  uint32_t steps_per_rev = static_cast<uint32_t>(this->number_of_steps) * (this->micro_stepping ? number_of_micro_steps : 1);
+  // rpm * steps_per_rev * 1000 / 60, rounded
+  uint64_t millisteps = ((uint64_t)whatSpeed * steps_per_rev * 50 + 1) / 3;
+  setStepRateMilli((millisteps > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : millisteps);
+}
+
+/*
+ * Sets the speed in steps per second, or microsteps per second if
+ * microstepping is used (the same steps that step() counts).
+ */
+void Stepper::setStepRate(const uint32_t& steps_per_second)
+{
+  setStepRateMilli((steps_per_second > 0xFFFFFFFFUL / 1000) ? 0xFFFFFFFFUL : steps_per_second * 1000);
+}
+
+/*
+ * Sets the speed in thousandths of a (micro)step per second, e.g. 1333333
+ * for 10 mm/s with 133.3333 steps per mm. The interval between the steps is
+ * kept in Timer1 ticks with 8 fractional bits (1/512 us), and the fraction
+ * is carried from step to step (see nextInterval), so over a long move the
+ * rate is the one set here to about 1 part in 256 * the interval in ticks.
+ * The division is done here, not per step.
+ */
+void Stepper::setStepRateMilli(const uint32_t& millisteps_per_second)
+{
+  if (millisteps_per_second == 0) {
+    return;
   }
-  else
-    this->micro_step_delay = 0;
+
+  uint64_t interval = ((uint64_t)TICKS_SHIFTED * 1000 + millisteps_per_second / 2) / millisteps_per_second;
+  if (interval < (1UL << 8)) {
+    interval = 1UL << 8;  // one tick, StepTimer limits it to MIN_INTERVAL
+  }
+  if (interval > 0xFFFFFFFFUL) {
+    interval = 0xFFFFFFFFUL;  // slowest: about 0.12 steps per second
+  }
+
+  // the timer reads step_interval in the middle of an asynchronous move
+  uint8_t sreg = SREG;
+  cli();
+  this->step_interval = interval;
+  SREG = sreg;
+}
+
+/*
+ * Sets the acceleration of the asynchronous moves in (micro)steps/s^2.
+ * A move starts at a low speed, ramps up to the speed set with setSpeed()
+ * or setStepRate(), and ramps down before the last step. 0 turns it off.
+ * The new value is used from the next move on.
+ */
+void Stepper::setAcceleration(const uint32_t& steps_per_second_2)
+{
+  // above this the ramp would be over in a handful of steps anyway
+  uint32_t accel = (steps_per_second_2 > 10000000UL) ? 10000000UL : steps_per_second_2;
+
+  // a/F^2 with 48 fractional bits, in two parts so that nothing overflows
+  uint32_t m = (((((uint64_t)accel << 24) / StepTimer::TICKS_PER_SEC) << 24) / StepTimer::TICKS_PER_SEC);
+
+  // The ramp starts from v0 = 2*sqrt(a), so the first step already gains 12% of its speed
+  // and keeps q <= 0.25 in rampChange(). The interval also has to fit in 16 bits.
+  uint32_t start_speed = 2 * FixedPoint::squareRoot(accel) + 1;
+  uint32_t min_speed = StepTimer::TICKS_PER_SEC / 0xFFFF + 1;
+  if (start_speed < min_speed) {
+    start_speed = min_speed;
+  }
+
+  uint8_t sreg = SREG;
+  cli();
+  this->ramp_accel = m;
+  this->ramp_start = TICKS_SHIFTED / start_speed;
+  SREG = sreg;
+}
+
+/*
+ * Sets the jerk of the asynchronous moves in (micro)steps/s^3. The
+ * acceleration rises and falls at this rate instead of jumping, which
+ * gives an S-curve speed profile. 0 (default) gives a trapezoidal one.
+ */
+void Stepper::setJerk(const uint32_t& steps_per_second_3)
+{
+  // j/F^3 with 64 fractional bits, in three parts so that nothing overflows
+  uint64_t jerk = ((uint64_t)steps_per_second_3 << 32) / StepTimer::TICKS_PER_SEC;
+  jerk = (jerk << 16) / StepTimer::TICKS_PER_SEC;
+  jerk = (jerk << 16) / StepTimer::TICKS_PER_SEC;
+
+  uint8_t sreg = SREG;
+  cli();
+  this->ramp_jerk = (jerk > 0xFFFFFFFFULL) ? 0xFFFFFFFFUL : jerk;
+  SREG = sreg;
 }
 
 /*
  * Moves the motor steps_to_move steps.  If the number is negative,
- * the motor moves in the reverse direction.
+ * the motor moves in the reverse direction. The steps are timed by
+ * Timer1 like the ones of stepAsync() (with its acceleration, if one is
+ * set), instead of polling micros() with its 4 us steps, and this waits
+ * till the move is over.
  */
 void Stepper::step(const int& steps_to_move)
 {
-  int steps_left = abs(steps_to_move);  // how many steps to take
+  stepAsync(steps_to_move);
+  while (this->moving) {
+    yield();
+  }
+}
+
+/*
+ * Starts moving the motor steps_to_move steps and returns immediately.
+ * The steps are taken from the Timer1 interrupt at the speed set with
+ * setSpeed(). If another stepper (or a group of LinActMultiAxis) is
+ * moving, this waits till that move is over.
+ */
+void Stepper::stepAsync(const long& steps_to_move)
+{
+  // there is only one timer channel for the steppers
+  while (timerTaken()) {
+    yield();
+  }
+
+  if (steps_to_move == 0) {
+    return;
+  }
+
+  uint8_t sreg = SREG;
+  cli();
 
   // determine direction based on whether steps_to_mode is + or -:
-  if (steps_to_move > 0) { this->direction = 1; }
-  if (steps_to_move < 0) { this->direction = 0; }
+  this->direction = (steps_to_move > 0) ? 1 : 0;
+  this->async_steps_left = abs(steps_to_move);
+  this->moving = true;
+  running = this;
+  startRamp();
 
+  SREG = sreg;
 
-  // if no microstepping is set
-  if (!this->micro_stepping)
-  {
-    // decrement the number of steps, moving one step each time:
-    while (steps_left > 0)
-    {
-      unsigned long now = micros();
-      // move only if the appropriate delay has passed:
-      if (now - this->last_step_time >= this->step_delay)
-      {
-        // get the timeStamp of when you stepped:
-        this->last_step_time = now;
-        // increment or decrement the step number,
-        // depending on direction:
-        if (this->direction == 1)
-        {
-          this->step_number++;
-          if (this->step_number == this->number_of_steps) {
-            this->step_number = 0;
-          }
-        }
-        else
-        {
-          if (this->step_number == 0) {
-            this->step_number = this->number_of_steps;
-          }
-          this->step_number--;
-        }
-        // decrement the steps left:
-        steps_left--;
-        // step the motor to step number 0, 1, ..., {3 or 10}
-        if (this->pin_count == 5)
-          stepMotor(this->step_number % 10);
-        else
-          stepMotor(this->step_number % 4);
-      }
-    }
+  // take the first step right away, like step() does after a pause
+  StepTimer::start(StepTimer::CHANNEL_A, Stepper::onTimer, StepTimer::MIN_INTERVAL);
+}
+
+/*
+ * True while Timer1 channel A moves something else than this stepper:
+ * another stepper, or a group of LinActMultiAxis, which steps its
+ * steppers with stepOnce() and leaves "running" as it was.
+ */
+bool Stepper::timerTaken() const
+{
+  return StepTimer::isRunning(StepTimer::CHANNEL_A) && !(running == this && this->moving);
+}
+
+/*
+ * True while an asynchronous move is in progress
+ */
+bool Stepper::isMoving() const
+{
+  return this->moving;
+}
+
+/*
+ * Number of steps that the asynchronous move still has to take
+ */
+long Stepper::stepsRemaining() const
+{
+  // a long is read in several instructions, the timer must not change it in between
+  uint8_t sreg = SREG;
+  cli();
+  long steps_left = this->async_steps_left;
+  SREG = sreg;
+
+  return steps_left;
+}
+
+/*
+ * Stops the asynchronous move. The step in progress is completed.
+ */
+void Stepper::stop()
+{
+  uint8_t sreg = SREG;
+  cli();
+
+  if (running == this) {
+    StepTimer::stop(StepTimer::CHANNEL_A);
+    running = 0;
   }
-  
-  // if microstepping is used
-  else 
-  {
-      // decrement the number of steps, moving one step each time:
-    while (steps_left > 0)
-    {
-      unsigned long now = micros();
-      // move only if the appropriate delay has passed:
-      if (now - this->last_step_time >= this->micro_step_delay)
-      {
-        // get the timeStamp of when you stepped:
-        this->last_step_time = now;
-          
-        // increment or decrement the whole step number,
-        // depending on direction:
-        if (this->direction == 1)
-        {
-          this->micro_step_number++;
-          // if there is whole step
-          if (this->micro_step_number == this->number_of_micro_steps) {
-            this->step_number++;
-            if (this->step_number == this->number_of_steps) {
-              this->step_number = 0;
-            }
-            this->micro_step_number = 0; //there was a whole step, microstep is reset to 0
-          }
-        }
-        else
-        {
-          // if there is whole step
-          if (this->micro_step_number == 0) {
-            if (this->step_number == 0) {
-              this->step_number = this->number_of_steps;
-            }
-            this->step_number--;
-            this->micro_step_number = this->number_of_micro_steps;
-          }
-          this->micro_step_number--;
-        }
-        
-        // decrement the steps left:
-		
-        steps_left--;
-        
-        // step the motor to step number 0, 1, ..., {3 or 10}
-        if (this->pin_count == 2 || this->pin_count == 4)
-			microStepMotor(this->step_number % 4, this->micro_step_number);
-      }
+  this->async_steps_left = 0;
+  this->moving = false;
+
+  SREG = sreg;
+}
+
+/*
+ * Moves the motor at steps_per_second (micro)steps per second, backwards
+ * if negative, till it is called again with another speed or with 0. The
+ * new speed is used from the step after the one that is pending. There is
+ * no ramp: whoever calls it has to change the speed gradually. Doesn't
+ * wait, so it can be called from an interrupt. If another stepper (or a
+ * group of LinActMultiAxis) is moving, this one doesn't start and it
+ * returns false: nothing was changed.
+ */
+bool Stepper::setVelocity(const long& steps_per_second)
+{
+  uint8_t sreg = SREG;
+  cli();
+
+  if (timerTaken()) {
+    SREG = sreg;
+    return false;
+  }
+
+  if (steps_per_second == 0) {
+    // the step that is pending is not taken
+    if (running == this && this->ramp_phase == RAMP_VELOCITY) {
+      StepTimer::stop(StepTimer::CHANNEL_A);
+      this->moving = false;
     }
-  } 
+    SREG = sreg;
+    return true;
+  }
+
+  unsigned long rate = abs(steps_per_second);
+  // down to 1 step per second: StepTimer splits the intervals that don't fit in 16 bits
+  uint32_t interval = (rate > StepTimer::TICKS_PER_SEC) ? (1UL << 8) : TICKS_SHIFTED / rate;
+  this->direction = (steps_per_second > 0) ? 1 : 0;
+  this->ramp_interval = interval;
+
+  bool start = !this->moving || running != this || this->ramp_phase != RAMP_VELOCITY;
+  if (start) {
+    this->ramp_phase = RAMP_VELOCITY;
+    this->ramp_fraction = 0;
+    this->async_steps_left = 0;
+    this->moving = true;
+    running = this;
+    StepTimer::start(StepTimer::CHANNEL_A, Stepper::onTimer, StepTimer::MIN_INTERVAL);
+  }
+
+  SREG = sreg;
+  return true;
 }
 
 /*
-* Moves the motor forward or backwards in microsteps.
-*/
-void Stepper::microStepMotor(const int& this_step, const int& this_micro_step)
-{
-	//yield() might be needed at slow RPM and/or many steps on an ESP8266
-	//yield(); 
-	int coil1value;
-	int coil2value;
-	
-	switch (this->number_of_micro_steps) {
-	case 2:
-		coil1value = microstepping_1_2[this_step][this_micro_step][0];
-		coil2value = microstepping_1_2[this_step][this_micro_step][1];
-		break;
-	case 4:
-		coil1value = microstepping_1_4[this_step][this_micro_step][0];
-		coil2value = microstepping_1_4[this_step][this_micro_step][1];
-		break;
-	case 8:
-		coil1value = microstepping_1_8[this_step][this_micro_step][0];
-		coil2value = microstepping_1_8[this_step][this_micro_step][1];
-		break;
-	}
+ * Takes one (micro)step forward or backward right away, without waiting
+ * for the step delay. Whoever calls it times the steps.
+ */
+void Stepper::stepOnce(const bool& forward)
+{
+  this->direction = forward ? 1 : 0;
+  this->step_function(*this);
+}
 
-	// set the correct PWM on the enable pin
-	analogWrite(motor_pwm_pin_1, (abs(coil1value) * PWMRANGE) / 100);
-	analogWrite(motor_pwm_pin_2, (abs(coil2value) * PWMRANGE) / 100);
+/*
+ * Speed set with setSpeed() or setStepRate(), in (micro)steps per second
+ */
+uint32_t Stepper::getStepRate() const
+{
+  return (TICKS_SHIFTED + this->step_interval / 2) / this->step_interval;
+}
 
-	if (this->pin_count == 2) {
-		if (coil1value > 0)
-			digitalWrite(motor_pin_1, HIGH);
-		else
-			digitalWrite(motor_pin_1, LOW);
+/*
+ * Same as getStepRate(), in thousandths of a (micro)step per second
+ */
+uint32_t Stepper::getStepRateMilli() const
+{
+  return ((uint64_t)TICKS_SHIFTED * 1000 + this->step_interval / 2) / this->step_interval;
+}
 
-		if (coil2value > 0)
-			digitalWrite(motor_pin_2, HIGH);
-		else
-			digitalWrite(motor_pin_2, LOW);
-	}
-	else if (this->pin_count == 4) {
-		if (coil1value > 0) {
-			digitalWrite(motor_pin_1, HIGH);
-			digitalWrite(motor_pin_2, LOW);
-		}
-		else {
-			digitalWrite(motor_pin_1, LOW);
-			digitalWrite(motor_pin_2, HIGH);
-		}
+/*
+ * Acceleration set with setAcceleration(), in (micro)steps/s^2
+ */
+uint32_t Stepper::getAcceleration() const
+{
+  // back from a/F^2 with 48 fractional bits
+  return ((((uint64_t)this->ramp_accel * StepTimer::TICKS_PER_SEC) >> 24) * StepTimer::TICKS_PER_SEC) >> 24;
+}
 
-		if (coil2value > 0) {
-			digitalWrite(motor_pin_3, HIGH);
-			digitalWrite(motor_pin_4, LOW);
-		}
-		else {
-			digitalWrite(motor_pin_3, LOW);
-			digitalWrite(motor_pin_4, HIGH);
-		}
-	}
+/*
+ * Called from the Timer1 interrupt. Takes a step of the running stepper
+ * and returns the delay till the next one, or 0 when the move is over.
+ */
+uint32_t Stepper::onTimer()
+{
+  Stepper* stepper = running;
+  if (stepper == 0) {
+    return 0;
+  }
+
+  if (stepper->ramp_phase == RAMP_VELOCITY) {
+    stepper->step_function(*stepper);
+    return stepper->nextInterval();
+  }
+
+  if (stepper->async_steps_left > 0) {
+    stepper->step_function(*stepper);
+    stepper->async_steps_left--;
+  }
+
+  if (stepper->async_steps_left <= 0) {
+    stepper->moving = false;
+    return 0;
+  }
+  return stepper->nextInterval();
 }
 
 /*
- * Moves the motor forward or backwards.
+ * Plans the start of an asynchronous move. The divisions are done here
+ * and at the phase changes, never on every step.
  */
-void Stepper::stepMotor(const int& thisStep)
+void Stepper::startRamp()
 {
-	//yield() might be needed at slow RPM and/or many steps on an ESP8266
-  //yield(); 
-  if (this->pin_count == 2) {
-    switch (thisStep) {
-      case 0:  // 01
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, HIGH);
-      break;
-      case 1:  // 11
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, HIGH);
-      break;
-      case 2:  // 10
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, LOW);
-      break;
-      case 3:  // 00
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, LOW);
-      break;
+  uint32_t cruise = this->step_interval;
+
+  this->ramp_steps = 0;
+  this->ramp_marks[0] = 0;
+  this->ramp_marks[1] = 0;
+  this->ramp_fraction = 0;
+
+  // no acceleration, or the set speed is slower than where the ramp starts
+  if (this->ramp_accel == 0 || cruise >= this->ramp_start) {
+    this->ramp_phase = RAMP_NONE;
+    return;
+  }
+
+  this->ramp_interval = this->ramp_start;
+  if (this->ramp_jerk == 0) {
+    this->ramp_m = this->ramp_accel;
+    this->ramp_m_peak = this->ramp_accel;
+    this->ramp_target = cruise;
+    this->ramp_phase = RAMP_ACCEL;
+  }
+  else {
+    // the acceleration rises till it reaches its max, or till the speed is half way to the set speed
+    uint32_t start_speed = TICKS_SHIFTED / this->ramp_start;
+    uint32_t max_speed = TICKS_SHIFTED / cruise;
+    this->ramp_m = 0;
+    this->ramp_m_peak = 0;
+    this->ramp_target = TICKS_SHIFTED / ((start_speed + max_speed) / 2);
+    this->ramp_phase = RAMP_JERK_UP;
+  }
+}
+
+/*
+ * Called from the Timer1 interrupt after every step of an asynchronous
+ * move. Updates the interval following the acceleration profile. The
+ * ramp down is a mirror of the ramp up: it starts when the steps left are
+ * as many as the steps taken to ramp up, so it also works for moves that
+ * are too short to reach the set speed.
+ */
+uint32_t Stepper::nextInterval()
+{
+  switch (this->ramp_phase) {
+  case RAMP_NONE:
+    this->ramp_interval = this->step_interval;
+    break;
+
+  case RAMP_VELOCITY:
+    break;
+
+  case RAMP_JERK_UP:
+  case RAMP_ACCEL:
+  case RAMP_JERK_DOWN:
+    this->ramp_steps++;
+    if (this->async_steps_left <= this->ramp_steps) {
+      endRampUp();
+      this->ramp_phase = RAMP_DECEL;
+    }
+    else {
+      speedUp(this->step_interval);
     }
+    break;
+
+  case RAMP_CRUISE:
+    // a slower speed, set while cruising, is taken right away (not slower than the start of the ramps)
+    if (this->step_interval > this->ramp_interval) {
+      this->ramp_interval = (this->step_interval < this->ramp_start) ? this->step_interval : this->ramp_start;
+    }
+    if (this->async_steps_left <= this->ramp_steps) {
+      endRampUp();
+      this->ramp_phase = RAMP_DECEL;
+    }
+    break;
   }
-  if (this->pin_count == 4) {
-    switch (thisStep) {
-      case 0:  // 1010
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, LOW);
-        digitalWrite(motor_pin_3, HIGH);
-        digitalWrite(motor_pin_4, LOW);
-      break;
-      case 1:  // 0110
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, HIGH);
-        digitalWrite(motor_pin_3, HIGH);
-        digitalWrite(motor_pin_4, LOW);
-      break;
-      case 2:  //0101
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, HIGH);
-        digitalWrite(motor_pin_3, LOW);
-        digitalWrite(motor_pin_4, HIGH);
-      break;
-      case 3:  //1001
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, LOW);
-        digitalWrite(motor_pin_3, LOW);
-        digitalWrite(motor_pin_4, HIGH);
-      break;
+
+  if (this->ramp_phase == RAMP_DECEL) {
+    slowDown();
+  }
+
+  // whole ticks, the fraction is carried over to keep the average rate
+  uint16_t sum = this->ramp_fraction + (this->ramp_interval & 0xFF);
+  this->ramp_fraction = sum & 0xFF;
+  return (this->ramp_interval >> 8) + (sum >> 8);
+}
+
+/*
+ * One step of the ramp up
+ */
+void Stepper::speedUp(const uint32_t& cruise_interval)
+{
+  if (this->ramp_phase == RAMP_JERK_UP) {
+    this->ramp_m += jerkChange(this->ramp_jerk, this->ramp_interval);
+
+    bool half_way = this->ramp_interval <= this->ramp_target;
+    if (half_way || this->ramp_m >= this->ramp_accel) {
+      if (this->ramp_m > this->ramp_accel) {
+        this->ramp_m = this->ramp_accel;
+      }
+      this->ramp_m_peak = this->ramp_m;
+      this->ramp_marks[0] = this->ramp_steps;
+
+      if (half_way) {
+        this->ramp_marks[1] = this->ramp_steps;
+        this->ramp_phase = RAMP_JERK_DOWN;
+      }
+      else {
+        // the acceleration starts falling when the speed is as far from the
+        // set speed as it is now from the start speed
+        uint32_t start_speed = TICKS_SHIFTED / this->ramp_start;
+        uint32_t speed = TICKS_SHIFTED / this->ramp_interval;
+        uint32_t max_speed = TICKS_SHIFTED / cruise_interval;
+        this->ramp_target = TICKS_SHIFTED / (max_speed - (speed - start_speed));
+        this->ramp_phase = RAMP_ACCEL;
+      }
+    }
+  }
+  else if (this->ramp_phase == RAMP_ACCEL) {
+    if (this->ramp_jerk != 0 && this->ramp_interval <= this->ramp_target) {
+      this->ramp_marks[1] = this->ramp_steps;
+      this->ramp_phase = RAMP_JERK_DOWN;
     }
   }
+  else {
+    uint32_t change = jerkChange(this->ramp_jerk, this->ramp_interval);
+    this->ramp_m = (this->ramp_m > change) ? this->ramp_m - change : 0;
+  }
+
+  this->ramp_interval -= rampChange(this->ramp_interval, this->ramp_m, true);
+
+  if (this->ramp_interval <= cruise_interval || (this->ramp_phase == RAMP_JERK_DOWN && this->ramp_m == 0)) {
+    endRampUp();
+    this->ramp_interval = cruise_interval;
+    this->ramp_phase = RAMP_CRUISE;
+  }
+}
 
-  if (this->pin_count == 5) {
-    switch (thisStep) {
-      case 0:  // 01101
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, HIGH);
-        digitalWrite(motor_pin_3, HIGH);
-        digitalWrite(motor_pin_4, LOW);
-        digitalWrite(motor_pin_5, HIGH);
-        break;
-      case 1:  // 01001
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, HIGH);
-        digitalWrite(motor_pin_3, LOW);
-        digitalWrite(motor_pin_4, LOW);
-        digitalWrite(motor_pin_5, HIGH);
-        break;
-      case 2:  // 01011
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, HIGH);
-        digitalWrite(motor_pin_3, LOW);
-        digitalWrite(motor_pin_4, HIGH);
-        digitalWrite(motor_pin_5, HIGH);
-        break;
-      case 3:  // 01010
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, HIGH);
-        digitalWrite(motor_pin_3, LOW);
-        digitalWrite(motor_pin_4, HIGH);
-        digitalWrite(motor_pin_5, LOW);
-        break;
-      case 4:  // 11010
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, HIGH);
-        digitalWrite(motor_pin_3, LOW);
-        digitalWrite(motor_pin_4, HIGH);
-        digitalWrite(motor_pin_5, LOW);
-        break;
-      case 5:  // 10010
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, LOW);
-        digitalWrite(motor_pin_3, LOW);
-        digitalWrite(motor_pin_4, HIGH);
-        digitalWrite(motor_pin_5, LOW);
-        break;
-      case 6:  // 10110
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, LOW);
-        digitalWrite(motor_pin_3, HIGH);
-        digitalWrite(motor_pin_4, HIGH);
-        digitalWrite(motor_pin_5, LOW);
-        break;
-      case 7:  // 10100
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, LOW);
-        digitalWrite(motor_pin_3, HIGH);
-        digitalWrite(motor_pin_4, LOW);
-        digitalWrite(motor_pin_5, LOW);
-        break;
-      case 8:  // 10101
-        digitalWrite(motor_pin_1, HIGH);
-        digitalWrite(motor_pin_2, LOW);
-        digitalWrite(motor_pin_3, HIGH);
-        digitalWrite(motor_pin_4, LOW);
-        digitalWrite(motor_pin_5, HIGH);
-        break;
-      case 9:  // 00101
-        digitalWrite(motor_pin_1, LOW);
-        digitalWrite(motor_pin_2, LOW);
-        digitalWrite(motor_pin_3, HIGH);
-        digitalWrite(motor_pin_4, LOW);
-        digitalWrite(motor_pin_5, HIGH);
-        break;
+/*
+ * Records the steps at which the phases of the ramp up ended, for the
+ * ones that were cut short (at the set speed or when the move is too short)
+ */
+void Stepper::endRampUp()
+{
+  if (this->ramp_phase == RAMP_JERK_UP) {
+    this->ramp_m_peak = this->ramp_m;
+    this->ramp_marks[0] = this->ramp_steps;
+  }
+  if (this->ramp_phase == RAMP_JERK_UP || this->ramp_phase == RAMP_ACCEL) {
+    this->ramp_marks[1] = this->ramp_steps;
+  }
+}
+
+/*
+ * One step of the ramp down. The acceleration follows the ramp up backwards.
+ */
+void Stepper::slowDown()
+{
+  long steps_left = this->async_steps_left;
+  uint32_t change = jerkChange(this->ramp_jerk, this->ramp_interval);
+
+  if (steps_left > this->ramp_marks[1]) {
+    this->ramp_m += change;
+    if (this->ramp_m > this->ramp_m_peak) {
+      this->ramp_m = this->ramp_m_peak;
     }
   }
+  else if (steps_left <= this->ramp_marks[0]) {
+    this->ramp_m = (this->ramp_m > change) ? this->ramp_m - change : 0;
+  }
+
+  this->ramp_interval += rampChange(this->ramp_interval, this->ramp_m, false);
+  if (this->ramp_interval > this->ramp_start) {
+    this->ramp_interval = this->ramp_start;
+  }
 }
 
+/*
+ * The "step_function" of a STEP/DIR driver: sets DIR if the direction
+ * changed (and waits for the setup time of the driver), then one pulse of
+ * "pulse_width" us on STEP. The driver counts the (micro)steps itself, so
+ * there is no step number or table to keep here. The pulse is timed with
+ * delayMicroseconds(), i.e., the pulse width is spent in the interrupt:
+ * 2 us of the 20 us between steps at 50 kHz.
+ */
+void Stepper::pulseStep(Stepper& stepper)
+{
+  if (stepper.direction != stepper.driver.dir_level) {
+    stepper.driver.dir_level = stepper.direction;
+    stepper.writeDriverPin(1, stepper.direction == 1);
+    delayMicroseconds(stepper.driver.dir_setup);
+  }
+  if (stepper.driver.off) {
+    stepper.driver.off = false;
+    digitalWrite(stepper.motor_pin_3, LOW);
+  }
+
+  stepper.writeDriverPin(0, true);
+  delayMicroseconds(stepper.driver.pulse_width);
+  stepper.writeDriverPin(0, false);
+}
+
+/*
+ * Sets the STEP (index 0) or DIR (index 1) pin of a STEP/DIR driver
+ */
+void Stepper::writeDriverPin(const uint8_t& index, const bool& level)
+{
+#ifndef STEPPER_DIGITALWRITE
+  if (this->coil_port[index] != 0) {
+    // the ISRs may write other pins of the same port
+    uint8_t sreg = SREG;
+    cli();
+    if (level)
+      *this->coil_port[index] |= this->coil_mask[index];
+    else
+      *this->coil_port[index] &= ~this->coil_mask[index];
+    SREG = sreg;
+    return;
+  }
+#endif
+  digitalWrite(index == 0 ? this->motor_pin_1 : this->motor_pin_2, level ? HIGH : LOW);
+}
+
+/*
+ * Sets the coil pins to a row of "coil_bits": one register write per port,
+ * instead of one digitalWrite() per pin. The second port is a dummy if the
+ * pins are all on one (see setupCoils).
+ */
+void Stepper::writePorts(const uint8_t* bits)
+{
+  // the ISRs may write other pins of the same ports
+  uint8_t sreg = SREG;
+  cli();
+  *this->coil_port[0] = (*this->coil_port[0] & ~this->coil_mask[0]) | bits[0];
+  *this->coil_port[1] = (*this->coil_port[1] & ~this->coil_mask[1]) | bits[1];
+  SREG = sreg;
+}
+
+/*
+ * Sets the coil pins to "levels" with digitalWrite(), bit 0 is motor_pin_1
+ */
+void Stepper::writePins(const uint8_t& levels)
+{
+  const uint8_t pins[5] = { motor_pin_1, motor_pin_2, motor_pin_3, motor_pin_4, motor_pin_5 };
+  for (uint8_t i = 0; i < this->pin_count; i++) {
+    digitalWrite(pins[i], (levels >> i) & 1 ? HIGH : LOW);
+  }
+}
+
+
+/*
+ * Connects the PWM pins of the microstepping to their timer and keeps
+ * their compare registers, so that a microstep writes the duty straight
+ * into OCRxx (see writeDuty) instead of calling analogWrite(). The
+ * outputs are inverted (low while the counter is below OCRxx) and
+ * OCRxx = ~duty: then 0 is fully off in fast PWM too, where a normal
+ * output still gives a pulse of one timer clock. The timers keep the
+ * mode and prescaler of the core (Timer0: fast PWM, 977 Hz; Timer2:
+ * phase correct, 490 Hz) till setPwmFrequency() is called.
+ * Pins on Timer1 (9, 10, taken by StepTimer) or without a timer, and
+ * other boards, keep using analogWrite().
+ */
+void Stepper::setupPwm()
+{
+#ifdef STEPPER_TIMER_PWM
+  const uint8_t pins[2] = { motor_pwm_pin_1, motor_pwm_pin_2 };
+  for (uint8_t k = 0; k < 2; k++) {
+    digitalWrite(pins[k], LOW);  // off while it is not connected to the timer
+    switch (digitalPinToTimer(pins[k])) {
+      case TIMER0A: OCR0A = 0xFF; TCCR0A |= _BV(COM0A1) | _BV(COM0A0); this->pwm_ocr[k] = &OCR0A; break;
+      case TIMER0B: OCR0B = 0xFF; TCCR0A |= _BV(COM0B1) | _BV(COM0B0); this->pwm_ocr[k] = &OCR0B; break;
+      case TIMER2A: OCR2A = 0xFF; TCCR2A |= _BV(COM2A1) | _BV(COM2A0); this->pwm_ocr[k] = &OCR2A; break;
+      case TIMER2B: OCR2B = 0xFF; TCCR2A |= _BV(COM2B1) | _BV(COM2B0); this->pwm_ocr[k] = &OCR2B; break;
+      default: this->pwm_ocr[k] = 0; break;
+    }
+  }
+#endif
+}
+
+/*
+ * Sets the PWM duty (0 .. PWMRANGE) of the enable pin of coil 0 or 1
+ */
+void Stepper::writeDuty(const uint8_t& coil, const uint8_t& duty)
+{
+  IO_REGISTER_PTR ocr = this->pwm_ocr[coil];
+  if (ocr)
+    *ocr = ~duty;  // inverted output, see setupPwm()
+  else
+    analogWrite(coil == 0 ? motor_pwm_pin_1 : motor_pwm_pin_2, duty);
+}
+
+/*
+ * Sets the frequency of the PWM on the enable pins. The microsteps change
+ * the duty at the step rate, a PWM that is not much faster than that
+ * doesn't give the coil current time to follow, and the default 490 or
+ * 977 Hz of analogWrite() can be heard. Only Timer2 can be changed: Timer0
+ * (pins 5, 6) also runs millis(), micros() and delay(), and Timer1 (pins
+ * 9, 10) runs the steps in the background (StepTimer). So both PWM pins
+ * must be 3 and 11. Timer2 is put in fast PWM mode with the prescaler that
+ * gives the closest frequency of F_CPU / 256 / {1, 8, 32, 64, 128, 256,
+ * 1024}, i.e., 62.5 kHz (PWM_FREQUENCY_ULTRASONIC) down to 61 Hz. Check
+ * that the motor driver can switch that fast (the L298 up to about
+ * 40 kHz, use 7.8 kHz then). tone() can't be used with it.
+ * Returns false, without changing anything, for other pins.
+ */
+bool Stepper::setPwmFrequency(const uint32_t& frequency)
+{
+#ifdef STEPPER_TIMER_PWM
+  for (uint8_t k = 0; k < 2; k++) {
+    if (this->pwm_ocr[k] != &OCR2A && this->pwm_ocr[k] != &OCR2B)
+      return false;
+  }
+
+  static const uint16_t prescalers[7] = { 1, 8, 32, 64, 128, 256, 1024 };
+  uint8_t best = 0;
+  for (uint8_t i = 1; i < 7; i++) {
+    if (labs((long)(F_CPU / 256 / prescalers[i]) - (long)frequency) < labs((long)(F_CPU / 256 / prescalers[best]) - (long)frequency))
+      best = i;
+  }
+
+  TCCR2A |= _BV(WGM21) | _BV(WGM20);  // fast PWM, TOP = 0xFF
+  TCCR2B = (TCCR2B & ~(_BV(WGM22) | _BV(CS22) | _BV(CS21) | _BV(CS20))) | (best + 1);
+  return true;
+#else
+  (void)frequency;
+  return false;
+#endif
+}
 
 /*
 off() turns of the motor by clearing motor pins to by clearing pwm/enable pins:
 */
 void Stepper::off(void)
 {
+	// a STEP/DIR driver is turned off with its EN pin, if it is connected. The next step turns it on again.
+	if (this->pin_count == 0) {
+		if (this->motor_pin_3 != StepDirDriver::NO_PIN) {
+			digitalWrite(this->motor_pin_3, HIGH);
+			this->driver.off = true;
+		}
+	}
 	// if microstepping is used, the motor can be turned off by clearing the PWM pins (even in the case of 2 wire configuration)
-	if (this->micro_stepping) {
-		analogWrite(motor_pwm_pin_1, 0);
-		analogWrite(motor_pwm_pin_2, 0);
+	else if (this->micro_stepping) {
+		writeDuty(0, 0);
+		writeDuty(1, 0);
 	}
 	else if (this->pin_count == 2) {
 		//This is not possible with 2 wire configuration without using  the PWM/enable pins.
@@ -1,5 +1,5 @@
 /*
- * Stepper.h - Stepper library for Wiring/Arduino - Version 1.2.1
+ * Stepper.h - Stepper library for Wiring/Arduino - Version 1.3.0
  *
  * Original library        (0.1)   by Tom Igoe.
  * Two-wire modifications  (0.2)   by Sebastian Gassner
@@ -10,6 +10,7 @@
  * Five phase five wire    (1.1.0) by Ryan Orendorff
  * Microstepping on bipolar(1.2.0) by Attila Kov�cs
  * Few corrections         (1.2.1) by Rahul Subramonian Bama
+ * Timer driven stepping   (1.3.0) by Rahul Subramonian Bama
  * 
  * v(1.2.1) Corrections Include: 
  * 1. Commenting out analogWriteFreq();
@@ -19,6 +20,73 @@
  *    unncessary 'ints'. Reducing size in RAM by 32 bytes.
  * 5. Changed the relavant functions pass by value to pass by reference,
  *    to speed up runtime execution of the function in arduino.
+ *
+ * v(1.3.0) Additions Include:
+ * 1. stepAsync(), isMoving(), stepsRemaining() and stop(). The steps are
+ *    generated from the Timer1 compare interrupt (see StepTimer.h), so
+ *    that step() is not the only way to move the motor and the sketch
+ *    can do something else while the motor moves. Only one stepper can
+ *    move asynchronously at a time.
+ * 2. Every constructor sets "phase", the one byte that keeps the step
+ *    of the sequence (or the phase of the microstep table) the coils
+ *    are on, and "direction", so the first step starts from a known
+ *    state.
+ * 3. setAcceleration(), setJerk() and setStepRate(). The asynchronous
+ *    moves ramp up from standstill, cruise and ramp down, with a
+ *    trapezoidal (or jerk limited S-curve) speed profile. The step
+ *    intervals are updated with integer multiplications only, see
+ *    nextInterval() in Stepper.cpp.
+ * 4. The coil pins are resolved to their port registers and bitmasks in
+ *    the constructor, and each step sets all of them with one register
+ *    write per port instead of up to five digitalWrite() calls. Define
+ *    STEPPER_DIGITALWRITE to go back to digitalWrite().
+ * 5. The four-wire + PWM constructor uses all four pins (it was
+ *    setting up a two-wire motor).
+ * 6. setVelocity(): moves at a signed speed, without a number of steps,
+ *    till it is set to 0. Meant for a control loop that changes the
+ *    speed from its own (timer) interrupt, see LinActWithRotEnc.
+ *    getStepRate() and getAcceleration() give back the settings.
+ * 7. stepOnce(): a single (micro)step without any delay, for code that
+ *    times the steps of several motors itself (see LinActMultiAxis).
+ * 8. The (micro)step is taken through "step_function". The constructors
+ *    set the step function of their wiring (CoilWiring<>::step or
+ *    stepPins, see item 12) or pulseStep() for a STEP/DIR driver, and
+ *    FixedStepper (see FixedStepper.h) sets one that is built at compile
+ *    time for fixed pins and microsteps, with the port writes folded in.
+ * 9. One microstep table for 2, 4, 8, 16 and 32 microsteps, generated
+ *    by the compiler from the sine and stored in flash (PROGMEM) as the
+ *    PWM duties and the directions of the coil currents, so a microstep
+ *    is a table lookup and the pin writes. It replaces the tables of
+ *    1/2, 1/4 and 1/8 microstepping that were in RAM.
+ * 10. The PWM pins of the microstepping are driven through the compare
+ *    registers of their timer (OCR0A/B, OCR2A/B), written directly on
+ *    every microstep instead of with analogWrite(). setPwmFrequency()
+ *    runs Timer2 (PWM pins 3 and 11) in fast PWM up to 62.5 kHz, above
+ *    the microstep rate and out of hearing. See setupPwm() in Stepper.cpp.
+ * 11. STEP/DIR constructor (see StepDirDriver below) for drivers like
+ *    the A4988, DRV8825 or TMC2208: every (micro)step is one pulse on
+ *    the STEP pin, with the direction on the DIR pin, and the driver does
+ *    the coil currents and the microstepping itself. Up to the 50 kHz of
+ *    StepTimer::MIN_INTERVAL in the background.
+ * 12. The wirings are policies (see CoilWiring in Stepper.cpp): full
+ *    steps on 2 or 4 wires, 5 phase, microsteps on 2 or 4 wires + PWM.
+ *    Each has its own phase table, and the constructor picks the step
+ *    function of its wiring once, so a step is the phase counter, a table
+ *    lookup and the port writes, without the tests of pin_count and
+ *    micro_stepping on every step. The step and microstep numbers are
+ *    one byte of phase, 10 bytes less per Stepper on the AVR.
+ * 13. setStepRateMilli() and getStepRateMilli(): speeds in 1/1000 steps
+ *    per second. The interval between the steps is kept in Timer1 ticks
+ *    with 8 fractional bits for all moves and the fraction is carried from
+ *    step to step, so long moves run at the rate that was set instead of
+ *    a whole number of us (or ticks) per step. setSpeed() goes through it
+ *    without truncating the rpm to us per step and per microstep. step()
+ *    is timed by Timer1 too, instead of polling micros().
+ * 14. A slower speed set while an asynchronous move cruises is taken
+ *    from the next step on (see the stall detection of LinActWithRotEnc).
+ * 15. stepAsync() waits, and setVelocity() doesn't start (it returns
+ *    false), while Timer1 channel A moves a group of LinActMultiAxis, not
+ *    only another stepper.
  *    
  * This library is free software; you can redistribute it and/or
  * modify it under the terms of the GNU Lesser General Public
@@ -90,7 +158,39 @@
 #ifndef Stepper_h
 #define Stepper_h
 
+#include "StepTimer.h"
+
 #define PWMRANGE 255
+#define MICROSTEP_RESOLUTION 32	// microsteps per step of the microstep table, the most a motor can have
+
+// the PWM pins are written through the timer registers of the ATmega328P/168, see setupPwm()
+#if (defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)) && !defined(STEPPER_DIGITALWRITE)
+#define STEPPER_TIMER_PWM
+#endif
+
+// the port and compare registers that the step functions write, and the pointers kept to them; the host
+// build has its own types for both
+#ifndef IO_REGISTER
+#define IO_REGISTER volatile uint8_t
+#define IO_REGISTER_PTR volatile uint8_t*
+#endif
+
+template<uint8_t PIN_1, uint8_t PIN_2, uint8_t PIN_3, uint8_t PIN_4, uint8_t MICRO_STEPS> class FixedStepper;
+
+// Pins and timing of a STEP/DIR driver, e.g. {8, 9, StepDirDriver::NO_PIN, 16, 2, 1}
+struct StepDirDriver {
+  uint8_t step_pin;        // a step on every rising edge
+  uint8_t dir_pin;         // high: forward
+  uint8_t enable_pin;      // EN (enabled when low, as on the A4988/DRV8825), NO_PIN if it is not connected
+  uint8_t micro_steps;     // set on the driver (MS pins), 1 to 128. Every pulse is one microstep
+  uint8_t pulse_width_us;  // STEP high time, A4988: 1, DRV8825: 2, TMC2208: 1 (DEFAULT_PULSE_WIDTH_US)
+  uint8_t dir_setup_us;    // from a change of DIR to the next rising edge of STEP (DEFAULT_DIR_SETUP_US)
+
+  static const uint8_t NO_PIN = 0xFF;
+  static const uint8_t DEFAULT_PULSE_WIDTH_US = 2;
+  static const uint8_t DEFAULT_DIR_SETUP_US = 1;
+};
+
 // library interface description
 class Stepper {
   public:
@@ -108,30 +208,105 @@ class Stepper {
     
     Stepper(const uint16_t& number_of_steps, const uint8_t& motor_pin_1, const uint8_t& motor_pin_2, const uint8_t& motor_pin_3, const uint8_t& motor_pin_4, const uint8_t& motor_pin_5);
 
-    // speed setter method:
+    // STEP/DIR driver, number_of_steps is full steps per revolution (the steps are microsteps of "driver"):
+    Stepper(const uint16_t& number_of_steps, const StepDirDriver& driver);
+
+    // frequency of the PWM of the microstepping, only for PWM pins on Timer2 (3, 11), false if it can't be set:
+    bool setPwmFrequency(const uint32_t& frequency);
+    static const uint32_t PWM_FREQUENCY_ULTRASONIC = F_CPU / 256;	// 62.5 kHz: fast PWM without prescaler
+
+    // speed setter methods:
     void setSpeed(const uint16_t& whatSpeed);
+    void setStepRate(const uint32_t& steps_per_second); // same as setSpeed, in (micro)steps per second
+    void setStepRateMilli(const uint32_t& millisteps_per_second); // in 1/1000 (micro)steps per second, for fractional speeds
 
-    // mover method:
+    // acceleration profile of the asynchronous moves, 0 turns it off (default):
+    void setAcceleration(const uint32_t& steps_per_second_2); // the moves run at the set speed if 0
+    void setJerk(const uint32_t& steps_per_second_3); // trapezoidal profile if 0, S-curve otherwise
+
+    // mover method (waits till the steps are taken by the Timer1 interrupt):
     void step(const int& number_of_steps);
 
+    // asynchronous mover methods (steps are taken from the Timer1 interrupt):
+    void stepAsync(const long& number_of_steps); // starts moving and returns immediately
+    bool isMoving() const;
+    long stepsRemaining() const;
+    void stop(); // stops the asynchronous move after the step in progress
+    bool setVelocity(const long& steps_per_second); // moves at this speed (sign: direction, down to 1 step/s) till it is set to 0,
+                                                    // false if the timer is taken by another stepper or group
+    void stepOnce(const bool& forward); // one (micro)step right away, can be called from an interrupt
+
+    // getters of the speed and acceleration settings:
+    uint32_t getStepRate() const;	// (micro)steps per second
+    uint32_t getStepRateMilli() const;	// 1/1000 (micro)steps per second
+    uint32_t getAcceleration() const;	// (micro)steps/s^2, 0 if there is no ramp
+
 	// turns off the coils of the motor
 	void off();
 
     int version(void);
 
   private:
-    void stepMotor(const int& this_step);
-	void microStepMotor(const int& this_step, const int& this_micro_step);
+    template<uint8_t PIN_1, uint8_t PIN_2, uint8_t PIN_3, uint8_t PIN_4, uint8_t MICRO_STEPS> friend class FixedStepper;
+
+    // wirings of the coils, see Stepper.cpp. Each one moves "phase" one (micro)step through its own table,
+    // CoilWiring makes the "step_function" of it (with the port registers, or with digitalWrite())
+    template<class Wiring> struct CoilWiring;
+    struct FullStepWiring;	// 2 or 4 wires, 4 steps
+    struct FivePhaseWiring;	// 5 wires, 10 steps
+    struct MicroStepWiring;	// 2 or 4 wires + PWM, the phases of "microstep_table"
+    template<class Wiring> void setupCoils(const uint8_t* levels, const uint8_t& num_rows);	// called by the constructors
+
+    static void pulseStep(Stepper& stepper);	// "step_function" of a STEP/DIR driver: one pulse on the STEP pin
+    static void noStep(Stepper& stepper);	// "step_function" of the empty constructor: no pins, nothing to write
+    void writeDriverPin(const uint8_t& index, const bool& level);	// STEP (0) or DIR (1) pin of a STEP/DIR driver
+    void (*step_function)(Stepper& stepper);	// takes every (micro)step: the one of the wiring, pulseStep or FixedStepper
+    void writePorts(const uint8_t* bits);	// sets the coil pins to a row of "coil_bits"
+    void writePins(const uint8_t& levels);	// sets the coil pins with digitalWrite(), bit 0 is motor_pin_1
+    void setupPwm();	// connects the PWM pins to their timer, called by the PWM constructors
+    void writeDuty(const uint8_t& coil, const uint8_t& duty);	// PWM duty of coil 0 or 1
+    // coil currents of a microstep, see "microstep_table"
+    struct MicroStep {
+      uint8_t duty_1;     // PWM duty of coil 1 (motor_pwm_pin_1)
+      uint8_t duty_2;     // PWM duty of coil 2 (motor_pwm_pin_2)
+      uint8_t polarity;   // direction of the currents: bit 0 set if coil 1 is positive, bit 1 for coil 2
+    };
+    static constexpr MicroStep microStep(const uint8_t& phase);	// entry of "microstep_table", computed by the compiler
+
+    static uint32_t onTimer();	// StepTimer callback, takes a step of the "running" stepper
+    static Stepper* volatile running;	// stepper that is moved by the timer
+    bool timerTaken() const;	// the timer moves another stepper or a group (see LinActMultiAxis)
+
+    // acceleration profile of the asynchronous moves
+    void startRamp();	// plans the start of a move
+    uint32_t nextInterval();	// interval in ticks till the next step of the move
+    void speedUp(const uint32_t& cruise_interval);
+    void slowDown();
+    void endRampUp();	// records where the ramp up ended, for the ramp down
 
     uint8_t direction;            // Direction of rotation
-    unsigned long step_delay; // delay between steps, in ms, based on speed
     uint16_t number_of_steps;      // total number of steps this motor can take
-    uint8_t pin_count;            // how many pins are in use.
-    int step_number;          // which step the motor is on
+    uint8_t pin_count{ 0 };       // how many pins are in use, 0 for a STEP/DIR driver
+    uint8_t phase{ 0 };           // which step of the sequence the coils are on, or phase of the microstep table
 	bool micro_stepping{ false };      //is microstepping enabled
     uint8_t number_of_micro_steps;          //holds the number of microsteps
-    uint8_t micro_step_number;          // which micro step the motor is on
-    unsigned long micro_step_delay; //delay between microsteps
+    uint8_t micro_step_stride{ 0 };          // MICROSTEP_RESOLUTION / number_of_micro_steps, phases of the table per microstep
+    uint32_t step_interval{ 0xFFFFUL << 8 }; // delay between (micro)steps in Timer1 ticks with 8 fractional bits, based on speed
+    volatile long async_steps_left{ 0 }; // steps left in the asynchronous move
+    volatile bool moving{ false };       // true while an asynchronous move is in progress
+
+    // Intervals of the profile are in Timer1 ticks with 8 fractional bits. "F" is the num of Timer1 ticks per second.
+    uint32_t ramp_accel{ 0 };     // acceleration as a/F^2 with 48 fractional bits, 0: no ramp
+    uint32_t ramp_jerk{ 0 };      // jerk as j/F^3 with 64 fractional bits, 0: trapezoidal profile
+    uint32_t ramp_start{ 0 };     // interval of the first step, the slowest one of the ramps
+    uint32_t ramp_interval;       // interval of the current step
+    uint32_t ramp_target;         // interval at which the current phase of the ramp up ends
+    uint32_t ramp_m;              // acceleration of the current step, same units as ramp_accel
+    uint32_t ramp_m_peak;         // highest acceleration reached while ramping up
+    long ramp_steps;              // num of steps taken while ramping up
+    long ramp_marks[2];           // ramp_steps at the end of the rising and of the constant acceleration
+    uint8_t ramp_phase{ 0 };      // see "RampPhase" in Stepper.cpp
+    uint8_t ramp_fraction;        // fraction of a tick carried over to the next interval
 
     // motor pin numbers:
     uint8_t motor_pin_1;
@@ -142,14 +317,39 @@ class Stepper {
 
     uint8_t motor_pwm_pin_1;
     uint8_t motor_pwm_pin_2;
+    IO_REGISTER_PTR pwm_ocr[2]{ 0, 0 };	// compare registers of the PWM pins, 0: analogWrite()
+
+    // coil pins as port registers, at most 2 ports (coil_port[1] is a dummy if there is only one).
+    // STEP/DIR driver: the STEP pin in [0] and the DIR pin in [1], see pulseStep().
+    IO_REGISTER_PTR coil_port[2];
+    uint8_t coil_mask[2];         // coil pins of each port
+
+    // STEP/DIR driver (motor_pin_1: STEP, motor_pin_2: DIR, motor_pin_3: EN)
+    struct DriverTiming {
+      uint8_t pulse_width;        // STEP high time in us
+      uint8_t dir_setup;          // us from a change of DIR to the STEP pulse
+      uint8_t dir_level;          // "direction" that the DIR pin is set to
+      bool off;                   // EN was set high by off(), the next step sets it low again
+    };
+
+    union {
+      // value of the coil pins of each port, for each row of the wiring (step of the sequence or
+      // polarity of the microstep). With digitalWrite(), the levels of the pins in [row][0].
+      uint8_t coil_bits[10][2];
+      DriverTiming driver;        // a STEP/DIR driver has no coils
+    };
+
+	static MicroStep const microstep_table [4 * MICROSTEP_RESOLUTION];	// in flash (PROGMEM)
+
+	static uint8_t const sequence_2_wire [4];
 
-    unsigned long last_step_time; // time stamp in us of when the last step was taken
+	static uint8_t const sequence_4_wire [4];
 
-	static int const microstepping_1_2 [4][2][2];
+	static uint8_t const sequence_5_wire [10];
 
-	static int const microstepping_1_4 [4][4][2];
+	static uint8_t const polarity_2_wire [4];
 
-	static int const microstepping_1_8 [4][8][2];
+	static uint8_t const polarity_4_wire [4];
 };
 
 
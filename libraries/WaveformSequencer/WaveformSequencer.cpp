@@ -0,0 +1,307 @@
+/*
+	WaveformSequencer.h - Library that runs a displacement waveform on a
+	linear actuator with encoder feedback, from a table of segments.
+
+	GNU GPL License
+ */
+
+#include "WaveformSequencer.h"
+#include "StepTimer.h"
+#include "SerialLog.h"
+
+
+namespace ns_rot = Sensor::Encoder::Rotary;
+namespace ns_sys = System::StepperRotary;
+namespace ns_seq = System::Sequencer;
+
+
+ns_seq::Obj ns_seq::init(LinActWithRotEnc::Obj& my_system){
+
+	ns_seq::Obj my_sequencer;
+
+	my_sequencer.head  = 0;
+	my_sequencer.tail  = 0;
+	my_sequencer.count = 0;
+
+	my_sequencer.state.phase        = ns_seq::PHASE_IDLE;
+	my_sequencer.state.hold_left_ms = 0;
+	my_sequencer.state.last_time    = 0;
+	my_sequencer.state.completed    = 0;
+	my_sequencer.state.from_um      = 0;
+	my_sequencer.state.linked       = false;
+	my_sequencer.state.passed       = 0;
+	my_sequencer.state.replan       = false;
+
+	my_sequencer.pSystem     = &my_system;
+	my_sequencer.printStatus = false;
+
+	return my_sequencer;
+}
+
+
+bool ns_seq::push(ns_seq::Obj& my_sequencer, const ns_seq::Segment& segment){
+
+	if (my_sequencer.count >= ns_seq::QUEUE_SIZE){
+		return false;
+	}
+
+	my_sequencer.queue[my_sequencer.head] = segment;
+	my_sequencer.head = (my_sequencer.head + 1) % ns_seq::QUEUE_SIZE;
+	my_sequencer.count++;
+	my_sequencer.state.replan = true;
+
+	return true;
+}
+
+
+uint8_t ns_seq::space(const ns_seq::Obj& my_sequencer){
+	return ns_seq::QUEUE_SIZE - my_sequencer.count;
+}
+
+
+// Takes the next segment out of the queue
+static ns_seq::Segment popSegment(ns_seq::Obj& my_sequencer){
+
+	ns_seq::Segment segment = my_sequencer.queue[my_sequencer.tail];
+	my_sequencer.tail = (my_sequencer.tail + 1) % ns_seq::QUEUE_SIZE;
+	my_sequencer.count--;
+	return segment;
+}
+
+
+// Segment "k" after the running one: the linked one first, then the queue
+static const ns_seq::Segment& upcoming(const ns_seq::Obj& my_sequencer, const uint8_t& k){
+
+	if (my_sequencer.state.linked){
+		if (k == 0){
+			return my_sequencer.state.next;
+		}
+		return my_sequencer.queue[(my_sequencer.tail + k - 1) % ns_seq::QUEUE_SIZE];
+	}
+	return my_sequencer.queue[(my_sequencer.tail + k) % ns_seq::QUEUE_SIZE];
+}
+
+
+// Speed limit of a segment in steps/s, 0: the speed set on the actuator (see LinActWithRotEnc::setServo).
+// All in integers, the segments are already in micro meters.
+static uint32_t segmentRate(const ns_sys::Obj& my_system, const ns_seq::Segment& segment){
+	return LinActStepper::getStepsUm(*my_system.pActuator, segment.speed_um_s);
+}
+
+
+// Speed in steps/s at which segment "a" (from "from_um") can go on to "b" without stopping: 0 if "a" holds its
+// target or "b" turns back, else the slower of the two
+static uint32_t junctionRate(const ns_sys::Obj& my_system, const int32_t& from_um, const ns_seq::Segment& a,
+                             const ns_seq::Segment& b){
+
+	int32_t first  = a.target_um - from_um;
+	int32_t second = b.target_um - a.target_um;
+	if (a.hold_ms != 0 || first == 0 || second == 0 || (first > 0) != (second > 0)){
+		return 0;
+	}
+
+	uint32_t rate_a = segmentRate(my_system, a);
+	uint32_t rate_b = segmentRate(my_system, b);
+	uint32_t rate_0 = my_system.pActuator->stepper_obj.getStepRate();
+	if (rate_a == 0) rate_a = rate_0;
+	if (rate_b == 0) rate_b = rate_0;
+	uint32_t rate = (rate_a < rate_b) ? rate_a : rate_b;
+
+	// Same limit as the servo, keeps v^2 in 32 bits
+	if (rate > StepTimer::TICKS_PER_SEC / StepTimer::MIN_INTERVAL){
+		rate = StepTimer::TICKS_PER_SEC / StepTimer::MIN_INTERVAL;
+	}
+	return rate;
+}
+
+
+// Fastest speed at which the running segment can end, squared: going backwards from the last segment in the queue
+// (which stops), the speed at the start of each segment is the one from which the servo can still slow down to the
+// speed at its end over its length (v^2 = v_end^2 + 2 a s), and not faster than the junction with the one before it.
+static uint32_t planExitRate2(const ns_seq::Obj& my_sequencer){
+
+	const ns_seq::State& state = my_sequencer.state;
+	const ns_sys::Obj& my_system = *my_sequencer.pSystem;
+	const uint32_t accel = my_system.state.accel; // Of the servo, in steps/s^2
+	const uint8_t num_upcoming = my_sequencer.count + (state.linked ? 1 : 0);
+
+	uint32_t rate2 = 0;
+	for (int8_t k = num_upcoming - 1; k >= 0; k--){
+		const ns_seq::Segment& segment = upcoming(my_sequencer, k);
+		const ns_seq::Segment& before  = (k == 0) ? state.segment : upcoming(my_sequencer, k - 1);
+		const int32_t before_from      = (k == 0) ? state.from_um : ((k == 1) ? state.segment.target_um :
+		                                                              upcoming(my_sequencer, k - 2).target_um);
+
+		uint32_t junction = junctionRate(my_system, before_from, before, segment);
+		if (junction == 0){
+			rate2 = 0;
+			continue;
+		}
+
+		uint32_t length = labs(LinActStepper::getStepsUm(*my_system.pActuator, segment.target_um - before.target_um));
+		if (accel == 0 || length > (0xFFFFFFFFUL - rate2) / 2 / accel){
+			rate2 = 0xFFFFFFFFUL;
+		}
+		else {
+			rate2 += 2 * accel * length;
+		}
+		if (rate2 > junction * junction){
+			rate2 = junction * junction;
+		}
+	}
+	return rate2;
+}
+
+
+// Plans the end of the running segment. If it doesn't have to stop there, the next segment is handed to the servo.
+static void planSegment(ns_seq::Obj& my_sequencer){
+
+	ns_seq::State& state = my_sequencer.state;
+	ns_sys::Obj& my_system = *my_sequencer.pSystem;
+	state.replan = false;
+
+	uint32_t exit_rate = FixedPoint::squareRoot(planExitRate2(my_sequencer));
+	if (state.linked){
+		ns_sys::setExitRate(my_system, exit_rate);
+		return;
+	}
+	if (exit_rate == 0){
+		return;
+	}
+
+	// Only the speed limit changes, the gain and the acceleration stay as they are
+	const ns_seq::Segment& next = my_sequencer.queue[my_sequencer.tail];
+	my_system.servo.max_rate = segmentRate(my_system, next);
+	if (ns_sys::setNextTargetUm(my_system, next.target_um, exit_rate)){
+		state.next   = popSegment(my_sequencer);
+		state.linked = true;
+	}
+}
+
+
+// Starts the move of the next segment in the queue
+static void startSegment(ns_seq::Obj& my_sequencer){
+
+	ns_seq::State& state = my_sequencer.state;
+	ns_sys::Obj& my_system = *my_sequencer.pSystem;
+
+	// From standstill, the segment starts where the encoder is
+	state.from_um = ns_rot::getPosition(*my_system.pRotary) * 1000 / my_system.convert.disp2encpos;
+	state.segment = popSegment(my_sequencer);
+	state.linked  = false;
+	state.passed  = 0;
+
+	my_system.servo.max_rate = segmentRate(my_system, state.segment);
+	ns_sys::moveToAsyncUm(my_system, state.segment.target_um);
+	state.phase  = ns_seq::PHASE_MOVING;
+	state.replan = true;
+}
+
+
+// Counts the segment that is running as done
+static void finishSegment(ns_seq::Obj& my_sequencer){
+
+	ns_seq::State& state = my_sequencer.state;
+	state.completed++;
+
+	if (my_sequencer.printStatus == true){
+		Print& record = SerialLog::begin();
+		record.print("Waveform Sequencer >> Segment Done >> Time(millis), Num, Target(um), Settle Time(us): ");
+		record.print(millis());
+		record.print(", ");
+		record.print(state.completed);
+		record.print(", ");
+		record.print(state.segment.target_um);
+		record.print(", ");
+		record.println(ns_sys::getSettleTime(*my_sequencer.pSystem));
+		SerialLog::end();
+	}
+}
+
+
+// Counts the time since the last call against the hold. True when the hold is over.
+static bool countHold(ns_seq::State& state, const unsigned long& now){
+
+	unsigned long elapsed_ms = (now - state.last_time) / 1000;
+	if (elapsed_ms >= state.hold_left_ms){
+		state.hold_left_ms = 0;
+		return true;
+	}
+
+	// The fraction of a milli second is left in "last_time" for the next call
+	state.last_time += elapsed_ms * 1000UL;
+	state.hold_left_ms -= elapsed_ms;
+	return false;
+}
+
+
+void ns_seq::update(ns_seq::Obj& my_sequencer){
+
+	ns_seq::State& state = my_sequencer.state;
+	ns_sys::Obj& my_system = *my_sequencer.pSystem;
+
+	if (state.phase == ns_seq::PHASE_MOVING){
+		// The servo crossed the target and went on to the linked segment
+		if (state.linked && ns_sys::getPassed(my_system) != state.passed){
+			state.passed++;
+			finishSegment(my_sequencer);
+			state.from_um = state.segment.target_um;
+			state.segment = state.next;
+			state.linked  = false;
+			state.replan  = true;
+		}
+
+		if (ns_sys::atTarget(my_system)){
+			// The hold starts when the servo settled at the target
+			state.last_time    = my_system.state.start_time + ns_sys::getSettleTime(my_system);
+			state.hold_left_ms = state.segment.hold_ms;
+			state.phase        = ns_seq::PHASE_HOLDING;
+		}
+		else if (state.replan){
+			planSegment(my_sequencer);
+		}
+		if (state.phase == ns_seq::PHASE_MOVING){
+			return;
+		}
+	}
+
+	if (state.phase == ns_seq::PHASE_HOLDING){
+		if (!countHold(state, micros())){
+			return;
+		}
+
+		finishSegment(my_sequencer);
+		state.phase = ns_seq::PHASE_IDLE;
+	}
+
+	if (state.phase == ns_seq::PHASE_IDLE && my_sequencer.count > 0){
+		startSegment(my_sequencer);
+	}
+}
+
+
+bool ns_seq::isIdle(const ns_seq::Obj& my_sequencer){
+	return my_sequencer.state.phase == ns_seq::PHASE_IDLE && my_sequencer.count == 0;
+}
+
+
+void ns_seq::stop(ns_seq::Obj& my_sequencer){
+
+	ns_sys::stop(*my_sequencer.pSystem);
+
+	my_sequencer.head  = 0;
+	my_sequencer.tail  = 0;
+	my_sequencer.count = 0;
+	my_sequencer.state.phase  = ns_seq::PHASE_IDLE;
+	my_sequencer.state.linked = false;
+}
+
+
+unsigned long ns_seq::getCompleted(const ns_seq::Obj& my_sequencer){
+	return my_sequencer.state.completed;
+}
+
+
+void ns_seq::printCommands(ns_seq::Obj& my_sequencer, const bool& status){
+	my_sequencer.printStatus = status;
+}
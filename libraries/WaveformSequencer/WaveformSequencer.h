@@ -0,0 +1,119 @@
+/*
+	WaveformSequencer.h - Library that runs a displacement waveform on a
+	linear actuator with encoder feedback, from a table of segments. This
+	library builds on "LinActWithRotEnc".
+
+	Segments:
+	A waveform is a list of segments. Each segment moves the actuator to an
+	absolute target (in micro meters) at a given speed and then holds it
+	there for a given time:
+
+	| target_um | speed_um_s | hold_ms |    (10 bytes)
+
+	"speed_um_s" of 0 means the speed set on the actuator. The segments
+	wait in a ring buffer of QUEUE_SIZE entries. More segments can be added
+	with "push" while the waveform runs, e.g., as they arrive via serial
+	from the PC, so a protocol of thousands of cycles never has to fit in
+	the RAM of the arduino. "space" tells how many segments can be pushed.
+
+	Timing:
+	The moves are done by the servo of "LinActWithRotEnc" in the background
+	and the hold starts at the moment the servo settled at the target (see
+	"LinActWithRotEnc::getSettleTime"), not when "update" happens to notice
+	it. The hold is counted from that time stamp with micros(), carrying the
+	fraction of a milli second over, so the end of a hold is exact to the
+	time between two calls of "update" and that error doesn't add up from
+	one segment to the next (unlike "delay()" after a blocking move, where
+	the time the move takes and the overhead of the code add up).
+
+	Look-ahead:
+	A segment without a hold that is followed by one in the same direction
+	doesn't stop at its target: the servo crosses it at the junction speed
+	and goes on to the next target (see "Look-ahead" in LinActWithRotEnc.h),
+	so a ramp that is sent as many points runs at its speed instead of
+	stopping at every point. The junction speed is the slower of the speeds
+	of the two segments. It is lowered, going backwards through the queue,
+	till the servo can slow down with its acceleration for every stop
+	further on: a hold, a turn back, and the last segment in the queue
+	(nothing is known after it). So the queue is the look-ahead. The more
+	segments wait, the longer the run at full speed; keep it filled. The
+	plan is made again when a segment is pushed or one is passed, not on
+	every "update". A segment that is crossed is done at that moment.
+
+	Call "update" as often as possible from loop(), it never waits.
+
+
+	About Code:
+	Similar style as in RotaryEncoder.h. The queue lives in the "Obj", so you
+	can run several sequencers on different systems. A system can only be
+	moved by one sequencer at a time, and the servo of "LinActWithRotEnc"
+	moves one system at a time (see LinActWithRotEnc.h).
+
+
+	GNU GPL License
+ */
+
+
+#include "Arduino.h"
+#include "LinActWithRotEnc.h"
+
+
+#ifndef WAVEFORMSEQUENCER_H
+#define WAVEFORMSEQUENCER_H
+
+namespace System{
+	namespace Sequencer{
+
+		static const uint8_t QUEUE_SIZE = 16; // Num of segments that can wait in the queue
+
+		struct Segment{
+			int32_t target_um;   // Absolute target in micro meters
+			uint16_t speed_um_s; // 0: the speed set on the actuator
+			uint32_t hold_ms;    // Time to stay at the target once it is reached
+		};
+
+		enum Phase { PHASE_IDLE = 0, PHASE_MOVING, PHASE_HOLDING };
+
+		struct State{
+			uint8_t phase;
+			Segment segment;          // Segment that is running
+			int32_t from_um;          // Where it started: the target before it
+			Segment next;             // Segment that the servo goes on to without stopping, if "linked"
+			bool linked;
+			uint16_t passed;          // "LinActWithRotEnc::getPassed" as last seen
+			bool replan;              // The queue changed since the last plan
+			uint32_t hold_left_ms;    // Whole milli seconds of the hold still to go
+			unsigned long last_time;  // micros() up to which the hold is counted
+			unsigned long completed;  // Num of segments done since "init"
+		};
+
+		typedef struct MyObj{
+			Segment queue[QUEUE_SIZE];
+			uint8_t head; // Next free entry
+			uint8_t tail; // Next segment to run
+			uint8_t count;
+			State state;
+			LinActWithRotEnc::Obj* pSystem;
+			bool printStatus; // Set this to true or false via "printCommands", to print every segment that is done. Default: False
+		} Obj;
+
+
+		Obj init(LinActWithRotEnc::Obj& my_system);
+
+		bool push(Obj& my_sequencer, const Segment& segment); // Adds a segment at the end, false if the queue is full
+		uint8_t space(const Obj& my_sequencer); // Num of segments that can still be pushed
+
+		void update(Obj& my_sequencer); // Starts the next segment when the current one is done. Doesn't wait.
+		bool isIdle(const Obj& my_sequencer); // True when all the segments are done
+		void stop(Obj& my_sequencer); // Stops the actuator and clears the queue
+
+		unsigned long getCompleted(const Obj& my_sequencer); // Num of segments done
+		void printCommands(Obj& my_sequencer, const bool& status); // Prints every segment that is done via serial
+	}
+}
+
+
+// Set the namespace as library name so that it is easier to access the functions
+namespace WaveformSequencer = System::Sequencer;
+
+#endif
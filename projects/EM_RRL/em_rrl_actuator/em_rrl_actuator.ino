@@ -10,11 +10,29 @@
 	This code controls the stepper motor to move the linear stage in a predefined
 	waveform with encoder feedback. 
 
-	The code gets the rpm of switching the stepper motor, the sensor length and a 
-	list of 10 strain percentages as input from the user via serial. This is used
-	to set the  speed of the motor and generate the waveforms for each particular
-	strain percent according to the sensor length. The genereated waveform is then
-	used to control the  stepper with encoder feedback.
+	The code gets the rpm of switching the stepper motor and the sensor length as
+	input from the user via serial. Then the waveform is streamed from the PC as
+	segments, one per line, while it runs (see WaveformSequencer.h):
+
+	<strain %> <hold time in ms> [<speed in mm/s>]
+
+	The actuator moves to the strain (with encoder feedback), reaches it, and
+	holds it for the given time before the next segment starts. Without a speed
+	the speed set at the start is used. Segments with a hold of 0 in the same
+	direction run through without stopping at each target, so a triangle or
+	sine ramp can be sent as many points with "0" as hold time and runs at the
+	speed (see "Look-ahead" in WaveformSequencer.h). Every line is answered with "OK <n>",
+	where n is the num of segments that can still be sent, or "FULL" if the line
+	was dropped because the queue was full, or "ERR" if it isn't a segment
+	(e.g., an empty line, a missing hold time, something after the speed, a
+	negative speed or one above 65.535 mm/s). So the PC can keep the queue filled
+	and run protocols of thousands of cycles. "STOP" stops the actuator and
+	clears the queue. A line "Waveform Sequencer >> Segment Done >> ..." is
+	printed every time a segment is done.
+
+	The waveform that was hard coded before, for each strain S:
+	0 10000, then 3 times [S 10000, S+1 2000, S-1 2000, S 5000, 0 15000],
+	then 2 5000, 0 50000.
 
 	Created by Rahul Subramonian Bama, May 14, 2019 
 	GNU GPL License
@@ -25,7 +43,9 @@
 #include "RotaryEncoder.h"
 #include "LinActStepper.h"
 #include "LinActWithRotEnc.h"
+#include "WaveformSequencer.h"
 #include "SerialComm.h"
+#include "SerialLog.h"
 
 
 // Serial Settings
@@ -33,15 +53,16 @@ static const uint32_t SERIAL_BAUD_RATE = 2000000;
 
 
 // Encoder Settings
-static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Connect to External Interrupt pins
+static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Any two pins, see RotaryEncoder.h
 static const uint16_t CPR = 4000; // Encoder's counts per revolution
 
 
 // Linear Actuator Settings
-static const uint8_t STEPPER_PINS[4] = {7,4,6,5};
-static const uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
-static const uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
-static const uint8_t LEAD_LENGTH = 12; // in mm.
+static constexpr uint8_t STEPPER_PINS[4] = {7,4,6,5}; // constexpr: the pins are template parameters of "Fixed" below
+static constexpr uint16_t NUM_STEPS = 200; // for stepper to complete 1 revolution
+static constexpr uint8_t MICRO_STEPS = 8; // Each step is divided into this many steps
+static constexpr uint8_t LEAD_LENGTH = 12; // in mm.
+static const float ACCELERATION = 50.0; // in mm/s^2. The moves ramp up and down so the motor doesn't stall at high rpm
 
 
 // System Settings
@@ -53,15 +74,19 @@ static const float TOLERANCE_FACTOR = 2.5; // This gets multipled by CPR/(NUM_ST
 namespace ns_sys = LinActWithRotEnc;
 namespace ns_rot = RotaryEncoder;
 namespace ns_act = LinActStepper;
+namespace ns_seq = WaveformSequencer;
 
 
 // Get objects for Encoder and Linear actuator
 static ns_rot::Obj my_rotary   = ns_rot::init(ENCODER_PINS, CPR);
-static ns_act::Obj my_actuator = ns_act::init(STEPPER_PINS, NUM_STEPS, LEAD_LENGTH, MICRO_STEPS);
+static ns_act::Obj my_actuator = ns_act::Fixed<STEPPER_PINS[0], STEPPER_PINS[1], STEPPER_PINS[2], STEPPER_PINS[3],
+                                                  NUM_STEPS, LEAD_LENGTH, MICRO_STEPS>::init();
 static ns_sys::Obj my_system   = ns_sys::init(my_rotary, my_actuator, TOLERANCE_FACTOR);
+static ns_seq::Obj my_sequencer = ns_seq::init(my_system);
 
 
 static float sensor_length;
+static char line[32]; // Line received from the PC
 
 
 
@@ -72,33 +97,49 @@ void setup(){
 	SerialComm::waitForSignal();
 
 
-	// Read the speed, sensor_length and the list of strain %
+	// Read the speed and sensor_length
 	long set_speed = Serial.parseInt();
 	ns_act::setSpeed(my_actuator, set_speed);
+	ns_act::setAcceleration(my_actuator, ACCELERATION);
 
 	sensor_length = Serial.parseFloat();
-
-	float percentage_strain[10];
-	for (uint8_t i=0; i<10; i++){
-		percentage_strain[i] = Serial.parseFloat();
+	while (Serial.available() > 0){
+		Serial.read(); // Clear i/p buffer
 	}
 
+	ns_seq::printCommands(my_sequencer, true);
+	reply("OK ", ns_seq::space(my_sequencer));
+}
 
-	// Wait to start executing experiment
-	SerialComm::waitForSignal();
-	Serial.read(); // Clear i/p buffer
 
+void loop(){
+
+	ns_seq::update(my_sequencer);
+	SerialLog::drain();
 
-	// Execute each strain waveform
-	for(uint8_t i=0; i<10; i++){
-		if (percentage_strain[i]>0){
-			executeWaveform(percentage_strain[i]);
-		}
+	if (!SerialComm::readLine(line, sizeof(line))){
+		return;
 	}
-}
 
+	if (strcmp(line, "STOP") == 0){
+		ns_seq::stop(my_sequencer);
+		reply("OK ", ns_seq::space(my_sequencer));
+		return;
+	}
 
-void loop(){
+	// A line that isn't a segment is not queued, the actuator would go to a strain of 0 in the middle of the protocol
+	ns_seq::Segment segment;
+	if (!parseSegment(line, segment)){
+		reply("ERR", -1);
+		return;
+	}
+
+	if (ns_seq::push(my_sequencer, segment)){
+		reply("OK ", ns_seq::space(my_sequencer));
+	}
+	else {
+		reply("FULL", -1);
+	}
 }
 
 
@@ -106,44 +147,49 @@ void loop(){
 
 // Supporting functions:
 
-void executeWaveform(const float& strain){
-	// Delay before start of %Strain
-	delay(10000);
-
-	// Execute the 3 cycles
-	for (uint8_t j=0; j<3; j++){
-		cycle(strain);
+// <strain %> <hold time in ms> [<speed in mm/s>], false if "text" is anything else
+bool parseSegment(const char* text, ns_seq::Segment& segment){
+	char* next;
 
-		// Delay between cycles
-		delay(15000);
+	float strain = strtod(text, &next);
+	float target_um = -strain*sensor_length*10.0; // -strain/100 * sensor length in mm * 1000
+	if (next == text || !(fabs(target_um) < 2e9)){ // No number, or one that doesn't fit in the int32_t (or NaN)
+		return false;
 	}
 
-	// Final 2% strain. Give in absolute values
-	strainStep(2.0);
-	delay(5000);
-	strainStep(0.0);
-
-	// Delay after strain waveform is over
-	delay(50000);
-}
+	const char* field = next;
+	long hold_ms = strtol(field, &next, 10);
+	if (next == field || hold_ms < 0){
+		return false;
+	}
 
+	field = next;
+	float speed_mm_s = strtod(field, &next); // Optional, 0 if it is missing
+	float speed_um_s = speed_mm_s*1000.0 + 0.5;
+	if (!(speed_mm_s >= 0 && speed_um_s < 0x10000UL)){ // Negative, too fast for the uint16_t, or NaN
+		return false;
+	}
 
-void cycle(const float& strain){
-	// Give Strains percentage in absolute values
-	strainStep(strain);
-	delay(10000);
-	strainStep(strain + 1.0);
-	delay(2000);
-	strainStep(strain - 1.0);
-	delay(2000);
-	strainStep(strain);
-	delay(5000);
-	strainStep(0);
+	while (isspace(*next)){
+		next++;
+	}
+	if (*next != '\0'){
+		return false;
+	}
 
+	segment.target_um  = target_um;
+	segment.speed_um_s = speed_um_s;
+	segment.hold_ms    = hold_ms;
+	return true;
 }
 
 
-void strainStep(const float& strain){
-	float abs_disp_mm = -strain*sensor_length/100.0;
-	ns_sys::moveTo(my_system, abs_disp_mm);
+void reply(const char* text, const int& value){
+	Print& record = SerialLog::begin();
+	record.print(text);
+	if (value >= 0){
+		record.print(value);
+	}
+	record.println();
+	SerialLog::end();
 }
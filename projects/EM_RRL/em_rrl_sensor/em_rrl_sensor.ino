@@ -10,9 +10,36 @@
 	measured  by connecting it to analog pin 0.
 
 	This code keeps track of the encoder position and prints out the time (in micro
-	seconds), encoder position and the analog voltage (0-1023) in a single line
-	separated by  a space (" "), via Serial at exactly 200 Hz (using Timer 
-	interrupts).
+	seconds), encoder position and the analog voltage (0-4095, see EXTRA_BITS) in a
+	single line separated by  a space (" "), via Serial at exactly SAMPLE_RATE Hz.
+
+	The samples are taken in the background by AnalogSampler (see
+	AnalogSampler.h): Timer1 starts every conversion of the ADC, and the ADC
+	interrupt stores the value with its time and the encoder position in a
+	ring buffer. loop() only takes them out of the buffer and sends them, so
+	the samples stay evenly spaced however long the sending takes, and rates
+	of several kHz are possible (up to AnalogSampler::MAX_RATE, or
+	AnalogSampler::FREE_RUNNING for the fastest the ADC can do). If loop()
+	can't keep up, e.g., text output at a high rate, samples are dropped and
+	counted (AnalogSampler::getOverruns).
+
+	The ADC actually runs 4^EXTRA_BITS times faster than SAMPLE_RATE, and the
+	ADC interrupt adds up that many conversions into one sample (see
+	AnalogFilter.h, oversampling). Each sample has EXTRA_BITS more bits than
+	analogRead and less noise, for the same serial bandwidth; divide by
+	2^EXTRA_BITS to get the scale of analogRead. With EXTRA_BITS of 0 the
+	samples are the raw ones (0-1023).
+
+	With BINARY_OUTPUT set to true the same values are sent in binary frames
+	instead (see SerialComm.h), 18 bytes per sample instead of about 25, with
+	a sequence number to spot lost samples. The samples that are waiting in
+	the buffer share a frame, down to about 11 bytes per sample at high
+	rates. With COMPRESSED_OUTPUT also set to true, only the changes from one
+	sample to the next are sent (see SerialComm.h, "Delta frames"), 1 to 3
+	bytes per sample, so the sample rate can go up 4 to 5 times on the same
+	baud rate. Those frames are sent when they are full or every FLUSH_MS.
+	Decode them on the PC with
+	"host/FrameDecoder/decode_frames", which prints the same lines as above.
 
 	Note: Do not overload interrupts i.e., it is not desired to have an interrupt
 	(encoder, for example) to trigger when another interrupt (timer)	is in
@@ -29,7 +56,8 @@
 	a bool condition. In the timer ISR I just changed the bool value. Because of
 	the very short ISR the encoders counts weren't missed. The encoder interrupt
 	are  sometimes triggered when printing via serial and this doesn't affect the
-	actual value of any variable that is printed. 
+	actual value of any variable that is printed. The ADC interrupt of
+	AnalogSampler is kept short for the same reason.
 
 	Created by Rahul Subramonian Bama, May 14, 2019
 	GNU GPL License
@@ -38,24 +66,27 @@
 
 
 #include "RotaryEncoder.h"
+#include "AnalogSampler.h"
+#include "AnalogFilter.h"
 #include "SerialComm.h"
 
 
 // Serial Settings
 static const uint32_t SERIAL_BAUD_RATE = 2000000;
+static const bool BINARY_OUTPUT = false; // Send binary frames instead of text
+static const bool COMPRESSED_OUTPUT = false; // With BINARY_OUTPUT: delta compressed frames
+static const uint32_t FLUSH_MS = 50; // Compressed frames wait at most this long to fill up
 
 
 // Encoder Settings
-static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Connect to External Interrupt pins
+static const uint8_t ENCODER_PINS[2] = {2,3}; // Channel A and B. Any two pins, see RotaryEncoder.h
 static const uint16_t CPR = 4000; // Encoder's counts per revolution
 
 
-// Timer Settings. This works only for ATmega328p, as I'm manipulating its registries
-static const uint16_t TIMER1_LOAD = 0; // Reset timer to this value when a compare match interrupt is generated
-static const uint16_t TIMER1_COMP = 10000; // Set frequency to 200Hz: (1/200)/(8/16e6) 
-                                // where 8 is the timer prescaler (See startTimer function to change value),
-                                // 200 is the desired freq, and 16e6 is arduino clock freq.
-static volatile bool send_data = false; // Send data only when timer instructs
+// Sampling Settings. This works only for ATmega328p, as AnalogSampler uses its Timer1 and ADC registries
+static const uint8_t ANALOG_PIN = 0; // Voltage across the sensor
+static const uint32_t SAMPLE_RATE = 200; // Hz, SAMPLE_RATE * 4^EXTRA_BITS must be MIN_RATE to MAX_RATE (see AnalogSampler.h)
+static const uint8_t EXTRA_BITS = 2; // Bits above the 10 of the ADC, by oversampling. 0 to AnalogFilter::MAX_EXTRA_BITS
 
 
 // Shorthand notation for namespace.
@@ -66,62 +97,60 @@ namespace ns_rot = RotaryEncoder;
 static ns_rot::Obj my_rotary   = ns_rot::init(ENCODER_PINS, CPR);
 
 
-// Begin Communication, wait for signal and then start timer after i/p received.
+// Get objects for the filter of the analog samples
+static AnalogFilter::Obj my_filter = (EXTRA_BITS > 0) ? AnalogFilter::oversample(EXTRA_BITS) : AnalogFilter::none();
+
+
+// Begin Communication, wait for signal and then start sampling after i/p received.
 void setup(){
 
 	Serial.begin(SERIAL_BAUD_RATE);
 	SerialComm::waitForSignal(); //Specify any value to start data collection
 	Serial.read(); // Clear serial buffer
 
-	startTimer();
+	AnalogSampler::start(ANALOG_PIN, SAMPLE_RATE * AnalogFilter::getDecimation(my_filter), &my_rotary, &my_filter);
 }
 
 
-// Print when timer instructs
+// Send the samples that have been taken since the last loop
 void loop(){
 
- 	if (send_data){
-		Serial.print(micros());
+	AnalogSampler::Sample sample;
+
+ 	if (BINARY_OUTPUT && COMPRESSED_OUTPUT){
+		static uint32_t last_flush = 0;
+		while (AnalogSampler::read(sample)){
+			SerialFrame::Sample frame_sample;
+			frame_sample.time     = sample.time;
+			frame_sample.position = sample.position;
+			frame_sample.analog   = sample.analog;
+			SerialComm::streamSample(frame_sample);
+		}
+		if (millis() - last_flush >= FLUSH_MS){
+			SerialComm::flushSamples();
+			last_flush = millis();
+		}
+ 	}
+ 	else if (BINARY_OUTPUT){
+		// Up to SAMPLES_PER_FRAME samples in one frame, saves the header and CRC of the others
+		SerialFrame::Sample frame_samples[SerialComm::SAMPLES_PER_FRAME];
+		uint8_t num_samples = 0;
+		while (num_samples < SerialComm::SAMPLES_PER_FRAME && AnalogSampler::read(sample)){
+			frame_samples[num_samples].time     = sample.time;
+			frame_samples[num_samples].position = sample.position;
+			frame_samples[num_samples].analog   = sample.analog;
+			num_samples++;
+		}
+		if (num_samples > 0){
+			SerialComm::sendSamples(frame_samples, num_samples);
+		}
+ 	}
+ 	else if (AnalogSampler::read(sample)){
+		Serial.print(sample.time);
 		Serial.print(" ");
-		Serial.print(ns_rot::getPosition(my_rotary));
+		Serial.print(sample.position);
 		Serial.print(" ");
-		Serial.println(analogRead(0));
-
-		send_data = false;
+		Serial.println(sample.analog);
  	}
 }
 
-
-
-
-// Supporting Functions:
-
-void startTimer(){
-	// Reset timer 1 control Reg A
-	TCCR1A = 0;
-
-	// Set timer prescaler to 8
-	TCCR1B &= ~(1 << CS12);
-	TCCR1B |= (1 << CS11);
-	TCCR1B &= ~(1 << CS10);
-
-	// Reset Timer1 and set compare value
-	TCNT1 = TIMER1_LOAD;
-	OCR1A = TIMER1_COMP;
-
-	// Enable Timer1 comapare interrupt
-	TIMSK1 = (1 << OCIE1A);
-
-	// Enable global interrupts
-	sei(); 
-}
-
-
-// Print commands are not specified inside ISR because of Interrupt Overhead from Encoders
-ISR(TIMER1_COMPA_vect){
-	// Reset Timer1
-	TCNT1 = TIMER1_LOAD;
-
-	// Send data
-	send_data = true;	
-}